@@ -0,0 +1,244 @@
+/*============================================================================
+ * @file name      : HeapFuzz.c
+ * @Author         : Shehab Aldeen Mohammed
+ * @Github         : https://github.com/ShehabAldeenMo
+ * @LinkedIn       : https://www.linkedin.com/in/shehab-aldeen-mohammed/
+ *
+ =============================================================================
+ * @Description:
+ * This file contains the fuzzing harness of the simulated heap. It drives
+ * HeapManager_Malloc, HeapManager_Free and a realloc built on top of them from
+ * a byte stream, and after every operation it runs the heap consistency checker
+ * and compares the heap against a shadow model of the live blocks.
+ *
+=============================================================================
+ * @Notes:
+ * - libFuzzer : clang -fsanitize=fuzzer -DHEAP_FUZZ_LIBFUZZER ...
+ * - AFL       : afl-gcc ... then `afl-fuzz -i in -o out ./heap_fuzz`
+ * - Standalone: `./heap_fuzz file...`, `./heap_fuzz < file` or
+ *               `./heap_fuzz --random <runs> [seed]`
+ *
+ ******************************************************************************
+ ==============================================================================
+*/
+
+/*===================================  Includes ==============================*/
+#include "HeapFuzz.h"
+#include "HeapTest.h"
+
+
+/*============================  extern Global Variable ==============================*/
+extern _Thread_local Heap* CurHeap;                   // heap instance the operations of this thread work on
+
+/*==============================  typedef   =====================================*/
+typedef struct HeapFuzzSlot {
+    sint8* Ptr;         // data pointer returned by the heap manager, NULL if the slot is empty
+    size_t Size;        // size requested by the input
+    uint8  Tag;         // byte pattern written in the whole block
+} HeapFuzzSlot;
+
+
+/*=============================  Static Variables ==============================*/
+static HeapFuzzSlot Shadow[HEAP_FUZZ_SLOTS];
+static uint8        NextTag = 1 ;
+
+
+/*=========================  Static Functions ===========================*/
+static void HeapFuzz_Fail(const char* Reason, sint8* Ptr) {
+    fprintf(stderr, "HeapFuzz: %s (block %p)\n", Reason, (void*)Ptr);
+    abort();
+}
+
+static void HeapFuzz_CheckHeap(void) {
+    if (HeapTest_CheckConsistency(CurHeap) == INVALID) {
+        HeapFuzz_Fail("heap consistency check failed", NULL);
+    }
+}
+
+/*
+ * Verify that a block returned by the heap manager lies inside the heap, is large
+ * enough and does not overlap any other live block of the shadow model.
+ */
+static void HeapFuzz_CheckNewBlock(uint8 Slot) {
+    sint8* Start = Shadow[Slot].Ptr - sizeof(size_t);
+    sint8* End   = Shadow[Slot].Ptr + HeapManager_GetSize(Shadow[Slot].Ptr);
+
+    if (((uintptr_t)Shadow[Slot].Ptr % 8) != 0) {
+        HeapFuzz_Fail("block is not aligned on 8", Shadow[Slot].Ptr);
+    }
+    if (Start < CurHeap->RegionStart || End > CurHeap->CurBreak) {
+        HeapFuzz_Fail("block is out of heap limits", Shadow[Slot].Ptr);
+    }
+    if (HeapManager_GetSize(Shadow[Slot].Ptr) < Shadow[Slot].Size) {
+        HeapFuzz_Fail("block is smaller than requested", Shadow[Slot].Ptr);
+    }
+
+    for (uint8 i = 0; i < HEAP_FUZZ_SLOTS; i++) {
+        if (i == Slot || Shadow[i].Ptr == NULL) {
+            continue;
+        }
+        sint8* OtherStart = Shadow[i].Ptr - sizeof(size_t);
+        sint8* OtherEnd   = Shadow[i].Ptr + HeapManager_GetSize(Shadow[i].Ptr);
+        if (Start < OtherEnd && OtherStart < End) {
+            HeapFuzz_Fail("block overlaps another live block", Shadow[Slot].Ptr);
+        }
+    }
+}
+
+static void HeapFuzz_Fill(uint8 Slot) {
+    Shadow[Slot].Tag = NextTag++ ;
+    memset(Shadow[Slot].Ptr, Shadow[Slot].Tag, HeapManager_GetSize(Shadow[Slot].Ptr));
+}
+
+static void HeapFuzz_Verify(uint8 Slot, size_t Length) {
+    for (size_t j = 0; j < Length; j++) {
+        if ((uint8)Shadow[Slot].Ptr[j] != Shadow[Slot].Tag) {
+            HeapFuzz_Fail("block content was overwritten", Shadow[Slot].Ptr);
+        }
+    }
+}
+
+static void HeapFuzz_Free(uint8 Slot) {
+    HeapFuzz_Verify(Slot, HeapManager_GetSize(Shadow[Slot].Ptr));
+    HeapManager_Free(Shadow[Slot].Ptr);
+    Shadow[Slot].Ptr = NULL ;
+}
+
+static void HeapFuzz_Alloc(uint8 Slot, size_t Size) {
+    if (Shadow[Slot].Ptr != NULL) {
+        HeapFuzz_Free(Slot);
+    }
+
+    Shadow[Slot].Ptr  = HeapManager_Malloc(Size);
+    Shadow[Slot].Size = Size ;
+    if (Shadow[Slot].Ptr == NULL) {
+        HeapFuzz_Fail("allocation failed", NULL);
+    }
+
+    HeapFuzz_CheckNewBlock(Slot);
+    HeapFuzz_Fill(Slot);
+}
+
+/*
+ * Same semantics as realloc in MyHeap.c: allocate, copy the common part and free the old block.
+ */
+static void HeapFuzz_Realloc(uint8 Slot, size_t Size) {
+    if (Shadow[Slot].Ptr == NULL) {
+        HeapFuzz_Alloc(Slot, Size);
+        return;
+    }
+
+    sint8* OldPtr  = Shadow[Slot].Ptr ;
+    size_t OldSize = HeapManager_GetSize(OldPtr);
+    sint8* NewPtr  = HeapManager_Malloc(Size);
+    if (NewPtr == NULL) {
+        HeapFuzz_Fail("reallocation failed", OldPtr);
+    }
+    size_t NewSize = HeapManager_GetSize(NewPtr);
+
+    memcpy(NewPtr, OldPtr, (OldSize < NewSize) ? OldSize : NewSize);
+    HeapFuzz_Verify(Slot, OldSize);
+    HeapManager_Free(OldPtr);
+
+    Shadow[Slot].Ptr  = NewPtr ;
+    Shadow[Slot].Size = Size ;
+    HeapFuzz_CheckNewBlock(Slot);
+    HeapFuzz_Verify(Slot, (OldSize < NewSize) ? OldSize : NewSize);
+    HeapFuzz_Fill(Slot);
+}
+
+
+/*=========================  Functions Implementation ===========================*/
+void HeapFuzz_RunInput(const uint8* Data, size_t Size) {
+    for (size_t i = 0; i + HEAP_FUZZ_OP_LENGTH <= Size; i += HEAP_FUZZ_OP_LENGTH) {
+        uint8  Op      = Data[i] % 3 ;
+        uint8  Slot    = Data[i + 1] % HEAP_FUZZ_SLOTS ;
+        size_t ReqSize = ((size_t)Data[i + 2] | ((size_t)Data[i + 3] << 8)) % HEAP_FUZZ_MAX_SIZE ;
+
+        if (Op == HEAP_FUZZ_OP_ALLOC) {
+            HeapFuzz_Alloc(Slot, ReqSize);
+        }
+        else if (Op == HEAP_FUZZ_OP_FREE) {
+            if (Shadow[Slot].Ptr != NULL) {
+                HeapFuzz_Free(Slot);
+            }
+        }
+        else {
+            HeapFuzz_Realloc(Slot, ReqSize);
+        }
+
+        HeapFuzz_CheckHeap();
+    }
+
+    /* release everything so the next input starts from an empty heap */
+    for (uint8 Slot = 0; Slot < HEAP_FUZZ_SLOTS; Slot++) {
+        if (Shadow[Slot].Ptr != NULL) {
+            HeapFuzz_Free(Slot);
+            HeapFuzz_CheckHeap();
+        }
+    }
+
+#if QUICKLIST == ENABLE
+    HeapQuickList_Flush(0);
+    HeapFuzz_CheckHeap();
+#endif
+
+    if (CurHeap->ptrHead != NULL &&
+        (CurHeap->ptrHead != CurHeap->ptrTail || CurHeap->ptrHead != (FreeBlock*)CurHeap->RegionStart ||
+         (sint8*)CurHeap->ptrHead + sizeof(size_t) + CurHeap->ptrHead->BlockSize != CurHeap->CurBreak)) {
+        HeapFuzz_Fail("heap is not a single free block after freeing everything", (sint8*)CurHeap->ptrHead);
+    }
+}
+
+
+/*==================================  Entry Points =============================*/
+#ifdef HEAP_FUZZ_LIBFUZZER
+
+int LLVMFuzzerTestOneInput(const uint8_t* Data, size_t Size) {
+    HeapFuzz_RunInput(Data, Size);
+    return 0;
+}
+
+#else
+
+static void HeapFuzz_RunStream(FILE* Stream) {
+    static uint8 Input[1 << 20];
+    size_t Length = fread(Input, 1, sizeof(Input), Stream);
+    HeapFuzz_RunInput(Input, Length);
+}
+
+int main(int argc, char** argv) {
+    if (argc >= 3 && strcmp(argv[1], "--random") == 0) {
+        static uint8 Input[HEAP_FUZZ_RANDOM_LENGTH];
+        long Runs = atol(argv[2]);
+        unsigned int Seed = (argc >= 4) ? (unsigned int)atol(argv[3]) : (unsigned int)time(NULL);
+
+        printf("Random fuzzing: %ld runs, seed %u\n", Runs, Seed);
+        srand(Seed);
+        for (long Run = 0; Run < Runs; Run++) {
+            for (size_t i = 0; i < sizeof(Input); i++) {
+                Input[i] = (uint8)rand();
+            }
+            HeapFuzz_RunInput(Input, sizeof(Input));
+        }
+    }
+    else if (argc >= 2) {
+        for (int i = 1; i < argc; i++) {
+            FILE* Stream = fopen(argv[i], "rb");
+            if (Stream == NULL) {
+                perror(argv[i]);
+                return EXIT_FAILURE;
+            }
+            HeapFuzz_RunStream(Stream);
+            fclose(Stream);
+        }
+    }
+    else {
+        HeapFuzz_RunStream(stdin);
+    }
+
+    printf("No heap inconsistency found.\n");
+    return 0;
+}
+
+#endif
@@ -0,0 +1,61 @@
+/*============================================================================
+ * @file name      : HeapFuzz.h
+ * @Author         : Shehab Aldeen Mohammed
+ * @Github         : https://github.com/ShehabAldeenMo
+ * @LinkedIn       : https://www.linkedin.com/in/shehab-aldeen-mohammed/
+ *
+ =============================================================================
+ * @Description:
+ * This header file declares the fuzzing harness of the simulated heap. The
+ * harness decodes a byte stream into a sequence of allocate, free and realloc
+ * operations, checks the heap consistency after every step and keeps a shadow
+ * model of the live blocks to catch overlapping or corrupted allocations.
+ *
+=============================================================================
+ * @Notes:
+ * - Built with libFuzzer when `HEAP_FUZZ_LIBFUZZER` is defined, otherwise a
+ *   standalone main reads inputs from files or stdin (AFL compatible) and can
+ *   also generate random inputs by itself.
+ * - Any violation prints a diagnostic on stderr and calls abort() so that the
+ *   fuzzing engine records the crashing input.
+ *
+ ******************************************************************************
+ ==============================================================================
+*/
+#ifndef HEAP_FUZZ_H_
+#define HEAP_FUZZ_H_
+
+/*===================================  Includes ===============================*/
+#include "../Level_2/HeapManager.h"
+#include <stdint.h>
+
+
+/*==================================  Definitions =============================*/
+#define HEAP_FUZZ_SLOTS          64                     // live blocks tracked by the shadow model
+#define HEAP_FUZZ_MAX_SIZE       (3 * BREAK_STEP_SIZE)  // large enough to cross a break step
+#define HEAP_FUZZ_OP_LENGTH      4                      // opcode, slot and two size bytes
+#define HEAP_FUZZ_RANDOM_LENGTH  4096                   // input length used by the random mode
+
+/*
+ * Operations decoded from the first byte of every 4 byte record
+ */
+#define HEAP_FUZZ_OP_ALLOC       0
+#define HEAP_FUZZ_OP_FREE        1
+#define HEAP_FUZZ_OP_REALLOC     2
+
+
+/*==========================  Function Prototypes ===========================*/
+/*
+ * Name             : HeapFuzz_RunInput
+ * Description      : Replays one fuzz input on the simulated heap. Every 4 bytes form an operation
+ *                    (opcode, slot, size low byte, size high byte), trailing bytes are ignored.
+ * Input            : Data - The fuzz input.
+ *                    Size - Length of the fuzz input in bytes.
+ * Output           : None
+ * Return           : None
+ * Notes            : All blocks still live at the end of the input are freed and the quick lists are 
+ *                    flushed, so consecutive inputs always start from a heap that holds a single free block.
+ */
+void HeapFuzz_RunInput(const uint8* Data, size_t Size);
+
+#endif
@@ -22,35 +22,45 @@
 
 /*===================================  Includes ==============================*/
 #include "HeapTest.h"
+#include <sys/wait.h>
+#include <unistd.h>
 
 
 /*============================  extern Global Variable ==============================*/
-extern FreeBlock* ptrHead;
-extern FreeBlock* ptrTail;
+extern _Thread_local Heap* CurHeap;                   // heap instance the operations of this thread work on
 
 uint32 Fail = 0 ;
 
+/*==============================  typedef   =====================================*/
+/* message exchanged through the shared heap by HeapTest_SharedHeapTest */
+typedef struct ShmMessage {
+    sint32 Producer;
+    sint32 Index;
+    size_t Length;
+    uint8  Payload[];
+} ShmMessage;
+
 /*=========================  Functions Implementation ===========================*/
 
 void HeapTest_PrintBordersState() {
     printf("-----------------------------------------------------------------------------------------\n");
     
     // Print information about ptrHead
-    if (ptrHead != NULL) {
-        printf("ptrHead: %p\n", (void*)ptrHead);
-        printf("ptrHead BlockSize: %5ld\n", ptrHead->BlockSize);
-        printf("ptrHead NextFreeBlock: %p\n", (void*)ptrHead->NextFreeBlock);
-        printf("ptrHead PreviousFreeBlock: %p\n", (void*)ptrHead->PreviousFreeBlock);
+    if (CurHeap->ptrHead != NULL) {
+        printf("ptrHead: %p\n", (void*)CurHeap->ptrHead);
+        printf("ptrHead BlockSize: %5ld\n", CurHeap->ptrHead->BlockSize);
+        printf("ptrHead NextFreeBlock: %p\n", (void*)HeapUtils_NextFree(CurHeap->ptrHead));
+        printf("ptrHead PreviousFreeBlock: %p\n", (void*)HeapUtils_PreviousFree(CurHeap->ptrHead));
     } else {
         printf("ptrHead is NULL\n");
     }
     
     // Print information about ptrTail
-    if (ptrTail != NULL) {
-        printf("ptrTail: %p\n", (void*)ptrTail);
-        printf("ptrTail BlockSize: %5ld\n", ptrTail->BlockSize);
-        printf("ptrTail NextFreeBlock: %p\n", (void*)ptrTail->NextFreeBlock);
-        printf("ptrTail PreviousFreeBlock: %p\n", (void*)ptrTail->PreviousFreeBlock);
+    if (CurHeap->ptrTail != NULL) {
+        printf("ptrTail: %p\n", (void*)CurHeap->ptrTail);
+        printf("ptrTail BlockSize: %5ld\n", CurHeap->ptrTail->BlockSize);
+        printf("ptrTail NextFreeBlock: %p\n", (void*)HeapUtils_NextFree(CurHeap->ptrTail));
+        printf("ptrTail PreviousFreeBlock: %p\n", (void*)HeapUtils_PreviousFree(CurHeap->ptrTail));
     } else {
         printf("ptrTail is NULL\n");
     }
@@ -115,6 +125,309 @@ void HeapTest_RandomAllocateFreeTest() {
     }
 }
 
+void HeapTest_Benchmark(void) {
+    static void*    pointers[NUM_ALLOCS];
+    struct timespec Start, End;
+    size_t          PeakHeap   = 0 ;
+    size_t          FreeNodes  = 0 ;
+    uint64          Allocs     = 0 ;
+
+    srand(BENCH_SEED);
+    memset(pointers, 0, sizeof(pointers));
+    clock_gettime(CLOCK_MONOTONIC, &Start);
+
+    for (int i = 0; i < MAX_ITERATIONS; ++i) {
+        int index = rand() % NUM_ALLOCS;
+        if (pointers[index] == NULL) {
+            size_t size = (sint32)(rand() % MAX_SIZE) + 1;
+            pointers[index] = HeapManager_Malloc(size);
+            if (pointers[index] == NULL) {
+                Fail++;
+            }
+            Allocs++;
+            if ((size_t)(CurHeap->CurBreak - CurHeap->RegionStart) > PeakHeap) {
+                PeakHeap = (size_t)(CurHeap->CurBreak - CurHeap->RegionStart);
+            }
+        } else {
+            HeapManager_Free(pointers[index]);
+            pointers[index] = NULL;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &End);
+
+    for (FreeBlock* Node = CurHeap->ptrHead; Node != NULL; Node = HeapUtils_NextFree(Node)) {
+        FreeNodes++;
+    }
+
+    for (int i = 0; i < NUM_ALLOCS; ++i) {
+        if (pointers[i] != NULL) {
+            HeapManager_Free(pointers[i]);
+            pointers[i] = NULL;
+        }
+    }
+
+    float64 Seconds = (float64)(End.tv_sec - Start.tv_sec) + (float64)(End.tv_nsec - Start.tv_nsec) / 1e9 ;
+    printf("Strategy          : %s\n", (NEXTFIT == ENABLE) ? "next fit" : "first fit");
+    printf("Iterations        : %d (%llu allocations)\n", MAX_ITERATIONS, Allocs);
+    printf("Elapsed           : %.3f s\n", Seconds);
+    printf("Time / allocation : %.3f us\n", Seconds * 1e6 / (float64)Allocs);
+    printf("Free list length  : %zu nodes at the end\n", FreeNodes);
+    printf("Peak heap size    : %zu KB\n", PeakHeap / ONE_K);
+}
+
+void HeapTest_ChurnBenchmark(void) {
+    static void*    pointers[CHURN_LIVE_BLOCKS];
+    static size_t   sizes[CHURN_LIVE_BLOCKS];
+    static void*    pinned[CHURN_LIVE_BLOCKS];
+    static void*    spacers[CHURN_LIVE_BLOCKS];
+    struct timespec Start, End;
+
+    /* fragment the front of the heap: small holes kept apart by long lived blocks */
+    for (int i = 0; i < CHURN_LIVE_BLOCKS; ++i) {
+        spacers[i] = HeapManager_Malloc(CHURN_HOLE_SIZE);
+        pinned[i] = HeapManager_Malloc(1);
+    }
+    for (int i = 0; i < CHURN_LIVE_BLOCKS; ++i) {
+        HeapManager_Free(spacers[i]);
+    }
+
+    /* the churned blocks don't fit in the holes */
+    srand(BENCH_SEED);
+    for (int i = 0; i < CHURN_LIVE_BLOCKS; ++i) {
+        sizes[i] = CHURN_HOLE_SIZE + 1 + (size_t)(rand() % (CHURN_MAX_SIZE - CHURN_HOLE_SIZE));
+        pointers[i] = HeapManager_Malloc(sizes[i]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &Start);
+
+    // free and allocate again the same size, the pattern of short lived request buffers
+    for (int i = 0; i < MAX_ITERATIONS; ++i) {
+        int index = rand() % CHURN_LIVE_BLOCKS;
+        HeapManager_Free(pointers[index]);
+        pointers[index] = HeapManager_Malloc(sizes[index]);
+        if (pointers[index] == NULL) {
+            Fail++;
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &End);
+
+    for (int i = 0; i < CHURN_LIVE_BLOCKS; ++i) {
+        HeapManager_Free(pointers[i]);
+        HeapManager_Free(pinned[i]);
+        pointers[i] = NULL;
+        pinned[i] = NULL;
+    }
+
+    float64 Seconds = (float64)(End.tv_sec - Start.tv_sec) + (float64)(End.tv_nsec - Start.tv_nsec) / 1e9 ;
+    printf("Churn workload    : %d free/malloc pairs over %d live blocks of %d..%d bytes\n",
+           MAX_ITERATIONS, CHURN_LIVE_BLOCKS, CHURN_HOLE_SIZE + 1, CHURN_MAX_SIZE);
+    printf("Quick lists       : %s\n", (QUICKLIST == ENABLE) ? "enabled" : "disabled");
+    printf("Elapsed           : %.3f s\n", Seconds);
+    printf("Time / pair       : %.3f us\n", Seconds * 1e6 / (float64)MAX_ITERATIONS);
+}
+
+/* one heap of HeapTest_MultiHeapTest, filled and checked by its own thread */
+typedef struct MultiHeapJob {
+    Heap*  heap;
+    int    id;
+    size_t count;
+    uint32 fails;
+    void*  pointers[NUM_ALLOCS];
+} MultiHeapJob;
+
+static void* HeapTest_MultiHeapWorker(void* arg) {
+    MultiHeapJob* job  = arg;
+    unsigned int  seed = BENCH_SEED + job->id;
+
+    /* fill the heap until its region is exhausted, with the byte pattern of the heap */
+    while (job->count < NUM_ALLOCS) {
+        size_t size = (size_t)(rand_r(&seed) % CHURN_MAX_SIZE) + 1;
+        sint8* ptr  = Heap_Alloc(job->heap, size);
+        if (ptr == NULL) {
+            break;
+        }
+        if (ptr < (sint8*)job->heap || ptr + HeapManager_GetSize(ptr) > (sint8*)job->heap + MULTI_HEAP_REGION) {
+            fprintf(stderr, "Block %p is outside of heap %d region\n", (void*)ptr, job->id);
+            job->fails++;
+        }
+        memset(ptr, job->id + 1, HeapManager_GetSize(ptr));
+        job->pointers[job->count++] = ptr;
+    }
+
+    /* free every other block, then check contents and structure of the heap */
+    for (size_t i = 0; i < job->count; i += 2) {
+        Heap_Free(job->heap, job->pointers[i]);
+        job->pointers[i] = NULL;
+    }
+    for (size_t i = 1; i < job->count; i += 2) {
+        sint8* ptr = job->pointers[i];
+        for (size_t j = 0; j < HeapManager_GetSize(ptr); j++) {
+            if (ptr[j] != job->id + 1) {
+                fprintf(stderr, "Heap %d block %p was overwritten\n", job->id, (void*)ptr);
+                job->fails++;
+                break;
+            }
+        }
+    }
+    if (HeapTest_CheckConsistency(job->heap) == INVALID) {
+        job->fails++;
+    }
+    return NULL;
+}
+
+void HeapTest_MultiHeapTest(void) {
+    static sint64       RegionA[MULTI_HEAP_REGION / sizeof(sint64)];
+    static sint64       RegionB[MULTI_HEAP_REGION / sizeof(sint64)];
+    static MultiHeapJob jobs[2];
+    pthread_t           threads[2];
+    int                 started[2];
+    Heap*               heaps[2];
+
+    heaps[0] = Heap_Create(RegionA, sizeof(RegionA));
+    heaps[1] = Heap_Create(RegionB, sizeof(RegionB));
+    if (heaps[0] == NULL || heaps[1] == NULL) {
+        fprintf(stderr, "Heap_Create failed\n");
+        Fail++;
+        return;
+    }
+
+    /* both heaps are used at the same time, each one by its own thread */
+    for (int h = 0; h < 2; ++h) {
+        jobs[h] = (MultiHeapJob){ .heap = heaps[h], .id = h };
+        started[h] = (pthread_create(&threads[h], NULL, HeapTest_MultiHeapWorker, &jobs[h]) == 0);
+        if (!started[h]) {
+            HeapTest_MultiHeapWorker(&jobs[h]);
+        }
+    }
+    for (int h = 0; h < 2; ++h) {
+        if (started[h]) {
+            pthread_join(threads[h], NULL);
+        }
+        Fail += jobs[h].fails;
+    }
+
+    printf("Heap A: %zu blocks, Heap B: %zu blocks in %d bytes regions\n", jobs[0].count, jobs[1].count, MULTI_HEAP_REGION);
+
+    /* discard both heaps at once and reuse the first region */
+    Heap_Destroy(heaps[0]);
+    Heap_Destroy(heaps[1]);
+    heaps[0] = Heap_Create(RegionA, sizeof(RegionA));
+    if (Heap_Alloc(heaps[0], MULTI_HEAP_REGION / 2) == NULL || HeapTest_CheckConsistency(heaps[0]) == INVALID) {
+        fprintf(stderr, "Region reuse after Heap_Destroy failed\n");
+        Fail++;
+    }
+}
+
+void HeapTest_SharedHeapTest(void) {
+    char   Name[64];
+    int    Pipe[2];
+    size_t Offset;
+    size_t Received = 0 ;
+    int    Status;
+
+    snprintf(Name, sizeof(Name), "/heap_test_%d", (int)getpid());
+    HeapShm* shm = HeapShm_Create(Name, SHM_HEAP_SIZE);
+    if (shm == NULL || pipe(Pipe) == -1) {
+        fprintf(stderr, "Shared heap setup failed\n");
+        Fail++;
+        return;
+    }
+
+    for (sint32 c = 0; c < SHM_PRODUCERS; c++) {
+        if (fork() != 0) {
+            continue;
+        }
+
+        /* producer: a mapping of its own, at another address than the inherited one */
+        close(Pipe[0]);
+        HeapShm* own = HeapShm_Open(Name);
+        if (own == NULL) {
+            _exit(1);
+        }
+
+        srand(c + 1);
+        for (sint32 i = 0; i < SHM_MESSAGES; i++) {
+            size_t      Length = (size_t)(rand() % CHURN_MAX_SIZE);
+            ShmMessage* Msg    = HeapShm_Alloc(own, sizeof(ShmMessage) + Length);
+            if (Msg == NULL) {
+                _exit(1);
+            }
+            Msg->Producer = c ;
+            Msg->Index    = i ;
+            Msg->Length   = Length ;
+            memset(Msg->Payload, (c * 31 + i) & 0xFF, Length);
+
+            /* keep some churn inside the producers too */
+            if (i % 2 == 1) {
+                HeapShm_Free(own, Msg);
+                continue;
+            }
+            Offset = HeapShm_ToOffset(own, Msg);
+            if (write(Pipe[1], &Offset, sizeof(Offset)) != sizeof(Offset)) {
+                _exit(1);
+            }
+        }
+        HeapShm_Close(own);
+        _exit(0);
+    }
+
+    /* consumer: check every message and free it on behalf of its producer */
+    close(Pipe[1]);
+    while (read(Pipe[0], &Offset, sizeof(Offset)) == sizeof(Offset)) {
+        ShmMessage* Msg = HeapShm_ToPointer(shm, Offset);
+        for (size_t j = 0; j < Msg->Length; j++) {
+            if (Msg->Payload[j] != ((Msg->Producer * 31 + Msg->Index) & 0xFF)) {
+                fprintf(stderr, "Message %d of producer %d was overwritten\n", Msg->Index, Msg->Producer);
+                Fail++;
+                break;
+            }
+        }
+        HeapShm_Free(shm, Msg);
+        Received++;
+    }
+    close(Pipe[0]);
+
+    while (wait(&Status) > 0) {
+        if (!WIFEXITED(Status) || WEXITSTATUS(Status) != 0) {
+            fprintf(stderr, "A producer failed\n");
+            Fail++;
+        }
+    }
+    if (Received != SHM_PRODUCERS * SHM_MESSAGES / 2) {
+        fprintf(stderr, "Received %zu messages instead of %d\n", Received, SHM_PRODUCERS * SHM_MESSAGES / 2);
+        Fail++;
+    }
+
+    /* a process that dies holding the lock must not block the others */
+    if (fork() == 0) {
+        HeapShm* own = HeapShm_Open(Name);
+        HeapShm_Lock(own);
+        _exit(0);
+    }
+    wait(&Status);
+
+    void* ptr = HeapShm_Alloc(shm, CHURN_MAX_SIZE);
+    if (ptr == NULL) {
+        fprintf(stderr, "Shared heap unusable after its lock owner died\n");
+        Fail++;
+    }
+    HeapShm_Free(shm, ptr);
+
+    if (HeapShm_Lock(shm) == VALID) {
+        if (HeapTest_CheckConsistency(&shm->heap) == INVALID) {
+            Fail++;
+        }
+        HeapShm_Unlock(shm);
+    }
+
+    printf("Shared heap: %d producers, %zu messages received\n", SHM_PRODUCERS, Received);
+
+    HeapShm_Close(shm);
+    HeapShm_Unlink(Name);
+}
+
 void VerifyData(sint8* ptr) {
     // Assuming that the metadata (FreeBlock structure) precedes the data
     FreeBlock* block = (FreeBlock*)(ptr - sizeof(size_t));
@@ -130,3 +443,111 @@ void VerifyData(sint8* ptr) {
         }
     }
 }
+
+static sint8 HeapTest_CheckCurrentHeap(void) {
+    sint8*     HeapStart = CurHeap->RegionStart ;
+    FreeBlock* PreNode   = NULL ;
+    FreeBlock* CurNode   = CurHeap->ptrHead ;
+    size_t     NodeCount = 0 ;
+    uint8      RoverSeen = (CurHeap->ptrRover == NULL) ? ON : OFF ;
+
+    // heap is not initialized before the first allocation
+    if (CurHeap->ptrHead == NULL && CurHeap->ptrTail == NULL) {
+        return VALID ;
+    }
+
+    /* walk the free list from head to tail */
+    while (CurNode != NULL) {
+        if ((sint8*)CurNode < HeapStart || (sint8*)CurNode + sizeof(size_t) + CurNode->BlockSize > CurHeap->CurBreak) {
+            fprintf(stderr, "Consistency: free node %p (size %zu) is out of heap limits\n", (void*)CurNode, CurNode->BlockSize);
+            return INVALID ;
+        }
+        if (HeapUtils_PreviousFree(CurNode) != PreNode) {
+            fprintf(stderr, "Consistency: free node %p has previous link %p, expected %p\n",
+                    (void*)CurNode, (void*)HeapUtils_PreviousFree(CurNode), (void*)PreNode);
+            return INVALID ;
+        }
+        if (PreNode != NULL && CurNode <= PreNode) {
+            fprintf(stderr, "Consistency: free list is not sorted at %p\n", (void*)CurNode);
+            return INVALID ;
+        }
+        // a cycle would visit more nodes than the heap can hold
+        if (++NodeCount > (size_t)(CurHeap->CurBreak - HeapStart) / sizeof(FreeBlock)) {
+            fprintf(stderr, "Consistency: free list has a cycle\n");
+            return INVALID ;
+        }
+        if (CurNode == CurHeap->ptrRover) {
+            RoverSeen = ON ;
+        }
+        PreNode = CurNode ;
+        CurNode = HeapUtils_NextFree(CurNode) ;
+    }
+
+    if (PreNode != CurHeap->ptrTail) {
+        fprintf(stderr, "Consistency: free list ends at %p but ptrTail is %p\n", (void*)PreNode, (void*)CurHeap->ptrTail);
+        return INVALID ;
+    }
+    if (RoverSeen == OFF) {
+        fprintf(stderr, "Consistency: ptrRover %p is not a free list node\n", (void*)CurHeap->ptrRover);
+        return INVALID ;
+    }
+
+    /* walk the heap block by block and match free nodes on the way */
+    sint8*     Cursor      = HeapStart ;
+    FreeBlock* NextFree    = CurHeap->ptrHead ;
+    uint8      PrevWasFree = OFF ;
+
+    while (Cursor < CurHeap->CurBreak) {
+        FreeBlock* Block = (FreeBlock*)Cursor ;
+
+        if (Block->BlockSize == 0 || Block->BlockSize % 8 != 0) {
+            fprintf(stderr, "Consistency: block %p has invalid size %zu\n", (void*)Block, Block->BlockSize);
+            return INVALID ;
+        }
+        if (NextFree != NULL && (sint8*)NextFree < Cursor) {
+            fprintf(stderr, "Consistency: free node %p is not on a block boundary\n", (void*)NextFree);
+            return INVALID ;
+        }
+
+        if (Block == NextFree) {
+            if (PrevWasFree == ON) {
+                fprintf(stderr, "Consistency: adjacent free blocks at %p are not coalesced\n", (void*)Block);
+                return INVALID ;
+            }
+            PrevWasFree = ON ;
+            NextFree = HeapUtils_NextFree(NextFree) ;
+        }
+        else {
+            PrevWasFree = OFF ;
+        }
+
+        Cursor += sizeof(size_t) + Block->BlockSize ;
+    }
+
+    if (Cursor != CurHeap->CurBreak) {
+        fprintf(stderr, "Consistency: last block ends at %p but CurBreak is %p\n", (void*)Cursor, (void*)CurHeap->CurBreak);
+        return INVALID ;
+    }
+    if (NextFree != NULL) {
+        fprintf(stderr, "Consistency: free node %p is not reachable by walking the heap\n", (void*)NextFree);
+        return INVALID ;
+    }
+
+#if QUICKLIST == ENABLE
+    if (HeapQuickList_Validate() == INVALID) {
+        return INVALID ;
+    }
+#endif
+
+    return VALID ;
+}
+
+sint8 HeapTest_CheckConsistency(Heap* heap) {
+    Heap* Saved = CurHeap ;
+
+    CurHeap = heap ;
+    sint8 Result = HeapTest_CheckCurrentHeap();
+    CurHeap = Saved ;
+
+    return Result ;
+}
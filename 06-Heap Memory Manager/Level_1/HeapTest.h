@@ -24,6 +24,7 @@
 
 /*===================================  Includes ===============================*/
 #include "../Level_2/HeapManager.h"
+#include "../Level_2/HeapShm.h"
 //#include "../Level_2/HeapExtras.h"
 #include <time.h>
 
@@ -33,6 +34,14 @@
 #define NUM_ALLOCS 10000
 #define MAX_SIZE 10240
 #define MAX_ITERATIONS 1000000
+#define BENCH_SEED 2024
+#define CHURN_LIVE_BLOCKS 1000
+#define CHURN_MAX_SIZE 256
+#define CHURN_HOLE_SIZE 64
+#define MULTI_HEAP_REGION (64 * ONE_K)
+#define SHM_HEAP_SIZE (4 * ONE_K * ONE_K)
+#define SHM_PRODUCERS 4
+#define SHM_MESSAGES 2000
 
 /*==========================  Function Prototypes ===========================*/
 /*
@@ -60,8 +69,73 @@ void HeapTest_PrintBordersState(void);
  *                    repeatedly allocating and freeing memory.
  */
 void HeapTest_RandomAllocateFreeTest(void);
+
+/*
+ * Name             : HeapTest_Benchmark
+ * Description      : Runs the same workload as HeapTest_RandomAllocateFreeTest with a fixed seed and 
+ *                    without any printing, then reports the elapsed time, the cost per allocation, 
+ *                    the free list length and the peak heap size.
+ * Input            : None
+ * Output           : Prints the benchmark results.
+ * Return           : None
+ * Notes            : Used to compare the allocation strategies (e.g. build with NEXTFIT=ENABLE).
+ */
+void HeapTest_Benchmark(void);
+
+/*
+ * Name             : HeapTest_ChurnBenchmark
+ * Description      : Fragments the front of the heap with small holes, keeps a set of small live blocks 
+ *                    that don't fit in those holes and repeatedly frees one of them and allocates the 
+ *                    same size again, then reports the elapsed time per free/malloc pair.
+ * Input            : None
+ * Output           : Prints the benchmark results.
+ * Return           : None
+ * Notes            : Measures the split/merge churn avoided by the quick lists (QUICKLIST=ENABLE).
+ */
+void HeapTest_ChurnBenchmark(void);
+
+/*
+ * Name             : HeapTest_MultiHeapTest
+ * Description      : Creates two heap instances over static regions and, from two threads running at 
+ *                    the same time, fills them until their regions are exhausted, frees half of the 
+ *                    blocks and checks that the blocks stayed inside their own region with their own 
+ *                    content. Both heaps are then destroyed and a region is reused.
+ * Input            : None
+ * Output           : Prints the number of blocks held by each heap, errors go to stderr.
+ * Return           : None
+ * Notes            : Every error increments Fail.
+ */
+void HeapTest_MultiHeapTest(void);
+
+/*
+ * Name             : HeapTest_SharedHeapTest
+ * Description      : Producer/consumer test of the shared memory heap. Forked producers map the heap 
+ *                    again (at another address), allocate messages in it and send their offsets 
+ *                    through a pipe, the parent checks and frees them. A last child dies holding the 
+ *                    heap lock to check that the robust mutex is recovered.
+ * Input            : None
+ * Output           : Prints the number of messages received, errors go to stderr.
+ * Return           : None
+ * Notes            : Every error increments Fail.
+ */
+void HeapTest_SharedHeapTest(void);
  
 
 void VerifyData(sint8* ptr);
 
+/*
+ * Name             : HeapTest_CheckConsistency
+ * Description      : Validates the internal structure of the simulated heap. The free list is 
+ *                    walked from head to tail to check its links and ordering, then the heap is 
+ *                    walked block by block from the start of its region up to the break pointer.
+ * Input            : heap - The heap instance to check (CurHeap for the default heap).
+ * Output           : Prints the first violation found on stderr.
+ * Return           : VALID if the heap is consistent, INVALID otherwise.
+ * Notes            : Checked invariants are: the free list is doubly linked, sorted by address and 
+ *                    ends at ptrTail; every block size is a multiple of 8; blocks tile the heap up 
+ *                    to CurBreak with no gaps; every free node starts on a block boundary and no 
+ *                    two free blocks are adjacent (they must have been coalesced).
+ */
+sint8 HeapTest_CheckConsistency(Heap* heap);
+
 #endif
\ No newline at end of file
@@ -27,18 +27,25 @@
 
 /*===================================  Includes ==============================*/
 #include "HeapExtras.h"
+#include "HeapQuickList.h"
 #include <unistd.h>
 
 
 /*============================  extern Global Variable ==============================*/
-extern sint64     SimHeap[MAX_HEAPLENGHT];          // simulated heap
-extern FreeBlock* ptrHead;
-extern FreeBlock* ptrTail;
-extern sint8*     CurBreak;                         // break pointer on simulated heap
-
-static sint8      TailBrkState = STATE1 ; 
+extern _Thread_local Heap* CurHeap;                   // heap instance the operations of this thread work on
 
 /*=========================  Functions Implementation ===========================*/
+size_t HeapExtras_AlignSize(size_t size){
+    // to ensure when free this pointer the new node will not overwrite on the next node
+    if (size < sizeof(FreeBlock) ){
+        size = sizeof(FreeBlock);
+    }
+
+    // to align data on 8
+    return ((size + 7 ) / 8) * 8;
+}
+
+
 sint8* HeapExtras_FirstFit(size_t size){
     static sint8 sleep_flag = 1 ;
     if (sleep_flag == 0){
@@ -52,15 +59,9 @@ sint8* HeapExtras_FirstFit(size_t size){
     * size: Requested size for memory allocation.
     */
     sint8*            RetDataPtr   = NULL ;  
-    FreeBlock*        CurBlock     = ptrHead ; 
-
-    // to ensure when free this pointer the new node will not overwrite on the next node
-    if (size < sizeof(FreeBlock) ){
-        size = sizeof(FreeBlock);
-    }
+    FreeBlock*        CurBlock     = CurHeap->ptrHead ; 
 
-    // to align data on 8
-    size = ((size + 7 ) / 8) * 8;
+    size = HeapExtras_AlignSize(size);
 
     TailBreakStatus();
 
@@ -73,7 +74,7 @@ sint8* HeapExtras_FirstFit(size_t size){
         if (RetDataPtr == NULL){
             /* make next index point to the next node
             */
-            CurBlock = CurBlock->NextFreeBlock ;
+            CurBlock = HeapUtils_NextFree(CurBlock) ;
         }
         else {
             break;
@@ -83,33 +84,94 @@ sint8* HeapExtras_FirstFit(size_t size){
     /* If no suitable free space was found, adjust the program break pointer and update the free list.
     * */
     if ( CurBlock == NULL){
-        RetDataPtr = HeapUtils_sbrkResize(size, TailBrkState);
+#if QUICKLIST == ENABLE
+        /* coalesce the deferred blocks first, the merged space may be enough without extending the heap */
+        if (HeapQuickList_Flush(size) == VALID){
+            return HeapExtras_FirstFit(size);
+        }
+#endif
+        RetDataPtr = HeapUtils_sbrkResize(size, CurHeap->TailBrkState);
     } // rather that will be continue on state 1
 
-    Shrink_Break(TailBrkState);
+    /* the allocation may have removed or moved the tail, so refresh its relation with the break */
+    TailBreakStatus();
+    Shrink_Break(CurHeap->TailBrkState);
 
     /* return index of allocation new space -> data */
     return RetDataPtr ;
 }
 
 
+sint8* HeapExtras_NextFit(size_t size){
+    /*
+    * RetDataPtr: Pointer to the location where memory will be allocated.
+    * StartBlock: Free node where the previous search stopped, the search ends when it comes back to it.
+    * CurBlock: Pointer to the current block in the free list being examined.
+    */
+    sint8*            RetDataPtr   = NULL ;
+    FreeBlock*        StartBlock   = (CurHeap->ptrRover != NULL) ? CurHeap->ptrRover : CurHeap->ptrHead ;
+    FreeBlock*        CurBlock     = StartBlock ;
+
+    size = HeapExtras_AlignSize(size);
+
+    TailBreakStatus();
+
+    /*
+    * Iterate once around the free list starting from the rover. The rover is parked on the examined
+    * node so that splitting or removing it moves the rover to the node that takes its place.
+    * */
+    while( CurBlock != NULL){
+        CurHeap->ptrRover = CurBlock ;
+        RetDataPtr = HeapUtils_AllocationCoreLoop(CurBlock,size);
+
+        if (RetDataPtr != NULL){
+            break;
+        }
+
+        CurBlock = (HeapUtils_NextFree(CurBlock) != NULL) ? HeapUtils_NextFree(CurBlock) : CurHeap->ptrHead ;
+        if (CurBlock == StartBlock){
+            CurBlock = NULL ;
+        }
+    }
+
+    /* If no suitable free space was found, adjust the program break pointer and update the free list.
+    * */
+    if ( CurBlock == NULL){
+#if QUICKLIST == ENABLE
+        /* coalesce the deferred blocks first, the merged space may be enough without extending the heap */
+        if (HeapQuickList_Flush(size) == VALID){
+            return HeapExtras_NextFit(size);
+        }
+#endif
+        RetDataPtr = HeapUtils_sbrkResize(size, CurHeap->TailBrkState);
+    }
+
+    TailBreakStatus();
+    Shrink_Break(CurHeap->TailBrkState);
+
+    return RetDataPtr ;
+}
+
+
 void HeapExtras_Init() {
-    // Create the initial free block in the simulated heap
-    FreeBlock* initialBlock = (FreeBlock*)SimHeap;
+    // Create the initial free block at the start of the heap region
+    FreeBlock* initialBlock = (FreeBlock*)CurHeap->RegionStart;
     
     // Set the block size to the total size of the simulated heap
     initialBlock->BlockSize = ( BREAK_STEP_SIZE - sizeof(size_t) ); // - sizeof(size_t) because the first size_t use for metadata representation
 
     // No other free blocks, so Next and Previous pointers are NULL
-    initialBlock->NextFreeBlock = NULL;
-    initialBlock->PreviousFreeBlock = NULL;
+    HeapUtils_SetNextFree(initialBlock, NULL) ;
+    HeapUtils_SetPreviousFree(initialBlock, NULL) ;
 
     // Set the head and tail pointers to the initial block
-    ptrHead = initialBlock;
-    ptrTail = initialBlock;
+    CurHeap->ptrHead = initialBlock;
+    CurHeap->ptrTail = initialBlock;
+    CurHeap->ptrRover = initialBlock;
 
     //set ptrCurBreak 
-    CurBreak = ((sint8*) (&SimHeap[BREAK_STEP_SIZE/sizeof(sint64)]) ) ;
+    CurHeap->CurBreak = CurHeap->RegionStart + BREAK_STEP_SIZE ;
+    CurHeap->TailBrkState = STATE2 ;
 }
 
 
@@ -123,7 +185,7 @@ void   HeapExtras_FreeOperationBeforeHead(FreeBlock* Node){
 
     /* head and tail point to the same node */
     sint8 HeadAndTail = INVALID ;
-    if (ptrHead == ptrTail){
+    if (CurHeap->ptrHead == CurHeap->ptrTail){
         HeadAndTail = VALID ;
     } 
 
@@ -135,10 +197,10 @@ void   HeapExtras_FreeOperationBeforeHead(FreeBlock* Node){
      *         - Update the old head's previous free space to the new node.
      *         - Update the head to point to the new node.
      */
-    if (PositionOfFreeBlock < (sint8*)ptrHead ){
-        HeapUtils_SetFreeNodeInfo(Node,Node->BlockSize,NULL,ptrHead);
-        ptrHead->PreviousFreeBlock = Node ;
-        ptrHead = Node ;
+    if (PositionOfFreeBlock < (sint8*)CurHeap->ptrHead ){
+        HeapUtils_SetFreeNodeInfo(Node,Node->BlockSize,NULL,CurHeap->ptrHead);
+        HeapUtils_SetPreviousFree(CurHeap->ptrHead, Node) ;
+        CurHeap->ptrHead = Node ;
     }
     /*
      * Case 2: The block is just before the head and adjacent to it.
@@ -147,18 +209,20 @@ void   HeapExtras_FreeOperationBeforeHead(FreeBlock* Node){
      *         - Set the new head's previous free space to NULL.
      *         - Set the new head's next free space to the old head's next free space.
      */
-    else if (PositionOfFreeBlock == (sint8*)ptrHead ){
-        size_t sizeOfhead = ptrHead->BlockSize;
+    else if (PositionOfFreeBlock == (sint8*)CurHeap->ptrHead ){
+        size_t sizeOfhead = CurHeap->ptrHead->BlockSize;
         if (HeadAndTail == INVALID){
-            FreeBlock* nextNode = ptrHead->NextFreeBlock;
-            ptrHead = Node ;
-            HeapUtils_SetFreeNodeInfo(ptrHead, Node->BlockSize+sizeOfhead+(size_t)sizeof(size_t),NULL,nextNode);
-            nextNode->PreviousFreeBlock = ptrHead ;
+            FreeBlock* nextNode = HeapUtils_NextFree(CurHeap->ptrHead);
+            HeapUtils_ReplaceRover(CurHeap->ptrHead, Node);
+            CurHeap->ptrHead = Node ;
+            HeapUtils_SetFreeNodeInfo(CurHeap->ptrHead, Node->BlockSize+sizeOfhead+(size_t)sizeof(size_t),NULL,nextNode);
+            HeapUtils_SetPreviousFree(nextNode, CurHeap->ptrHead) ;
         }
         else {
-            ptrHead = Node ;
-            ptrTail = ptrHead ;
-            HeapUtils_SetFreeNodeInfo(ptrHead, Node->BlockSize+sizeOfhead+(size_t)sizeof(size_t),NULL,NULL);
+            HeapUtils_ReplaceRover(CurHeap->ptrHead, Node);
+            CurHeap->ptrHead = Node ;
+            CurHeap->ptrTail = CurHeap->ptrHead ;
+            HeapUtils_SetFreeNodeInfo(CurHeap->ptrHead, Node->BlockSize+sizeOfhead+(size_t)sizeof(size_t),NULL,NULL);
         }
     }
     /*
@@ -181,7 +245,7 @@ void   HeapExtras_FreeOperationAfterTail(FreeBlock* Node){
     printf("Free after tail and node Size = %5ld\n",Node->BlockSize);
     getchar();
 #endif
-    sint8* PositionOfTailBlock = (sint8*)ptrTail + ptrTail->BlockSize + sizeof(size_t) ; // to check that the target free block is adjecent for tail or away from.
+    sint8* PositionOfTailBlock = (sint8*)CurHeap->ptrTail + CurHeap->ptrTail->BlockSize + sizeof(size_t) ; // to check that the target free block is adjecent for tail or away from.
 
     /* if ptr is pointing to tail before node node is away from
     *  that : 1- define new node
@@ -191,16 +255,16 @@ void   HeapExtras_FreeOperationAfterTail(FreeBlock* Node){
     *         5- update tail to point to index
     * */
     if (PositionOfTailBlock < (sint8*)Node ){
-        HeapUtils_SetFreeNodeInfo(Node,Node->BlockSize,ptrTail,NULL);
-        ptrTail->NextFreeBlock = Node;
-        ptrTail = Node ;
+        HeapUtils_SetFreeNodeInfo(Node,Node->BlockSize,CurHeap->ptrTail,NULL);
+        HeapUtils_SetNextFree(CurHeap->ptrTail, Node) ;
+        CurHeap->ptrTail = Node ;
     }
      /* if ptr is pointing to node just after tail node and adjecent for it
      *  redefine new metdata for free space to be equal the margin of new free space and tail space
      * */
     else if (PositionOfTailBlock == (sint8*)Node){
-        size_t sizeOftail = ptrTail->BlockSize;
-        ptrTail->BlockSize = sizeOftail+(size_t)sizeof(size_t)+Node->BlockSize;
+        size_t sizeOftail = CurHeap->ptrTail->BlockSize;
+        CurHeap->ptrTail->BlockSize = sizeOftail+(size_t)sizeof(size_t)+Node->BlockSize;
     }
     else {
 #if DEBUGGING == ENABLE
@@ -211,7 +275,7 @@ void   HeapExtras_FreeOperationAfterTail(FreeBlock* Node){
     }
 
     TailBreakStatus();
-    Shrink_Break(TailBrkState);
+    Shrink_Break(CurHeap->TailBrkState);
 }
 
 
@@ -220,18 +284,18 @@ void   HeapExtras_FreeOperationMiddleNode(FreeBlock* Node){
     printf("Free in middle from free list and node Size = %5ld\n",Node->BlockSize);
     getchar();
 #endif
-    FreeBlock* nextNode = ptrHead ; // to store the next free slot after index
+    FreeBlock* nextNode = CurHeap->ptrHead ; // to store the next free slot after index
     FreeBlock* PreNode = NULL ;     // to store the previous free slot before index
     size_t size = Node->BlockSize ;
 
     // till reach to the strict next free slot after index  
     while (nextNode < Node){
-        nextNode = nextNode->NextFreeBlock;
+        nextNode = HeapUtils_NextFree(nextNode);
     }
-    PreNode = nextNode->PreviousFreeBlock; // to store the previous free slot before index
+    PreNode = HeapUtils_PreviousFree(nextNode); // to store the previous free slot before index
     
-    FreeBlock* PrevPrevNode = PreNode->PreviousFreeBlock;
-    FreeBlock* NextNextNode = nextNode->NextFreeBlock;
+    FreeBlock* PrevPrevNode = HeapUtils_PreviousFree(PreNode);
+    FreeBlock* NextNextNode = HeapUtils_NextFree(nextNode);
 
     size_t SizeOfPrev = PreNode->BlockSize ;
     size_t SizeOfNext = nextNode->BlockSize ;
@@ -274,19 +338,20 @@ void   HeapExtras_FreeOperationMiddleNode(FreeBlock* Node){
         * */
         HeapUtils_SetFreeNodeInfo(Node,NewSize,PreNode,NextNextNode);
         HeapUtils_SetFreeNodeInfo(PreNode,SizeOfPrev,PrevPrevNode,Node);
+        HeapUtils_ReplaceRover(nextNode, Node);
 
         /* update Tail to point on new update node */
-        if (nextNode == ptrTail){
+        if (nextNode == CurHeap->ptrTail){
 #if DEBUGGING == ENABLE
             printf("\n Free from left with Tail \n");
 #endif
-            ptrTail = Node ;
+            CurHeap->ptrTail = Node ;
         }
         else{
 #if DEBUGGING == ENABLE
             printf("\n Free from left without Tail \n");
 #endif
-            HeapUtils_SetFreeNodeInfo(NextNextNode,NextNextNode->BlockSize,Node,NextNextNode->NextFreeBlock);
+            HeapUtils_SetFreeNodeInfo(NextNextNode,NextNextNode->BlockSize,Node,HeapUtils_NextFree(NextNextNode));
         }
     }
     // indexOfptr point to node just after free node(x) and before free node(y) from right so we will extend x,y node to join three adjecent free spaces    
@@ -296,19 +361,20 @@ void   HeapExtras_FreeOperationMiddleNode(FreeBlock* Node){
 #endif
         sint32 NewSize = SizeOfPrev+size+SizeOfNext+2*sizeof(size_t) ;
         HeapUtils_SetFreeNodeInfo(PreNode,NewSize,PrevPrevNode,NextNextNode);
+        HeapUtils_ReplaceRover(nextNode, PreNode);
 
         /* update Tail to point on new update node */
-        if (nextNode == ptrTail){
+        if (nextNode == CurHeap->ptrTail){
 #if DEBUGGING == ENABLE
             printf("\n Free between two free slots with Tail \n");
 #endif
-            ptrTail = PreNode ;
+            CurHeap->ptrTail = PreNode ;
         }
         else{
 #if DEBUGGING == ENABLE
             printf("\n Free between two free slots without Tail \n");
 #endif
-            HeapUtils_SetFreeNodeInfo(NextNextNode,NextNextNode->BlockSize,PreNode,NextNextNode->NextFreeBlock);
+            HeapUtils_SetFreeNodeInfo(NextNextNode,NextNextNode->BlockSize,PreNode,HeapUtils_NextFree(NextNextNode));
         }
 
     }
@@ -339,21 +405,43 @@ void   HeapExtras_FreeOperationMiddleNode(FreeBlock* Node){
     }
 }
 
+void HeapExtras_FreeOperation(FreeBlock* Node){
+    // If `Node` is pointing to a node before the head node
+    if (Node < CurHeap->ptrHead) {
+        HeapExtras_FreeOperationBeforeHead(Node);
+    }
+    // If `Node` is pointing to a node after the tail node
+    else if (Node > CurHeap->ptrTail) {
+        HeapExtras_FreeOperationAfterTail(Node);
+    }
+    // If `Node` is pointing to a node between head and tail nodes
+    else if (Node > CurHeap->ptrHead && Node < CurHeap->ptrTail) {
+        HeapExtras_FreeOperationMiddleNode(Node);
+    }
+    else {
+#if DEBUGGING == ENABLE
+        printf("Error: deletedBlock is not within valid heap limits \n");
+#endif
+        while (1); // For testing purposes
+        exit(INVALID);
+    }
+}
+
 void TailBreakStatus(){
     /* Check if the head and tail are pointing to the same index before the break pointer in the heap.
     *  This ensures that there is no allocated memory between them (related to issue #46).
     * - STATE1: Tail points to a node but not directly before the break pointer.
     * - STATE2: Tail points to a node and is directly before the break pointer.
     */
-    sint8* AdjecentNode = (sint8*)ptrTail + sizeof(size_t) + ptrTail->BlockSize ;
-    if (AdjecentNode == CurBreak){
-        TailBrkState = STATE2 ; // used to call Helper_sbrk if it is needed.
+    sint8* AdjecentNode = (sint8*)CurHeap->ptrTail + sizeof(size_t) + CurHeap->ptrTail->BlockSize ;
+    if (AdjecentNode == CurHeap->CurBreak){
+        CurHeap->TailBrkState = STATE2 ; // used to call Helper_sbrk if it is needed.
     } // rather that will be continue on state 1
     else {
 #if DEBUGGING == ENABLE
-        printf("AdjecentNode = %p and CurBreak = %p",AdjecentNode,CurBreak);
+        printf("AdjecentNode = %p and CurBreak = %p",AdjecentNode,CurHeap->CurBreak);
         getchar();
 #endif
-        TailBrkState = STATE1 ;
+        CurHeap->TailBrkState = STATE1 ;
     }
 }
\ No newline at end of file
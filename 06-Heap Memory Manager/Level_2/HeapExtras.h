@@ -39,6 +39,20 @@
  */
 sint8* HeapExtras_FirstFit(size_t size);
 
+/*
+ * Name             : HeapExtras_NextFit
+ * Description      : Allocates memory using the next-fit strategy. The search starts from the roving 
+ *                    pointer left by the previous allocation and wraps around the free list once. 
+ *                    If no suitable free block is found, the heap is expanded using sbrk.
+ * Input            : size - The requested size of memory to allocate.
+ * Output           : None.
+ * Return           : Pointer to the allocated memory block if successful, or NULL if the allocation fails.
+ * Notes            : Small blocks left at the front of the list are not rescanned on every call. 
+ *                    The rover is kept valid by HeapUtils_ReplaceRover whenever its node is split, 
+ *                    removed or merged.
+ */
+sint8* HeapExtras_NextFit(size_t size);
+
 /*
  * Name             : HeapExtras_Init
  * Description      : Initializes the simulated heap by setting up the initial free block. 
@@ -93,6 +107,27 @@ void   HeapExtras_FreeOperationAfterTail(FreeBlock* Node);
  */
 void   HeapExtras_FreeOperationMiddleNode(FreeBlock* Node);
 
+/*
+ * Name             : HeapExtras_FreeOperation
+ * Description      : Returns a block to the free list, dispatching to the before head, after tail or 
+ *                    middle node operation depending on where the block lies relative to the free list.
+ * Input            : FreeBlock* Node - A pointer to the metadata of the block to be freed.
+ * Output           : None.
+ * Return           : None.
+ * Notes            : Adjacent free blocks are coalesced by the called operation.
+ */
+void   HeapExtras_FreeOperation(FreeBlock* Node);
+
+/*
+ * Name             : HeapExtras_AlignSize
+ * Description      : Converts a requested size to the block size actually reserved by the allocator.
+ * Input            : size - The requested size of memory to allocate.
+ * Output           : None.
+ * Return           : The size rounded up to a multiple of 8 and to at least sizeof(FreeBlock).
+ * Notes            : A block must be able to hold the FreeBlock links once it is freed.
+ */
+size_t HeapExtras_AlignSize(size_t size);
+
 void TailBreakStatus();
 
 #endif
\ No newline at end of file
@@ -31,27 +31,99 @@
 
 /*=============================  Global Variables ==============================*/
 sint64       SimHeap[MAX_HEAPLENGHT];                      // simulated heap
-FreeBlock*   ptrHead     = NULL ;
-FreeBlock*   ptrTail     = NULL ;
-static uint8 InitFlag    = ON ;
-sint8*       CurBreak    = NULL;                           // break pointer on simulated heap
 
+/* default heap instance used by HeapManager_Malloc and HeapManager_Free */
+static Heap  DefaultHeap = {
+    .RegionStart = (sint8*)SimHeap,
+    .RegionEnd   = (sint8*)&SimHeap[MAX_HEAPLENGHT],
+    .InitFlag    = ON,
+};
 
+/* heap instance the operations work on, one per thread so threads using different heaps don't race */
+_Thread_local Heap* CurHeap = &DefaultHeap ;
+
+
+/*=========================  Functions Implementation ===========================*/
 void* HeapManager_Malloc(size_t size) {
-    if (InitFlag == ON) {
+    return Heap_Alloc(&DefaultHeap, size);
+}
+
+
+void HeapManager_Free(void* ptr){
+    Heap_Free(&DefaultHeap, ptr);
+}
+
+size_t HeapManager_GetSize(void* ptr){
+    // Assuming that the metadata (FreeBlock structure) precedes the data
+    FreeBlock* block = (FreeBlock*)(ptr - sizeof(size_t));
+    size_t size = block->BlockSize;
+
+    return size ;
+}
+
+
+Heap* Heap_Create(void* region, size_t size) {
+    if (region == NULL) {
+        return NULL ;
+    }
+
+    // keep the heap control structure and the blocks aligned on 8
+    sint8* RegionStart = (sint8*)(((uintptr_t)region + 7) & ~(uintptr_t)7);
+    sint8* RegionEnd   = (sint8*)region + size ;
+
+    if (RegionEnd < RegionStart + sizeof(Heap) + BREAK_STEP_SIZE) {
+#if DEBUGGING == ENABLE
+        printf("Heap region of %zu bytes is too small\n", size);
+#endif
+        return NULL ;
+    }
+
+    Heap* heap = (Heap*)RegionStart ;
+    memset(heap, 0, sizeof(Heap));
+    heap->RegionStart = RegionStart + sizeof(Heap) ;
+    heap->RegionEnd   = RegionEnd ;
+    heap->InitFlag    = ON ;
+
+    return heap ;
+}
+
+
+void* Heap_Alloc(Heap* heap, size_t size) {
+    if (heap == NULL) {
+        return NULL ;
+    }
+
+    Heap*  Saved     = CurHeap ;
+    sint8* ptrOfData = NULL ;
+
+    CurHeap = heap ;
+    if (CurHeap->InitFlag == ON) {
         HeapExtras_Init();
-        InitFlag = OFF;
+        CurHeap->InitFlag = OFF;
+    }
+
+#if QUICKLIST == ENABLE
+    // An exact size match from the quick lists skips the free list search
+    ptrOfData = HeapQuickList_Pop(size);
+#endif
+
+    if (ptrOfData == NULL) {
+#if NEXTFIT == ENABLE
+        ptrOfData = HeapExtras_NextFit(size);
+#else
+        ptrOfData = HeapExtras_FirstFit(size);
+#endif
     }
- 
-    sint8* ptrOfData = HeapExtras_FirstFit(size);
+
+    CurHeap = Saved ;
 
     // Return a pointer to the allocated memory, cast to void*
     return (void*)ptrOfData;
 }
 
 
-void HeapManager_Free(void* ptr){
-    if (ptr == NULL) {
+void Heap_Free(Heap* heap, void* ptr) {
+    if (heap == NULL || ptr == NULL) {
 #if DEBUGGING == ENABLE
         printf("Passing NULL to free function\n");
         exit(INVALID);
@@ -59,34 +131,30 @@ void HeapManager_Free(void* ptr){
         return ;
     }
 
+    Heap* Saved = CurHeap ;
+    CurHeap = heap ;
+
     // Calculate the address of the FreeBlock metadata
     FreeBlock* deletedBlock = (FreeBlock*)((sint8*)ptr - sizeof(size_t));
-    
-    // If `deletedBlock` is pointing to a node before the head node
-    if (deletedBlock < ptrHead) {
-        HeapExtras_FreeOperationBeforeHead(deletedBlock);
-    }
-    // If `deletedBlock` is pointing to a node after the tail node
-    else if (deletedBlock > ptrTail) {
-        HeapExtras_FreeOperationAfterTail(deletedBlock);
-    }
-    // If `deletedBlock` is pointing to a node between head and tail nodes
-    else if (deletedBlock > ptrHead && deletedBlock < ptrTail) {
-        HeapExtras_FreeOperationMiddleNode(deletedBlock);
+
+#if QUICKLIST == ENABLE
+    // Small blocks are cached without coalescing until allocation pressure requires it
+    if (HeapQuickList_Push(deletedBlock) == INVALID) {
+        HeapExtras_FreeOperation(deletedBlock);
     }
-    else {
-#if DEBUGGING == ENABLE
-        printf("Error: deletedBlock is not within valid heap limits \n");
+#else
+    HeapExtras_FreeOperation(deletedBlock);
 #endif
-        while (1); // For testing purposes
-        exit(INVALID);
-    }
+
+    CurHeap = Saved ;
 }
 
-size_t HeapManager_GetSize(void* ptr){
-    // Assuming that the metadata (FreeBlock structure) precedes the data
-    FreeBlock* block = (FreeBlock*)(ptr - sizeof(size_t));
-    size_t size = block->BlockSize;
 
-    return size ;
-}
\ No newline at end of file
+void Heap_Destroy(Heap* heap) {
+    if (heap == NULL || heap == &DefaultHeap) {
+        return ;
+    }
+
+    // every block of the heap is released at once, the region belongs to the caller again
+    memset(heap, 0, sizeof(Heap));
+}
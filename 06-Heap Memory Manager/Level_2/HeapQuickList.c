@@ -0,0 +1,126 @@
+/*============================================================================
+ * @file name      : HeapQuickList.c
+ * @Author         : Shehab Aldeen Mohammed
+ * @Github         : https://github.com/ShehabAldeenMo
+ * @LinkedIn       : https://www.linkedin.com/in/shehab-aldeen-mohammed/
+ *
+ =============================================================================
+ * @Description:
+ * This file contains the implementation of the quick lists used for deferred
+ * coalescing. An alloc/free churn of the same size is served from a per size
+ * LIFO list, so the same block is not split and merged again on every call.
+ *
+=============================================================================
+ * @Notes:
+ * - Quick list N holds blocks of exactly sizeof(FreeBlock) + 8*N bytes.
+ * - The lists are singly linked through the NextFreeBlock link of the blocks.
+ *
+ ******************************************************************************
+ ==============================================================================
+*/
+
+/*===================================  Includes ==============================*/
+#include "HeapQuickList.h"
+#include "HeapExtras.h"
+
+
+/*============================  extern Global Variable ==============================*/
+extern _Thread_local Heap* CurHeap;                   // heap instance the operations of this thread work on
+
+
+/*=========================  Functions Implementation ===========================*/
+sint8 HeapQuickList_Push(FreeBlock* Node){
+    size_t size = Node->BlockSize ;
+
+    if (size > QUICKLIST_MAX_SIZE){
+        return INVALID ;
+    }
+
+    size_t Bin = (size - sizeof(FreeBlock)) / 8 ;
+    if (CurHeap->QuickCount[Bin] >= QUICKLIST_MAX_COUNT){
+        return INVALID ;
+    }
+
+    HeapUtils_SetNextFree(Node, CurHeap->QuickBins[Bin]) ;
+    CurHeap->QuickBins[Bin] = Node ;
+    CurHeap->QuickCount[Bin]++ ;
+    CurHeap->QuickBytes += size ;
+
+    return VALID ;
+}
+
+
+sint8* HeapQuickList_Pop(size_t size){
+    size = HeapExtras_AlignSize(size);
+
+    if (size > QUICKLIST_MAX_SIZE){
+        return NULL ;
+    }
+
+    size_t     Bin  = (size - sizeof(FreeBlock)) / 8 ;
+    FreeBlock* Node = CurHeap->QuickBins[Bin] ;
+    if (Node == NULL){
+        return NULL ;
+    }
+
+    CurHeap->QuickBins[Bin] = HeapUtils_NextFree(Node) ;
+    CurHeap->QuickCount[Bin]-- ;
+    CurHeap->QuickBytes -= size ;
+
+    return (sint8*)Node + sizeof(size_t) ;
+}
+
+
+sint8 HeapQuickList_Flush(size_t MinBytes){
+    sint8 Released = INVALID ;
+
+    /* the cached blocks can't make room for the request, keep them for their own sizes */
+    if (CurHeap->QuickBytes == 0 || CurHeap->QuickBytes < MinBytes){
+        return INVALID ;
+    }
+
+    for (size_t Bin = 0; Bin < QUICKLIST_BINS; Bin++){
+        while (CurHeap->QuickBins[Bin] != NULL){
+            FreeBlock* Node = CurHeap->QuickBins[Bin] ;
+            CurHeap->QuickBins[Bin] = HeapUtils_NextFree(Node) ;
+            HeapExtras_FreeOperation(Node);
+            Released = VALID ;
+        }
+        CurHeap->QuickCount[Bin] = 0 ;
+    }
+    CurHeap->QuickBytes = 0 ;
+
+    return Released ;
+}
+
+
+sint8 HeapQuickList_Validate(void){
+    for (size_t Bin = 0; Bin < QUICKLIST_BINS; Bin++){
+        size_t Count = 0 ;
+
+        for (FreeBlock* Node = CurHeap->QuickBins[Bin]; Node != NULL; Node = HeapUtils_NextFree(Node)){
+            if ((sint8*)Node < CurHeap->RegionStart || (sint8*)Node >= CurHeap->CurBreak){
+                fprintf(stderr, "Consistency: quick list block %p is out of heap limits\n", (void*)Node);
+                return INVALID ;
+            }
+            if (Node->BlockSize != sizeof(FreeBlock) + 8 * Bin){
+                fprintf(stderr, "Consistency: quick list block %p has size %zu in list of size %zu\n",
+                        (void*)Node, Node->BlockSize, sizeof(FreeBlock) + 8 * Bin);
+                return INVALID ;
+            }
+            if (++Count > CurHeap->QuickCount[Bin]){
+                fprintf(stderr, "Consistency: quick list of size %zu holds more blocks than counted\n",
+                        sizeof(FreeBlock) + 8 * Bin);
+                return INVALID ;
+            }
+        }
+
+        if (Count != CurHeap->QuickCount[Bin]){
+            fprintf(stderr, "Consistency: quick list of size %zu holds %zu blocks but %u are counted\n",
+                    sizeof(FreeBlock) + 8 * Bin, Count, CurHeap->QuickCount[Bin]);
+            return INVALID ;
+        }
+    }
+
+    return VALID ;
+}
@@ -0,0 +1,77 @@
+/*============================================================================
+ * @file name      : HeapQuickList.h
+ * @Author         : Shehab Aldeen Mohammed
+ * @Github         : https://github.com/ShehabAldeenMo
+ * @LinkedIn       : https://www.linkedin.com/in/shehab-aldeen-mohammed/
+ *
+ =============================================================================
+ * @Description:
+ * This header file declares the quick lists used for deferred coalescing. Small
+ * freed blocks are pushed on a LIFO list of their exact size instead of being
+ * merged with their neighbours, and the next allocation of the same size pops
+ * them back without searching the free list.
+ *
+=============================================================================
+ * @Notes:
+ * - Enabled by the `QUICKLIST` configuration in `HeapUtils.h`, the lists and
+ *   their limits are part of the Heap structure declared there.
+ * - Blocks in the quick lists are still allocated from the free list point of
+ *   view, they are coalesced in bulk by HeapQuickList_Flush when an allocation
+ *   cannot be satisfied from the free list.
+ *
+ ******************************************************************************
+ ==============================================================================
+*/
+#ifndef HEAP_QUICK_LIST_H_
+#define HEAP_QUICK_LIST_H_
+
+/*===================================  Includes ===============================*/
+#include "../Level_3/HeapUtils.h"
+
+
+/*==========================  Function Prototypes ===========================*/
+/*
+ * Name             : HeapQuickList_Push
+ * Description      : Caches a freed block on the quick list of its exact size.
+ * Input            : FreeBlock* Node - A pointer to the metadata of the block being freed.
+ * Output           : None.
+ * Return           : VALID if the block was cached, INVALID if it is too large or its list is full
+ *                    and it has to be freed through the free list.
+ * Notes            : The block keeps its size and only its NextFreeBlock field is used as the link.
+ */
+sint8  HeapQuickList_Push(FreeBlock* Node);
+
+/*
+ * Name             : HeapQuickList_Pop
+ * Description      : Takes the most recently cached block of the requested size.
+ * Input            : size - The requested size of memory to allocate.
+ * Output           : None.
+ * Return           : Pointer to the data of the cached block, or NULL if its quick list is empty.
+ * Notes            : The size is aligned the same way as the fit algorithms do.
+ */
+sint8* HeapQuickList_Pop(size_t size);
+
+/*
+ * Name             : HeapQuickList_Flush
+ * Description      : Empties all quick lists by returning their blocks to the free list, where they
+ *                    are coalesced with their free neighbours.
+ * Input            : MinBytes - The lists are flushed only if they hold at least this many bytes.
+ * Output           : None.
+ * Return           : VALID if at least one block was released, INVALID otherwise.
+ * Notes            : Called by the fit algorithms with the requested size before extending the heap, 
+ *                    so a large request doesn't rescan the free list for a few cached small blocks.
+ *                    Pass 0 to flush unconditionally.
+ */
+sint8  HeapQuickList_Flush(size_t MinBytes);
+
+/*
+ * Name             : HeapQuickList_Validate
+ * Description      : Checks that every cached block has the size of its list and lies inside the heap.
+ * Input            : None.
+ * Output           : Prints the first violation found on stderr.
+ * Return           : VALID if the quick lists are consistent, INVALID otherwise.
+ * Notes            : Used by HeapTest_CheckConsistency.
+ */
+sint8  HeapQuickList_Validate(void);
+
+#endif
@@ -0,0 +1,221 @@
+/*============================================================================
+ * @file name      : HeapShm.c
+ * @Author         : Shehab Aldeen Mohammed
+ * @Github         : https://github.com/ShehabAldeenMo
+ * @LinkedIn       : https://www.linkedin.com/in/shehab-aldeen-mohammed/
+ *
+ =============================================================================
+ * @Description:
+ * This file contains the implementation of the shared memory heap. The heap
+ * instance lives in a POSIX shared memory object and every operation runs the
+ * usual heap functions on it while holding a process shared robust mutex.
+ *
+=============================================================================
+ * @Notes:
+ * - Link with -pthread (and -lrt on glibc older than 2.34).
+ * - The Heap structure keeps absolute pointers, they are valid at shm->Base.
+ *   HeapShm_Lock moves them by the difference between the mappings when a
+ *   process with another mapping address takes the lock.
+ *
+ ******************************************************************************
+ ==============================================================================
+*/
+
+/*===================================  Includes ==============================*/
+#include "HeapShm.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*=========================  Static Functions ===========================*/
+static void* HeapShm_Move(void* ptr, intptr_t Delta) {
+    return (ptr == NULL) ? NULL : (void*)((sint8*)ptr + Delta);
+}
+
+/*
+ * Make the absolute pointers of the heap valid in the mapping of the calling process.
+ */
+static void HeapShm_Rebase(HeapShm* shm) {
+    intptr_t Delta = (sint8*)shm - shm->Base ;
+    Heap*    heap  = &shm->heap ;
+
+    if (Delta == 0) {
+        return ;
+    }
+
+    heap->ptrHead     = HeapShm_Move(heap->ptrHead, Delta);
+    heap->ptrTail     = HeapShm_Move(heap->ptrTail, Delta);
+    heap->ptrRover    = HeapShm_Move(heap->ptrRover, Delta);
+    heap->CurBreak    = HeapShm_Move(heap->CurBreak, Delta);
+    heap->RegionStart = HeapShm_Move(heap->RegionStart, Delta);
+    heap->RegionEnd   = HeapShm_Move(heap->RegionEnd, Delta);
+    for (size_t Bin = 0; Bin < QUICKLIST_BINS; Bin++) {
+        heap->QuickBins[Bin] = HeapShm_Move(heap->QuickBins[Bin], Delta);
+    }
+
+    shm->Base = (sint8*)shm ;
+}
+
+static HeapShm* HeapShm_Map(int fd, size_t size) {
+    void* region = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (region == MAP_FAILED) {
+        perror("mmap");
+        return NULL ;
+    }
+    return (HeapShm*)region ;
+}
+
+
+/*=========================  Functions Implementation ===========================*/
+HeapShm* HeapShm_Create(const char* name, size_t size) {
+    pthread_mutexattr_t Attr;
+
+    if (size < sizeof(HeapShm) + BREAK_STEP_SIZE) {
+#if DEBUGGING == ENABLE
+        printf("Shared heap of %zu bytes is too small\n", size);
+#endif
+        return NULL ;
+    }
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd == -1) {
+        perror("shm_open");
+        return NULL ;
+    }
+    if (ftruncate(fd, (off_t)size) == -1) {
+        perror("ftruncate");
+        close(fd);
+        shm_unlink(name);
+        return NULL ;
+    }
+
+    HeapShm* shm = HeapShm_Map(fd, size);
+    if (shm == NULL) {
+        shm_unlink(name);
+        return NULL ;
+    }
+
+    // the lock must work across processes and survive the death of its owner
+    pthread_mutexattr_init(&Attr);
+    pthread_mutexattr_setpshared(&Attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&Attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&shm->Lock, &Attr);
+    pthread_mutexattr_destroy(&Attr);
+
+    // same initial state as Heap_Create, the blocks start right after the header
+    memset(&shm->heap, 0, sizeof(Heap));
+    shm->heap.RegionStart = (sint8*)shm + sizeof(HeapShm) ;
+    shm->heap.RegionEnd   = (sint8*)shm + size ;
+    shm->heap.InitFlag    = ON ;
+    shm->Size             = size ;
+    shm->Base             = (sint8*)shm ;
+
+    // publish the header only once it is complete, HeapShm_Open checks it
+    __sync_synchronize();
+    shm->Magic = HEAP_SHM_MAGIC ;
+
+    return shm ;
+}
+
+
+HeapShm* HeapShm_Open(const char* name) {
+    struct stat Info;
+
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd == -1) {
+        perror("shm_open");
+        return NULL ;
+    }
+    if (fstat(fd, &Info) == -1 || (size_t)Info.st_size < sizeof(HeapShm)) {
+        perror("fstat");
+        close(fd);
+        return NULL ;
+    }
+
+    HeapShm* shm = HeapShm_Map(fd, (size_t)Info.st_size);
+    if (shm == NULL) {
+        return NULL ;
+    }
+    if (shm->Magic != HEAP_SHM_MAGIC) {
+#if DEBUGGING == ENABLE
+        printf("Shared heap %s is not initialized\n", name);
+#endif
+        munmap(shm, (size_t)Info.st_size);
+        return NULL ;
+    }
+
+    return shm ;
+}
+
+
+void HeapShm_Close(HeapShm* shm) {
+    if (shm != NULL) {
+        munmap(shm, shm->Size);
+    }
+}
+
+
+sint8 HeapShm_Unlink(const char* name) {
+    return (shm_unlink(name) == 0) ? VALID : INVALID ;
+}
+
+
+sint8 HeapShm_Lock(HeapShm* shm) {
+    int ret = pthread_mutex_lock(&shm->Lock);
+
+    if (ret == EOWNERDEAD) {
+        fprintf(stderr, "HeapShm: previous lock owner died, the shared heap is used as it was left\n");
+        pthread_mutex_consistent(&shm->Lock);
+    }
+    else if (ret != 0) {
+        errno = ret ;
+        perror("pthread_mutex_lock");
+        return INVALID ;
+    }
+
+    HeapShm_Rebase(shm);
+    return VALID ;
+}
+
+
+void HeapShm_Unlock(HeapShm* shm) {
+    pthread_mutex_unlock(&shm->Lock);
+}
+
+
+void* HeapShm_Alloc(HeapShm* shm, size_t size) {
+    if (shm == NULL || HeapShm_Lock(shm) == INVALID) {
+        return NULL ;
+    }
+
+    void* ptr = Heap_Alloc(&shm->heap, size);
+
+    HeapShm_Unlock(shm);
+    return ptr ;
+}
+
+
+void HeapShm_Free(HeapShm* shm, void* ptr) {
+    if (shm == NULL || ptr == NULL || HeapShm_Lock(shm) == INVALID) {
+        return ;
+    }
+
+    Heap_Free(&shm->heap, ptr);
+
+    HeapShm_Unlock(shm);
+}
+
+
+size_t HeapShm_ToOffset(HeapShm* shm, void* ptr) {
+    return (ptr == NULL) ? 0 : (size_t)((sint8*)ptr - (sint8*)shm);
+}
+
+
+void* HeapShm_ToPointer(HeapShm* shm, size_t offset) {
+    return (offset == 0) ? NULL : (void*)((sint8*)shm + offset);
+}
@@ -0,0 +1,166 @@
+/*============================================================================
+ * @file name      : HeapShm.h
+ * @Author         : Shehab Aldeen Mohammed
+ * @Github         : https://github.com/ShehabAldeenMo
+ * @LinkedIn       : https://www.linkedin.com/in/shehab-aldeen-mohammed/
+ *
+ =============================================================================
+ * @Description:
+ * This header file declares the shared memory heap. A heap instance is placed
+ * in a POSIX shared memory object (shm_open/mmap) together with a process
+ * shared robust mutex, so cooperating processes can allocate payloads in the
+ * shared region and exchange offsets instead of copying the payloads.
+ *
+=============================================================================
+ * @Notes:
+ * - The free list links are offsets from the blocks themselves, so the list is
+ *   valid whatever address a process maps the region at. The few absolute
+ *   pointers of the Heap structure are rebased by the process that takes the
+ *   lock when its mapping address differs from the previous owner's one.
+ * - Blocks must be passed between processes as offsets (HeapShm_ToOffset and
+ *   HeapShm_ToPointer), a pointer is only valid in the process that made it.
+ * - The heap manager itself is single threaded, the lock serializes processes
+ *   and not threads using the default heap at the same time.
+ *
+ ******************************************************************************
+ ==============================================================================
+*/
+#ifndef HEAP_SHM_H_
+#define HEAP_SHM_H_
+
+/*===================================  Includes ===============================*/
+#include "HeapManager.h"
+#include <pthread.h>
+
+
+/*==================================  Definitions =============================*/
+#define HEAP_SHM_MAGIC           0x48454150534D4D31ULL  // "HEAPSMM1", set once the region is ready
+
+
+/*==============================  typedef   =====================================*/
+/*
+ * Header at the start of the shared memory object, the blocks follow it.
+ */
+typedef struct HeapShm {
+    uint64          Magic;                  // HEAP_SHM_MAGIC once initialized
+    size_t          Size;                   // size of the shared memory object
+    sint8*          Base;                   // mapping address the pointers of heap are valid at
+    pthread_mutex_t Lock;                   // process shared robust mutex protecting the heap
+    Heap            heap;                   // heap instance over the rest of the object
+} HeapShm;
+
+
+/*==========================  Function Prototypes ===========================*/
+/*
+ * Name             : HeapShm_Create
+ * Description      : Creates a shared memory object, maps it and initializes a heap instance and its
+ *                    process shared robust mutex in it.
+ * Input            : name - Name of the shared memory object ("/name" as for shm_open).
+ *                    size - Size of the object in bytes.
+ * Output           : Prints the failing system call with perror.
+ * Return           : The mapped shared heap, or NULL if the object exists or can't be created.
+ * Notes            : The size must be at least sizeof(HeapShm) + BREAK_STEP_SIZE. The object stays
+ *                    in the system until HeapShm_Unlink.
+ */
+HeapShm* HeapShm_Create(const char* name, size_t size);
+
+/*
+ * Name             : HeapShm_Open
+ * Description      : Maps a shared heap created by another process.
+ * Input            : name - Name given to HeapShm_Create.
+ * Output           : Prints the failing system call with perror.
+ * Return           : The mapped shared heap, or NULL if it doesn't exist or isn't initialized yet.
+ * Notes            : The mapping address may differ from the other processes' ones.
+ */
+HeapShm* HeapShm_Open(const char* name);
+
+/*
+ * Name             : HeapShm_Close
+ * Description      : Unmaps a shared heap from the calling process.
+ * Input            : shm - Shared heap returned by HeapShm_Create or HeapShm_Open.
+ * Output           : None
+ * Return           : None
+ * Notes            : The blocks stay allocated for the other processes.
+ */
+void     HeapShm_Close(HeapShm* shm);
+
+/*
+ * Name             : HeapShm_Unlink
+ * Description      : Removes the shared memory object name, the memory is released once every
+ *                    process closed it.
+ * Input            : name - Name given to HeapShm_Create.
+ * Output           : None
+ * Return           : VALID on success, INVALID otherwise.
+ * Notes            : None
+ */
+sint8    HeapShm_Unlink(const char* name);
+
+/*
+ * Name             : HeapShm_Lock
+ * Description      : Takes the heap mutex and rebases the heap pointers to the mapping of the
+ *                    calling process.
+ * Input            : shm - Shared heap.
+ * Output           : Reports on stderr when the previous owner died holding the lock.
+ * Return           : VALID when the lock is held, INVALID otherwise.
+ * Notes            : Used by HeapShm_Alloc/HeapShm_Free, and directly to run several operations or
+ *                    to inspect shm->heap atomically. If the owner died in the middle of an operation
+ *                    the mutex is made consistent again and the heap is used as it was left.
+ */
+sint8    HeapShm_Lock(HeapShm* shm);
+
+/*
+ * Name             : HeapShm_Unlock
+ * Description      : Releases the heap mutex taken by HeapShm_Lock.
+ * Input            : shm - Shared heap.
+ * Output           : None
+ * Return           : None
+ * Notes            : None
+ */
+void     HeapShm_Unlock(HeapShm* shm);
+
+/*
+ * Name             : HeapShm_Alloc
+ * Description      : Allocates a block in the shared heap.
+ * Input            : shm - Shared heap.
+ *                    size - The size of the memory block to be allocated (in bytes).
+ * Output           : None
+ * Return           : A pointer to the block in the mapping of the calling process, or NULL if the
+ *                    shared region is exhausted.
+ * Notes            : None
+ */
+void*    HeapShm_Alloc(HeapShm* shm, size_t size);
+
+/*
+ * Name             : HeapShm_Free
+ * Description      : Frees a block of the shared heap, whichever process allocated it.
+ * Input            : shm - Shared heap.
+ *                    ptr - A pointer to the block in the mapping of the calling process.
+ * Output           : None
+ * Return           : None
+ * Notes            : None
+ */
+void     HeapShm_Free(HeapShm* shm, void* ptr);
+
+/*
+ * Name             : HeapShm_ToOffset
+ * Description      : Converts a block pointer to an offset that can be sent to another process.
+ * Input            : shm - Shared heap.
+ *                    ptr - A pointer in the mapping of the calling process, or NULL.
+ * Output           : None
+ * Return           : The offset of ptr from the start of the shared object, 0 for NULL.
+ * Notes            : None
+ */
+size_t   HeapShm_ToOffset(HeapShm* shm, void* ptr);
+
+/*
+ * Name             : HeapShm_ToPointer
+ * Description      : Converts an offset received from another process to a pointer.
+ * Input            : shm - Shared heap.
+ *                    offset - Offset returned by HeapShm_ToOffset.
+ * Output           : None
+ * Return           : The pointer in the mapping of the calling process, NULL for offset 0.
+ * Notes            : None
+ */
+void*    HeapShm_ToPointer(HeapShm* shm, size_t offset);
+
+#endif
@@ -33,11 +33,8 @@
 
 
 /*============================  extern Global Variable ==============================*/
-extern sint64 SimHeap[MAX_HEAPLENGHT];          // simulated heap
-extern FreeBlock* ptrHead;
-extern FreeBlock* ptrTail;
-extern sint8* CurBreak;                         // break pointer on simulated heap
- 
+extern _Thread_local Heap* CurHeap;                   // heap instance the operations of this thread work on
+
 /*=========================  Functions Implementation ===========================*/
 sint8* HeapUtils_AllocationCoreLoop(FreeBlock* ptrBlock,size_t ReqSize){
     sint8* RetDataPtr         = NULL ;  
@@ -62,17 +59,17 @@ sint8* HeapUtils_AllocationCoreLoop(FreeBlock* ptrBlock,size_t ReqSize){
 
 
 sint8* HeapUtils_sbrk (size_t size){
-    sint8* result = CurBreak + size ; // to use it in check size condition
+    sint8* result = CurHeap->CurBreak + size ; // to use it in check size condition
     sint8* temp = NULL;
 
     /*to ensure that the new current break in heap limitions*/
-    if ( result < (sint8*)SimHeap ){
+    if ( result < CurHeap->RegionStart ){
 #if DEBUGGING == ENABLE  
         printf("Invalid passing negative size parameter\n");
 #endif
         return temp ;
     }
-    else if (result > ((sint8*) &SimHeap[MAX_HEAPLENGHT]) ){
+    else if (result > CurHeap->RegionEnd ){
 #if DEBUGGING == ENABLE 
         printf("Invalid passing positive size parameter\n");
 #endif
@@ -80,8 +77,8 @@ sint8* HeapUtils_sbrk (size_t size){
     } // else continue work to extend pointer of break counter
 
     /*update heap break*/
-    temp = CurBreak ;
-    CurBreak += size ;   
+    temp = CurHeap->CurBreak ;
+    CurHeap->CurBreak += size ;   
     return temp ;
 }
 
@@ -97,13 +94,12 @@ sint8* HeapUtils_sbrkResize(size_t ReqSize,sint8 flag){
     while (RetDataPtr == NULL){
         New = (FreeBlock*)HeapUtils_sbrk(BREAK_STEP_SIZE);
 
-        /* if there is no space */
+        /* if there is no space left in the heap region the allocation fails */
         if (New == NULL){
 #if DEBUGGING == ENABLE 
             printf("Invalid state from Helper_sbrk function\n");
 #endif
-            while(1);///////////////////////////// for testing
-            exit(INVALID);
+            return NULL ;
         }
 
         /* 
@@ -117,19 +113,19 @@ sint8* HeapUtils_sbrkResize(size_t ReqSize,sint8 flag){
             *        3. new tail -> next free space point to !
             *        4. remove old tail node 
             */
-           ptrTail->NextFreeBlock = New ;
-           New->PreviousFreeBlock = ptrTail ;
-           ptrTail = New ;
+           HeapUtils_SetFreeNodeInfo(New,BREAK_STEP_SIZE-sizeof(size_t),CurHeap->ptrTail,NULL);
+           HeapUtils_SetNextFree(CurHeap->ptrTail, New) ;
+           CurHeap->ptrTail = New ;
         }
         else if (flag == STATE2){
             /*
             * Extend current break pointer and resize heap
             * still head and tail point to the same node but with new size
             * */
-            ptrTail->BlockSize += BREAK_STEP_SIZE;
+            CurHeap->ptrTail->BlockSize += BREAK_STEP_SIZE;
         } // else continue in loop
         flag = STATE2 ;
-        RetDataPtr = HeapUtils_AllocationCoreLoop(ptrTail, ReqSize);
+        RetDataPtr = HeapUtils_AllocationCoreLoop(CurHeap->ptrTail, ReqSize);
     }
 
     return RetDataPtr ;
@@ -142,7 +138,7 @@ sint8* HeapUtils_SplitFreeBlock (FreeBlock* Node, size_t spliting_size){
 
     /* head and tail point to the same node */
     sint8 HeadAndTail = INVALID ;
-    if (ptrHead == ptrTail){
+    if (CurHeap->ptrHead == CurHeap->ptrTail){
         HeadAndTail = VALID ;
     } 
 
@@ -152,7 +148,7 @@ sint8* HeapUtils_SplitFreeBlock (FreeBlock* Node, size_t spliting_size){
     *        2. next free space pointer will redefine in array but still point to the same cell
     *        3. metadata will redefine in array and store remaining size of free space
     */
-   if (Node == ptrHead){
+   if (Node == CurHeap->ptrHead){
 #if DEBUGGING == ENABLE
         printf("Free Size from Head = %5ld\nRequired Size from user = %5ld\n",Node->BlockSize,spliting_size);
         getchar();
@@ -165,30 +161,32 @@ sint8* HeapUtils_SplitFreeBlock (FreeBlock* Node, size_t spliting_size){
         * - we need this local variable if there is a free node after head to make head_next_node-> previous
         * point to the new location of head.  
         * */
-        FreeBlock* NextNode = Node->NextFreeBlock ;
+        FreeBlock* NextNode = HeapUtils_NextFree(Node) ;
         
         /* to shift tail with first group calls for maollac*/
         if (HeadAndTail == INVALID){
-            ptrHead = (FreeBlock*) ((sint8*)ptrHead + spliting_size + sizeof(size_t));
-            HeapUtils_SetFreeNodeInfo(ptrHead, (SizeOfFreeSpace-spliting_size-sizeof(size_t)), NULL,NextNode);
-            NextNode->PreviousFreeBlock = ptrHead ;
+            CurHeap->ptrHead = (FreeBlock*) ((sint8*)CurHeap->ptrHead + spliting_size + sizeof(size_t));
+            HeapUtils_SetFreeNodeInfo(CurHeap->ptrHead, (SizeOfFreeSpace-spliting_size-sizeof(size_t)), NULL,NextNode);
+            HeapUtils_SetPreviousFree(NextNode, CurHeap->ptrHead) ;
         }
         else if (HeadAndTail == VALID){
-            ptrHead = (FreeBlock*) ((sint8*)ptrHead + spliting_size + sizeof(size_t)) ;
-            ptrTail = ptrHead ;
-            HeapUtils_SetFreeNodeInfo(ptrHead,(SizeOfFreeSpace-spliting_size-sizeof(size_t)), NULL,NULL);
+            CurHeap->ptrHead = (FreeBlock*) ((sint8*)CurHeap->ptrHead + spliting_size + sizeof(size_t)) ;
+            CurHeap->ptrTail = CurHeap->ptrHead ;
+            HeapUtils_SetFreeNodeInfo(CurHeap->ptrHead,(SizeOfFreeSpace-spliting_size-sizeof(size_t)), NULL,NULL);
         }
+        HeapUtils_ReplaceRover(Node, CurHeap->ptrHead);
    }
     /* handle simulated array if tail is suitable to allocate this size
     *  that: 1. previous free space pointer will redefine in array but still point to the same cell
     *        2. next free space pointer will redefine in array and store ! in this cell
     *        3. metadata will redefine in array and store remaining size of free space
     */
-   else if (Node == ptrTail){
-        FreeBlock* PreNode = Node->PreviousFreeBlock;
-        ptrTail = (FreeBlock*) ((sint8*)Node + spliting_size + sizeof(size_t));
-        HeapUtils_SetFreeNodeInfo(ptrTail,(SizeOfFreeSpace-spliting_size-sizeof(size_t)),PreNode,NULL); 
-        PreNode->NextFreeBlock = ptrTail ;
+   else if (Node == CurHeap->ptrTail){
+        FreeBlock* PreNode = HeapUtils_PreviousFree(Node);
+        CurHeap->ptrTail = (FreeBlock*) ((sint8*)Node + spliting_size + sizeof(size_t));
+        HeapUtils_SetFreeNodeInfo(CurHeap->ptrTail,(SizeOfFreeSpace-spliting_size-sizeof(size_t)),PreNode,NULL); 
+        HeapUtils_SetNextFree(PreNode, CurHeap->ptrTail) ;
+        HeapUtils_ReplaceRover(Node, CurHeap->ptrTail);
    }
     /* handle simulated array if neither head or tail is suitable to allocate this size
     *  that: 1. previous free space pointer will redefine in array but still point to the same cell
@@ -198,11 +196,12 @@ sint8* HeapUtils_SplitFreeBlock (FreeBlock* Node, size_t spliting_size){
     */
     else if (InFreeList == VALID){
         FreeBlock* NewNode = (FreeBlock*) ((sint8*)Node + spliting_size + sizeof(size_t));
-        FreeBlock* PreNode = Node->PreviousFreeBlock ;
-        FreeBlock* NextNode = Node->NextFreeBlock;
+        FreeBlock* PreNode = HeapUtils_PreviousFree(Node) ;
+        FreeBlock* NextNode = HeapUtils_NextFree(Node);
         HeapUtils_SetFreeNodeInfo(NewNode,(SizeOfFreeSpace-spliting_size-sizeof(size_t)), PreNode,NextNode);  
-        PreNode->NextFreeBlock = NewNode ;
-        NextNode->PreviousFreeBlock = NewNode ;
+        HeapUtils_SetNextFree(PreNode, NewNode) ;
+        HeapUtils_SetPreviousFree(NextNode, NewNode) ;
+        HeapUtils_ReplaceRover(Node, NewNode);
     }
     else {
 #if DEBUGGING == ENABLE 
@@ -230,7 +229,7 @@ sint8* HeapUtils_RemoveFreeBlock (FreeBlock* Node, size_t spliting_size){
     
     /* head and tail point to the same node */
     sint8 HeadAndTail = INVALID ;
-    if (ptrHead == ptrTail){
+    if (CurHeap->ptrHead == CurHeap->ptrTail){
         HeadAndTail = VALID ;
     }
 
@@ -240,7 +239,7 @@ sint8* HeapUtils_RemoveFreeBlock (FreeBlock* Node, size_t spliting_size){
     *  that  1. shift head node to next node
     *        2. make next node -> previous free space equals !
     */
-   if (Node == ptrHead){
+   if (Node == CurHeap->ptrHead){
 #if DEBUGGING == ENABLE
         printf("Free Size from Head = %5ld\nRequired Size from user = %5ld\n",Node->BlockSize,spliting_size);
         getchar();
@@ -251,32 +250,35 @@ sint8* HeapUtils_RemoveFreeBlock (FreeBlock* Node, size_t spliting_size){
         * */
         /* to shift tail with first group calls for maollac*/
         if (HeadAndTail == INVALID){
-            ptrHead = ptrHead->NextFreeBlock ;
-            ptrHead->PreviousFreeBlock = NULL ;
+            CurHeap->ptrHead = HeapUtils_NextFree(CurHeap->ptrHead) ;
+            HeapUtils_SetPreviousFree(CurHeap->ptrHead, NULL) ;
+            HeapUtils_ReplaceRover(Node, CurHeap->ptrHead);
         }
         else if (HeadAndTail == VALID ){
+            /* the free list can't be empty, so the last free block is only taken if the heap can grow */
             FreeBlock* New = (FreeBlock*)HeapUtils_sbrk(BREAK_STEP_SIZE); 
             if (New == NULL){
 #if DEBUGGING == ENABLE 
                 printf("Invalid state from Helper_sbrk function\n");
 #endif
-                while(1);///////////////////////////// for testing
-                exit(INVALID);
+                return NULL ;
             }
 
             HeapUtils_SetFreeNodeInfo(New,BREAK_STEP_SIZE-sizeof(size_t),NULL,NULL);
-            ptrTail = New ;
-            ptrHead = New ;
+            CurHeap->ptrTail = New ;
+            CurHeap->ptrHead = New ;
+            HeapUtils_ReplaceRover(Node, New);
         }
    }
     /* handle simulated array if tail is suitable to allocate this size
     *  that: 1. backword tail index to previous free slot 
     *        2. backword tail -> next free space point to !
     * */
-   else if (Node == ptrTail){
-        FreeBlock* Backwork_Tail = ptrTail->PreviousFreeBlock ; 
-        ptrTail = Backwork_Tail ;
-        ptrTail->NextFreeBlock = NULL ;
+   else if (Node == CurHeap->ptrTail){
+        FreeBlock* Backwork_Tail = HeapUtils_PreviousFree(CurHeap->ptrTail) ; 
+        CurHeap->ptrTail = Backwork_Tail ;
+        HeapUtils_SetNextFree(CurHeap->ptrTail, NULL) ;
+        HeapUtils_ReplaceRover(Node, NULL);
    }
     /* handle simulated array if neither head or tail is suitable to allocate this size
     *  that: 1. make next node -> previous free space index point to temp -> previous free space
@@ -284,10 +286,11 @@ sint8* HeapUtils_RemoveFreeBlock (FreeBlock* Node, size_t spliting_size){
     *        3. remove temp node 
     */
    else if (InFreeList == VALID){
-        FreeBlock* PreTemp = Node->PreviousFreeBlock ;
-        FreeBlock* NextTemp = Node->NextFreeBlock;
-        NextTemp->PreviousFreeBlock = PreTemp ; 
-        PreTemp->NextFreeBlock = NextTemp ; 
+        FreeBlock* PreTemp = HeapUtils_PreviousFree(Node) ;
+        FreeBlock* NextTemp = HeapUtils_NextFree(Node);
+        HeapUtils_SetPreviousFree(NextTemp, PreTemp) ; 
+        HeapUtils_SetNextFree(PreTemp, NextTemp) ; 
+        HeapUtils_ReplaceRover(Node, NextTemp);
     }
     else {
 #if DEBUGGING == ENABLE 
@@ -310,13 +313,13 @@ sint8* HeapUtils_RemoveFreeBlock (FreeBlock* Node, size_t spliting_size){
 
 
 sint8 HeapUtils_SearchOnIndexInFreeList(FreeBlock* block){
-    FreeBlock* ptr = ptrHead ;
+    FreeBlock* ptr = CurHeap->ptrHead ;
     while( ptr != NULL ){ // while its next node is not jump over break
         if (block == ptr ){
             return VALID ;
         }
         else {
-            ptr = ptr->NextFreeBlock ;
+            ptr = HeapUtils_NextFree(ptr) ;
         }
     }
     return INVALID ;
@@ -325,26 +328,26 @@ sint8 HeapUtils_SearchOnIndexInFreeList(FreeBlock* block){
 
 
 void   HeapUtils_SetFreeNodeInfo(FreeBlock* Node, size_t metadata, FreeBlock* previous_content, FreeBlock* next_content){
-    Node->PreviousFreeBlock = previous_content ; 
-    Node->NextFreeBlock = next_content ;
+    HeapUtils_SetPreviousFree(Node, previous_content) ; 
+    HeapUtils_SetNextFree(Node, next_content) ;
     Node->BlockSize =  metadata;
 }
 
 void Shrink_Break(sint8 flag){
     if (flag == STATE2){
-        size_t Tail_Size = ptrTail->BlockSize ;
+        size_t Tail_Size = CurHeap->ptrTail->BlockSize ;
 
         while (Tail_Size > BREAK_STEP_SIZE){
-            sint8* result = CurBreak - BREAK_STEP_SIZE ; // to use it in check size condition
+            sint8* result = CurHeap->CurBreak - BREAK_STEP_SIZE ; // to use it in check size condition
 
             /*to ensure that the new current break in heap limitions*/
-            if ( result < (sint8*)SimHeap ){
+            if ( result < CurHeap->RegionStart ){
 #if DEBUGGING == ENABLE 
                 printf("Invalid passing negative size parameter\n");
 #endif
                 return;
             }
-            else if (result > ((sint8*) &SimHeap[MAX_HEAPLENGHT]) ){
+            else if (result > CurHeap->RegionEnd ){
 #if DEBUGGING == ENABLE 
                 printf("Invalid passing positive size parameter\n");
 #endif
@@ -352,9 +355,16 @@ void Shrink_Break(sint8 flag){
             } // else continue work to extend pointer of break counter
 
             /*update heap break*/
-            CurBreak -= BREAK_STEP_SIZE ; 
-            ptrTail->BlockSize -= BREAK_STEP_SIZE ; 
-            Tail_Size = ptrTail->BlockSize ;
+            CurHeap->CurBreak -= BREAK_STEP_SIZE ; 
+            CurHeap->ptrTail->BlockSize -= BREAK_STEP_SIZE ; 
+            Tail_Size = CurHeap->ptrTail->BlockSize ;
         }
     }
-}
\ No newline at end of file
+}
+
+void HeapUtils_ReplaceRover(FreeBlock* OldNode, FreeBlock* NewNode){
+    if (CurHeap->ptrRover == OldNode){
+        /* wrap around to the head when the rover falls off the end of the list */
+        CurHeap->ptrRover = (NewNode != NULL) ? NewNode : CurHeap->ptrHead ;
+    }
+}
@@ -30,6 +30,7 @@
 #include <stdio.h>          // Standard I/O functions
 #include <stdlib.h>         // Standard library functions: memory management, program utilities, etc.
 #include <string.h>         // String manipulation functions
+#include <stdint.h>         // uintptr_t
 
 
 /*==================================  Definitions ===========================*/
@@ -52,6 +53,22 @@
 /*==============================  Configurations   =====================================*/
 #define DEBUGGING                                DISABLE
 
+/*
+* to search the free list from a roving pointer (next fit) set 'ENABLE'
+* to always search from the head (first fit) set 'DISABLE'
+*/
+#ifndef NEXTFIT
+#define NEXTFIT                                  DISABLE
+#endif
+
+/*
+* to keep small freed blocks in per size quick lists and defer their coalescing set 'ENABLE'
+* to coalesce every freed block immediately set 'DISABLE'
+*/
+#ifndef QUICKLIST
+#define QUICKLIST                                ENABLE
+#endif
+
 
 /*==============================  typedef   =====================================*/
 typedef unsigned char boolean         ;
@@ -66,12 +83,42 @@ typedef unsigned long long int uint64 ;
 typedef float float32                 ;
 typedef double float64                ;
 
+/*
+ * The free list links are stored as offsets from the block itself (0 for no block), so the
+ * list stays valid when the heap region is mapped at another address, e.g. shared memory
+ * mapped by several processes. They are accessed through HeapUtils_NextFree/PreviousFree.
+ */
 typedef struct FreeBlock {
-    size_t BlockSize;
-    struct FreeBlock* NextFreeBlock;
-    struct FreeBlock* PreviousFreeBlock;
+    size_t   BlockSize;
+    intptr_t NextFreeBlock;
+    intptr_t PreviousFreeBlock;
 } FreeBlock;
 
+/*
+ * Quick lists of deferred coalescing, list N holds blocks of exactly sizeof(FreeBlock) + 8*N bytes
+ */
+#define QUICKLIST_MAX_SIZE       256                                    // largest block size kept in a quick list
+#define QUICKLIST_BINS           ((QUICKLIST_MAX_SIZE - sizeof(FreeBlock)) / 8 + 1)
+#define QUICKLIST_MAX_COUNT      64                                     // blocks kept per size before freeing normally
+
+/*
+ * State of one heap instance. The default heap runs over SimHeap, other instances run over
+ * a memory region given to Heap_Create and keep this structure at the start of the region.
+ */
+typedef struct Heap {
+    FreeBlock* ptrHead;                             // first node of the free list
+    FreeBlock* ptrTail;                             // last node of the free list
+    FreeBlock* ptrRover;                            // next fit roving pointer
+    sint8*     CurBreak;                            // break pointer of the heap
+    sint8*     RegionStart;                         // first byte available for blocks
+    sint8*     RegionEnd;                           // limit that the break can't cross
+    sint8      TailBrkState;                        // relation between the tail and the break
+    uint8      InitFlag;                            // ON until the first allocation initializes the heap
+    uint8      QuickCount[QUICKLIST_BINS];          // number of blocks in every quick list
+    FreeBlock* QuickBins[QUICKLIST_BINS];           // top of every quick list
+    size_t     QuickBytes;                          // bytes held by all quick lists
+} Heap;
+
 /*==============================  Functions Prototypes   ==========================*/
 /*
  * Name             : HeapUtils_AllocationCoreLoop
@@ -97,7 +144,7 @@ sint8* HeapUtils_AllocationCoreLoop(FreeBlock* ptrBlock,size_t size);
  * Output           : None.
  * Return           : sint8* - A pointer to the previous program break or NULL if the requested size is invalid.
  * Notes            : The function checks if the requested size would cause the program break to exceed 
- *                    the simulated heap's boundaries, returning NULL if the request is invalid.
+ *                    the region of the current heap instance, returning NULL if the request is invalid.
  */
 sint8* HeapUtils_sbrk (size_t size);
 
@@ -112,8 +159,9 @@ sint8* HeapUtils_sbrk (size_t size);
  * Output           : None.
  * Return           : sint8* - A pointer to the allocated memory or NULL if allocation fails.
  * Notes            : The function loops until memory is successfully allocated, extending the heap 
- *                    as necessary. It handles cases where no suitable free space exists, creating 
- *                    or resizing blocks based on the provided flag.
+ *                    as necessary, or returns NULL once the heap region is exhausted. It handles cases 
+ *                    where no suitable free space exists, creating or resizing blocks based on the 
+ *                    provided flag.
  */
 sint8* HeapUtils_sbrkResize(size_t ReqSize,sint8 flag);
 
@@ -177,4 +225,53 @@ sint8  HeapUtils_SearchOnIndexInFreeList(FreeBlock* block);
 
 void Shrink_Break(sint8 flag);
 
+/*
+ * Name             : HeapUtils_ReplaceRover
+ * Description      : Keeps the next fit roving pointer valid when a free node leaves the free list 
+ *                    or moves to another address. If the rover points to the old node it is moved 
+ *                    to the node that takes its place.
+ * Input            : FreeBlock* OldNode - The free node that is removed, merged or moved.
+ *                    FreeBlock* NewNode - The free node that replaces it (NULL restarts from the head).
+ * Output           : None.
+ * Return           : None.
+ * Notes            : Called by every split, remove and coalescing operation that makes a free node 
+ *                    disappear, so the rover never points into allocated memory.
+ */
+void HeapUtils_ReplaceRover(FreeBlock* OldNode, FreeBlock* NewNode);
+
+
+/*==============================  Inline Functions   ==========================*/
+/*
+ * Name             : HeapUtils_NextFree / HeapUtils_PreviousFree
+ * Description      : Convert the self relative links of a free node to pointers.
+ * Input            : FreeBlock* Node - A free node (or a quick list node for the next link).
+ * Output           : None.
+ * Return           : FreeBlock* - The linked node or NULL at the end of the list.
+ * Notes            : A node never links to itself, so offset 0 is used for NULL.
+ */
+static inline FreeBlock* HeapUtils_NextFree(const FreeBlock* Node){
+    return (Node->NextFreeBlock == 0) ? NULL : (FreeBlock*)((sint8*)Node + Node->NextFreeBlock);
+}
+
+static inline FreeBlock* HeapUtils_PreviousFree(const FreeBlock* Node){
+    return (Node->PreviousFreeBlock == 0) ? NULL : (FreeBlock*)((sint8*)Node + Node->PreviousFreeBlock);
+}
+
+/*
+ * Name             : HeapUtils_SetNextFree / HeapUtils_SetPreviousFree
+ * Description      : Store a link of a free node as an offset from the node itself.
+ * Input            : FreeBlock* Node - The node to update.
+ *                    FreeBlock* Link - The linked node or NULL.
+ * Output           : None.
+ * Return           : None.
+ * Notes            : The links must be set again whenever a node is moved to another address.
+ */
+static inline void HeapUtils_SetNextFree(FreeBlock* Node, const FreeBlock* Link){
+    Node->NextFreeBlock = (Link == NULL) ? 0 : (intptr_t)((const sint8*)Link - (sint8*)Node);
+}
+
+static inline void HeapUtils_SetPreviousFree(FreeBlock* Node, const FreeBlock* Link){
+    Node->PreviousFreeBlock = (Link == NULL) ? 0 : (intptr_t)((const sint8*)Link - (sint8*)Node);
+}
+
 #endif 
\ No newline at end of file
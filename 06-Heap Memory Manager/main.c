@@ -27,7 +27,26 @@
 extern uint32 Fail ;
 
 /*==================================  main =====================================*/
-int main (){
+int main (int argc, char** argv){
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        HeapTest_Benchmark();
+        return 0 ;
+    }
+    if (argc > 1 && strcmp(argv[1], "--churn") == 0) {
+        HeapTest_ChurnBenchmark();
+        return 0 ;
+    }
+    if (argc > 1 && strcmp(argv[1], "--multi") == 0) {
+        HeapTest_MultiHeapTest();
+        printf("Fails = %u\n", Fail);
+        return (Fail == 0) ? 0 : 1 ;
+    }
+    if (argc > 1 && strcmp(argv[1], "--shm") == 0) {
+        HeapTest_SharedHeapTest();
+        printf("Fails = %u\n", Fail);
+        return (Fail == 0) ? 0 : 1 ;
+    }
+
     printf("Starting random allocation and deallocation test...\n");
     HeapTest_RandomAllocateFreeTest();
     printf("Test complete.\n");
@@ -31,11 +31,7 @@
 
 
 /*============================  extern Global Variable ==============================*/
-extern FreeBlock* ptrHead;
-extern FreeBlock* ptrTail;
-extern sint8*     CurBreak;                         // break pointer on simulated heap
-
-static sint8      TailBrkState = STATE1 ; 
+extern _Thread_local Heap* CurHeap;                   // heap instance the operations of this thread work on
 
 /*=========================  Functions Implementation ===========================*/
 sint8* HeapExtras_FirstFit(size_t size){
@@ -51,7 +47,7 @@ sint8* HeapExtras_FirstFit(size_t size){
     * size: Requested size for memory allocation.
     */
     sint8*            RetDataPtr   = NULL ;  
-    FreeBlock*        CurBlock     = ptrHead ; 
+    FreeBlock*        CurBlock     = CurHeap->ptrHead ; 
 
     // to ensure when free this pointer the new node will not overwrite on the next node
     if (size < sizeof(FreeBlock) ){
@@ -82,10 +78,12 @@ sint8* HeapExtras_FirstFit(size_t size){
     /* If no suitable free space was found, adjust the program break pointer and update the free list.
     * */
     if ( CurBlock == NULL){
-        RetDataPtr = HeapUtils_sbrkResize(size, TailBrkState);
+        RetDataPtr = HeapUtils_sbrkResize(size, CurHeap->TailBrkState);
     } // rather that will be continue on state 1
 
-    Shrink_Break(TailBrkState);
+    /* the allocation may have removed or moved the tail, so refresh its relation with the break */
+    TailBreakStatus();
+    Shrink_Break(CurHeap->TailBrkState);
 
     /* return index of allocation new space -> data */
     return RetDataPtr ;
@@ -93,10 +91,15 @@ sint8* HeapExtras_FirstFit(size_t size){
 
 
 void HeapExtras_Init() {
+    // Region heaps start their break at the region start, the default heap at the program break
+    if (CurHeap->RegionEnd != NULL) {
+        CurHeap->CurBreak = CurHeap->RegionStart ;
+    }
+
     // Use sbrk to allocate the initial block of memory from the system heap
-    void* heap_start = sbrk(BREAK_STEP_SIZE);
+    void* heap_start = HeapUtils_sbrk(BREAK_STEP_SIZE);
     
-    if (heap_start == (void*)-1) {
+    if (heap_start == NULL) {
         // Handle sbrk failure
         perror("sbrk failed");
         exit(EXIT_FAILURE);
@@ -113,11 +116,9 @@ void HeapExtras_Init() {
     initialBlock->PreviousFreeBlock = NULL;
 
     // Set the head and tail pointers to the initial block
-    ptrHead = initialBlock;
-    ptrTail = initialBlock;
-
-    // Set the current break pointer to the end of the allocated block
-    CurBreak = (sint8*)sbrk(0);  // Get the current program break
+    CurHeap->ptrHead = initialBlock;
+    CurHeap->ptrTail = initialBlock;
+    CurHeap->TailBrkState = STATE2 ;
 }
 
 
@@ -131,7 +132,7 @@ void   HeapExtras_FreeOperationBeforeHead(FreeBlock* Node){
 
     /* head and tail point to the same node */
     sint8 HeadAndTail = INVALID ;
-    if (ptrHead == ptrTail){
+    if (CurHeap->ptrHead == CurHeap->ptrTail){
         HeadAndTail = VALID ;
     } 
 
@@ -143,10 +144,10 @@ void   HeapExtras_FreeOperationBeforeHead(FreeBlock* Node){
      *         - Update the old head's previous free space to the new node.
      *         - Update the head to point to the new node.
      */
-    if (PositionOfFreeBlock < (sint8*)ptrHead ){
-        HeapUtils_SetFreeNodeInfo(Node,Node->BlockSize,NULL,ptrHead);
-        ptrHead->PreviousFreeBlock = Node ;
-        ptrHead = Node ;
+    if (PositionOfFreeBlock < (sint8*)CurHeap->ptrHead ){
+        HeapUtils_SetFreeNodeInfo(Node,Node->BlockSize,NULL,CurHeap->ptrHead);
+        CurHeap->ptrHead->PreviousFreeBlock = Node ;
+        CurHeap->ptrHead = Node ;
     }
     /*
      * Case 2: The block is just before the head and adjacent to it.
@@ -155,18 +156,18 @@ void   HeapExtras_FreeOperationBeforeHead(FreeBlock* Node){
      *         - Set the new head's previous free space to NULL.
      *         - Set the new head's next free space to the old head's next free space.
      */
-    else if (PositionOfFreeBlock == (sint8*)ptrHead ){
-        size_t sizeOfhead = ptrHead->BlockSize;
+    else if (PositionOfFreeBlock == (sint8*)CurHeap->ptrHead ){
+        size_t sizeOfhead = CurHeap->ptrHead->BlockSize;
         if (HeadAndTail == INVALID){
-            FreeBlock* nextNode = ptrHead->NextFreeBlock;
-            ptrHead = Node ;
-            HeapUtils_SetFreeNodeInfo(ptrHead, Node->BlockSize+sizeOfhead+(size_t)sizeof(size_t),NULL,nextNode);
-            nextNode->PreviousFreeBlock = ptrHead ;
+            FreeBlock* nextNode = CurHeap->ptrHead->NextFreeBlock;
+            CurHeap->ptrHead = Node ;
+            HeapUtils_SetFreeNodeInfo(CurHeap->ptrHead, Node->BlockSize+sizeOfhead+(size_t)sizeof(size_t),NULL,nextNode);
+            nextNode->PreviousFreeBlock = CurHeap->ptrHead ;
         }
         else {
-            ptrHead = Node ;
-            ptrTail = ptrHead ;
-            HeapUtils_SetFreeNodeInfo(ptrHead, Node->BlockSize+sizeOfhead+(size_t)sizeof(size_t),NULL,NULL);
+            CurHeap->ptrHead = Node ;
+            CurHeap->ptrTail = CurHeap->ptrHead ;
+            HeapUtils_SetFreeNodeInfo(CurHeap->ptrHead, Node->BlockSize+sizeOfhead+(size_t)sizeof(size_t),NULL,NULL);
         }
     }
     /*
@@ -189,7 +190,7 @@ void   HeapExtras_FreeOperationAfterTail(FreeBlock* Node){
     printf("Free after tail and node Size = %5ld\n",Node->BlockSize);
     getchar();
 #endif
-    sint8* PositionOfTailBlock = (sint8*)ptrTail + ptrTail->BlockSize + sizeof(size_t) ; // to check that the target free block is adjecent for tail or away from.
+    sint8* PositionOfTailBlock = (sint8*)CurHeap->ptrTail + CurHeap->ptrTail->BlockSize + sizeof(size_t) ; // to check that the target free block is adjecent for tail or away from.
 
     /* if ptr is pointing to tail before node node is away from
     *  that : 1- define new node
@@ -199,16 +200,16 @@ void   HeapExtras_FreeOperationAfterTail(FreeBlock* Node){
     *         5- update tail to point to index
     * */
     if (PositionOfTailBlock < (sint8*)Node ){
-        HeapUtils_SetFreeNodeInfo(Node,Node->BlockSize,ptrTail,NULL);
-        ptrTail->NextFreeBlock = Node;
-        ptrTail = Node ;
+        HeapUtils_SetFreeNodeInfo(Node,Node->BlockSize,CurHeap->ptrTail,NULL);
+        CurHeap->ptrTail->NextFreeBlock = Node;
+        CurHeap->ptrTail = Node ;
     }
      /* if ptr is pointing to node just after tail node and adjecent for it
      *  redefine new metdata for free space to be equal the margin of new free space and tail space
      * */
     else if (PositionOfTailBlock == (sint8*)Node){
-        size_t sizeOftail = ptrTail->BlockSize;
-        ptrTail->BlockSize = sizeOftail+(size_t)sizeof(size_t)+Node->BlockSize;
+        size_t sizeOftail = CurHeap->ptrTail->BlockSize;
+        CurHeap->ptrTail->BlockSize = sizeOftail+(size_t)sizeof(size_t)+Node->BlockSize;
     }
     else {
 #if DEBUGGING == ENABLE
@@ -219,7 +220,7 @@ void   HeapExtras_FreeOperationAfterTail(FreeBlock* Node){
     }
 
     TailBreakStatus();
-    Shrink_Break(TailBrkState);
+    Shrink_Break(CurHeap->TailBrkState);
 }
 
 
@@ -228,7 +229,7 @@ void   HeapExtras_FreeOperationMiddleNode(FreeBlock* Node){
     printf("Free in middle from free list and node Size = %5ld\n",Node->BlockSize);
     getchar();
 #endif
-    FreeBlock* nextNode = ptrHead ; // to store the next free slot after index
+    FreeBlock* nextNode = CurHeap->ptrHead ; // to store the next free slot after index
     FreeBlock* PreNode = NULL ;     // to store the previous free slot before index
     size_t size = Node->BlockSize ;
 
@@ -284,11 +285,11 @@ void   HeapExtras_FreeOperationMiddleNode(FreeBlock* Node){
         HeapUtils_SetFreeNodeInfo(PreNode,SizeOfPrev,PrevPrevNode,Node);
 
         /* update Tail to point on new update node */
-        if (nextNode == ptrTail){
+        if (nextNode == CurHeap->ptrTail){
 #if DEBUGGING == ENABLE
             printf("\n Free from left with Tail \n");
 #endif
-            ptrTail = Node ;
+            CurHeap->ptrTail = Node ;
         }
         else{
 #if DEBUGGING == ENABLE
@@ -306,11 +307,11 @@ void   HeapExtras_FreeOperationMiddleNode(FreeBlock* Node){
         HeapUtils_SetFreeNodeInfo(PreNode,NewSize,PrevPrevNode,NextNextNode);
 
         /* update Tail to point on new update node */
-        if (nextNode == ptrTail){
+        if (nextNode == CurHeap->ptrTail){
 #if DEBUGGING == ENABLE
             printf("\n Free between two free slots with Tail \n");
 #endif
-            ptrTail = PreNode ;
+            CurHeap->ptrTail = PreNode ;
         }
         else{
 #if DEBUGGING == ENABLE
@@ -353,15 +354,15 @@ void TailBreakStatus(){
     * - STATE1: Tail points to a node but not directly before the break pointer.
     * - STATE2: Tail points to a node and is directly before the break pointer.
     */
-    sint8* AdjecentNode = (sint8*)ptrTail + sizeof(size_t) + ptrTail->BlockSize ;
-    if (AdjecentNode == CurBreak){
-        TailBrkState = STATE2 ; // used to call Helper_sbrk if it is needed.
+    sint8* AdjecentNode = (sint8*)CurHeap->ptrTail + sizeof(size_t) + CurHeap->ptrTail->BlockSize ;
+    if (AdjecentNode == CurHeap->CurBreak){
+        CurHeap->TailBrkState = STATE2 ; // used to call Helper_sbrk if it is needed.
     } // rather that will be continue on state 1
     else {
 #if DEBUGGING == ENABLE
-        printf("AdjecentNode = %p and CurBreak = %p",AdjecentNode,CurBreak);
+        printf("AdjecentNode = %p and CurBreak = %p",AdjecentNode,CurHeap->CurBreak);
         getchar();
 #endif
-        TailBrkState = STATE1 ;
+        CurHeap->TailBrkState = STATE1 ;
     }
 }
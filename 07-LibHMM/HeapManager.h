@@ -68,6 +68,65 @@ void* HeapManager_Malloc(size_t size);
  */
 void HeapManager_Free(void* ptr);
 
+/*
+ * Name             : HeapManager_GetSize
+ * Description      : Returns the usable size of an allocated block.
+ * Input            : ptr - A pointer returned by one of the allocation functions.
+ * Output           : None
+ * Return           : The size of the block data in bytes, at least the requested size.
+ * Notes            : Works for blocks of any heap instance.
+ */
 size_t HeapManager_GetSize(void* ptr);
 
+/*
+ * Name             : Heap_Create
+ * Description      : Creates an independent heap instance over a memory region owned by the caller 
+ *                    (a static array, an mmap'ed area, shared memory, ...).
+ * Input            : region - Start of the memory region.
+ *                    size - Size of the memory region in bytes.
+ * Output           : None
+ * Return           : A handle of the new heap, or NULL if the region is too small.
+ * Notes            : The Heap structure is stored at the start of the region and the break of the 
+ *                    instance never crosses the end of the region. The region must be at least 
+ *                    sizeof(Heap) + BREAK_STEP_SIZE bytes long.
+ */
+Heap*  Heap_Create(void* region, size_t size);
+
+/*
+ * Name             : Heap_Alloc
+ * Description      : Allocates a block of memory from the given heap instance, using the same 
+ *                    strategies as HeapManager_Malloc.
+ * Input            : heap - Handle returned by Heap_Create.
+ *                    size - The size of the memory block to be allocated (in bytes).
+ * Output           : None
+ * Return           : A pointer to the allocated memory, or NULL if the heap region is exhausted.
+ * Notes            : Instances don't share any state, blocks of different heaps never interleave.
+ *                    Threads may work on different heaps at the same time, the heap the call works
+ *                    on is tracked per thread. A heap used by several threads needs a lock around
+ *                    its calls, as HeapShm does for processes.
+ */
+void*  Heap_Alloc(Heap* heap, size_t size);
+
+/*
+ * Name             : Heap_Free
+ * Description      : Frees a block previously allocated from the same heap instance.
+ * Input            : heap - Handle of the heap the block was allocated from.
+ *                    ptr - A pointer to the memory block that needs to be freed.
+ * Output           : None
+ * Return           : None
+ * Notes            : Freeing a block in another heap than its own corrupts both heaps.
+ */
+void   Heap_Free(Heap* heap, void* ptr);
+
+/*
+ * Name             : Heap_Destroy
+ * Description      : Discards a heap instance and all of its blocks at once.
+ * Input            : heap - Handle returned by Heap_Create.
+ * Output           : None
+ * Return           : None
+ * Notes            : No block is freed one by one, the region can be reused or unmapped by the caller 
+ *                    right after. The default heap can't be destroyed.
+ */
+void   Heap_Destroy(Heap* heap);
+
 #endif
@@ -33,9 +33,7 @@
 
 
 /*============================  extern Global Variable ==============================*/
-extern FreeBlock* ptrHead;
-extern FreeBlock* ptrTail;
-extern sint8* CurBreak;                         // break pointer on simulated heap
+extern _Thread_local Heap* CurHeap;                   // heap instance the operations of this thread work on
  
 /*=========================  Functions Implementation ===========================*/
 sint8* HeapUtils_AllocationCoreLoop(FreeBlock* ptrBlock,size_t ReqSize){
@@ -61,7 +59,22 @@ sint8* HeapUtils_AllocationCoreLoop(FreeBlock* ptrBlock,size_t ReqSize){
 
 
 sint8* HeapUtils_sbrk(size_t size) {
-    sint8* oldBreak = (sint8*)sbrk(0);  // Get the current break value
+    sint8* oldBreak = CurHeap->CurBreak ;
+
+    /* heap over a region given to Heap_Create, the break moves inside the region only */
+    if (CurHeap->RegionEnd != NULL) {
+        sint8* result = CurHeap->CurBreak + size ;
+        if (result < CurHeap->RegionStart || result > CurHeap->RegionEnd) {
+#if DEBUGGING == ENABLE
+            printf("break of %zu bytes is out of heap region\n", size);
+#endif
+            return NULL;
+        }
+        CurHeap->CurBreak = result ;
+        return oldBreak;
+    }
+
+    oldBreak = (sint8*)sbrk(0);  // Get the current break value
     sint8* newBreak = (sint8*)sbrk(size);  // Attempt to increase the program break
 
     if (newBreak == (sint8*)-1) {
@@ -71,7 +84,8 @@ sint8* HeapUtils_sbrk(size_t size) {
 #endif
         return NULL;
     }
-    
+
+    CurHeap->CurBreak = oldBreak + size ;
     return oldBreak;  // Return the old break, which is the start of the newly allocated memory
 }
 
@@ -91,8 +105,7 @@ sint8* HeapUtils_sbrkResize(size_t ReqSize,sint8 flag){
 #if DEBUGGING == ENABLE 
             printf("Invalid state from Helper_sbrk function\n");
 #endif
-            while(1);///////////////////////////// for testing
-            exit(INVALID);
+            return NULL ;
         }
 
         /* 
@@ -106,19 +119,19 @@ sint8* HeapUtils_sbrkResize(size_t ReqSize,sint8 flag){
             *        3. new tail -> next free space point to !
             *        4. remove old tail node 
             */
-           ptrTail->NextFreeBlock = New ;
-           New->PreviousFreeBlock = ptrTail ;
-           ptrTail = New ;
+           HeapUtils_SetFreeNodeInfo(New,BREAK_STEP_SIZE-sizeof(size_t),CurHeap->ptrTail,NULL);
+           CurHeap->ptrTail->NextFreeBlock = New ;
+           CurHeap->ptrTail = New ;
         }
         else if (flag == STATE2){
             /*
             * Extend current break pointer and resize heap
             * still head and tail point to the same node but with new size
             * */
-            ptrTail->BlockSize += BREAK_STEP_SIZE;
+            CurHeap->ptrTail->BlockSize += BREAK_STEP_SIZE;
         } // else continue in loop
         flag = STATE2 ;
-        RetDataPtr = HeapUtils_AllocationCoreLoop(ptrTail, ReqSize);
+        RetDataPtr = HeapUtils_AllocationCoreLoop(CurHeap->ptrTail, ReqSize);
     }
 
     return RetDataPtr ;
@@ -131,7 +144,7 @@ sint8* HeapUtils_SplitFreeBlock (FreeBlock* Node, size_t spliting_size){
 
     /* head and tail point to the same node */
     sint8 HeadAndTail = INVALID ;
-    if (ptrHead == ptrTail){
+    if (CurHeap->ptrHead == CurHeap->ptrTail){
         HeadAndTail = VALID ;
     } 
 
@@ -141,7 +154,7 @@ sint8* HeapUtils_SplitFreeBlock (FreeBlock* Node, size_t spliting_size){
     *        2. next free space pointer will redefine in array but still point to the same cell
     *        3. metadata will redefine in array and store remaining size of free space
     */
-   if (Node == ptrHead){
+   if (Node == CurHeap->ptrHead){
 #if DEBUGGING == ENABLE
         printf("Free Size from Head = %5ld\nRequired Size from user = %5ld\n",Node->BlockSize,spliting_size);
         getchar();
@@ -158,14 +171,14 @@ sint8* HeapUtils_SplitFreeBlock (FreeBlock* Node, size_t spliting_size){
         
         /* to shift tail with first group calls for maollac*/
         if (HeadAndTail == INVALID){
-            ptrHead = (FreeBlock*) ((sint8*)ptrHead + spliting_size + sizeof(size_t));
-            HeapUtils_SetFreeNodeInfo(ptrHead, (SizeOfFreeSpace-spliting_size-sizeof(size_t)), NULL,NextNode);
-            NextNode->PreviousFreeBlock = ptrHead ;
+            CurHeap->ptrHead = (FreeBlock*) ((sint8*)CurHeap->ptrHead + spliting_size + sizeof(size_t));
+            HeapUtils_SetFreeNodeInfo(CurHeap->ptrHead, (SizeOfFreeSpace-spliting_size-sizeof(size_t)), NULL,NextNode);
+            NextNode->PreviousFreeBlock = CurHeap->ptrHead ;
         }
         else if (HeadAndTail == VALID){
-            ptrHead = (FreeBlock*) ((sint8*)ptrHead + spliting_size + sizeof(size_t)) ;
-            ptrTail = ptrHead ;
-            HeapUtils_SetFreeNodeInfo(ptrHead,(SizeOfFreeSpace-spliting_size-sizeof(size_t)), NULL,NULL);
+            CurHeap->ptrHead = (FreeBlock*) ((sint8*)CurHeap->ptrHead + spliting_size + sizeof(size_t)) ;
+            CurHeap->ptrTail = CurHeap->ptrHead ;
+            HeapUtils_SetFreeNodeInfo(CurHeap->ptrHead,(SizeOfFreeSpace-spliting_size-sizeof(size_t)), NULL,NULL);
         }
    }
     /* handle simulated array if tail is suitable to allocate this size
@@ -173,11 +186,11 @@ sint8* HeapUtils_SplitFreeBlock (FreeBlock* Node, size_t spliting_size){
     *        2. next free space pointer will redefine in array and store ! in this cell
     *        3. metadata will redefine in array and store remaining size of free space
     */
-   else if (Node == ptrTail){
+   else if (Node == CurHeap->ptrTail){
         FreeBlock* PreNode = Node->PreviousFreeBlock;
-        ptrTail = (FreeBlock*) ((sint8*)Node + spliting_size + sizeof(size_t));
-        HeapUtils_SetFreeNodeInfo(ptrTail,(SizeOfFreeSpace-spliting_size-sizeof(size_t)),PreNode,NULL); 
-        PreNode->NextFreeBlock = ptrTail ;
+        CurHeap->ptrTail = (FreeBlock*) ((sint8*)Node + spliting_size + sizeof(size_t));
+        HeapUtils_SetFreeNodeInfo(CurHeap->ptrTail,(SizeOfFreeSpace-spliting_size-sizeof(size_t)),PreNode,NULL); 
+        PreNode->NextFreeBlock = CurHeap->ptrTail ;
    }
     /* handle simulated array if neither head or tail is suitable to allocate this size
     *  that: 1. previous free space pointer will redefine in array but still point to the same cell
@@ -219,7 +232,7 @@ sint8* HeapUtils_RemoveFreeBlock (FreeBlock* Node, size_t spliting_size){
     
     /* head and tail point to the same node */
     sint8 HeadAndTail = INVALID ;
-    if (ptrHead == ptrTail){
+    if (CurHeap->ptrHead == CurHeap->ptrTail){
         HeadAndTail = VALID ;
     } 
 
@@ -229,7 +242,7 @@ sint8* HeapUtils_RemoveFreeBlock (FreeBlock* Node, size_t spliting_size){
     *  that  1. shift head node to next node
     *        2. make next node -> previous free space equals !
     */
-   if (Node == ptrHead){
+   if (Node == CurHeap->ptrHead){
 #if DEBUGGING == ENABLE
         printf("Free Size from Head = %5ld\nRequired Size from user = %5ld\n",Node->BlockSize,spliting_size);
         getchar();
@@ -240,8 +253,8 @@ sint8* HeapUtils_RemoveFreeBlock (FreeBlock* Node, size_t spliting_size){
         * */
         /* to shift tail with first group calls for maollac*/
         if (HeadAndTail == INVALID){
-            ptrHead = ptrHead->NextFreeBlock ;
-            ptrHead->PreviousFreeBlock = NULL ;
+            CurHeap->ptrHead = CurHeap->ptrHead->NextFreeBlock ;
+            CurHeap->ptrHead->PreviousFreeBlock = NULL ;
         }
         else if (HeadAndTail == VALID ){
             FreeBlock* New = (FreeBlock*)HeapUtils_sbrk(BREAK_STEP_SIZE); 
@@ -249,23 +262,22 @@ sint8* HeapUtils_RemoveFreeBlock (FreeBlock* Node, size_t spliting_size){
 #if DEBUGGING == ENABLE 
                 printf("Invalid state from Helper_sbrk function\n");
 #endif
-                while(1);///////////////////////////// for testing
-                exit(INVALID);
+                return NULL ;
             }
 
             HeapUtils_SetFreeNodeInfo(New,BREAK_STEP_SIZE-sizeof(size_t),NULL,NULL);
-            ptrTail = New ;
-            ptrHead = New ;
+            CurHeap->ptrTail = New ;
+            CurHeap->ptrHead = New ;
         }
    }
     /* handle simulated array if tail is suitable to allocate this size
     *  that: 1. backword tail index to previous free slot 
     *        2. backword tail -> next free space point to !
     * */
-   else if (Node == ptrTail){
-        FreeBlock* Backwork_Tail = ptrTail->PreviousFreeBlock ; 
-        ptrTail = Backwork_Tail ;
-        ptrTail->NextFreeBlock = NULL ;
+   else if (Node == CurHeap->ptrTail){
+        FreeBlock* Backwork_Tail = CurHeap->ptrTail->PreviousFreeBlock ; 
+        CurHeap->ptrTail = Backwork_Tail ;
+        CurHeap->ptrTail->NextFreeBlock = NULL ;
    }
     /* handle simulated array if neither head or tail is suitable to allocate this size
     *  that: 1. make next node -> previous free space index point to temp -> previous free space
@@ -299,7 +311,7 @@ sint8* HeapUtils_RemoveFreeBlock (FreeBlock* Node, size_t spliting_size){
 
 
 sint8 HeapUtils_SearchOnIndexInFreeList(FreeBlock* block){
-    FreeBlock* ptr = ptrHead ;
+    FreeBlock* ptr = CurHeap->ptrHead ;
     while( ptr != NULL ){ // while its next node is not jump over break
         if (block == ptr ){
             return VALID ;
@@ -321,22 +333,18 @@ void   HeapUtils_SetFreeNodeInfo(FreeBlock* Node, size_t metadata, FreeBlock* pr
 
 void Shrink_Break(sint8 flag){
     if (flag == STATE2){
-        size_t Tail_Size = ptrTail->BlockSize ;
+        size_t Tail_Size = CurHeap->ptrTail->BlockSize ;
 
         while (Tail_Size > BREAK_STEP_SIZE){
-            void* new_break = sbrk(BREAK_STEP_SIZE);
-
-            // Check if sbrk() was successful
-            if (new_break == (void*)-1) {
-                // sbrk() failed, handle the error
+            /* give the last step back, HeapUtils_sbrk updates the heap break */
+            if (HeapUtils_sbrk(-BREAK_STEP_SIZE) == NULL) {
                 perror("sbrk");
-                while(1);
+                return ;
             }
 
-            /*update heap break*/
-            CurBreak -= BREAK_STEP_SIZE ; 
-            ptrTail->BlockSize -= BREAK_STEP_SIZE ; 
-            Tail_Size = ptrTail->BlockSize ;
+
+            CurHeap->ptrTail->BlockSize -= BREAK_STEP_SIZE ; 
+            Tail_Size = CurHeap->ptrTail->BlockSize ;
         }
     }
 }
\ No newline at end of file
@@ -31,6 +31,7 @@
 #include <stdlib.h>         // Standard library functions: memory management, program utilities, etc.
 #include <string.h>         // String manipulation functions
 #include <unistd.h>
+#include <stdint.h>
 
 /*==================================  Definitions ===========================*/
 #define ONE_K                                   1024
@@ -71,6 +72,21 @@ typedef struct FreeBlock {
     struct FreeBlock* PreviousFreeBlock;
 } FreeBlock;
 
+/*
+ * State of one heap instance. The default heap grows the program break with sbrk, other 
+ * instances run over a memory region given to Heap_Create and keep this structure at the 
+ * start of the region.
+ */
+typedef struct Heap {
+    FreeBlock* ptrHead;                             // first node of the free list
+    FreeBlock* ptrTail;                             // last node of the free list
+    sint8*     CurBreak;                            // break pointer of the heap
+    sint8*     RegionStart;                         // first byte available for blocks
+    sint8*     RegionEnd;                           // limit that the break can't cross, NULL for sbrk
+    sint8      TailBrkState;                        // relation between the tail and the break
+    uint8      InitFlag;                            // ON until the first allocation initializes the heap
+} Heap;
+
 /*==============================  Functions Prototypes   ==========================*/
 /*
  * Name             : HeapUtils_AllocationCoreLoop
@@ -95,8 +111,8 @@ sint8* HeapUtils_AllocationCoreLoop(FreeBlock* ptrBlock,size_t size);
  * Input            : size_t size - The amount of memory to extend the program's data space.
  * Output           : None.
  * Return           : sint8* - A pointer to the previous program break or NULL if the requested size is invalid.
- * Notes            : The function checks if the requested size would cause the program break to exceed 
- *                    the simulated heap's boundaries, returning NULL if the request is invalid.
+ * Notes            : The default heap moves the program break with sbrk, a heap created over a region 
+ *                    returns NULL if the new break would leave the region.
  */
 sint8* HeapUtils_sbrk (size_t size);
 
@@ -111,8 +127,9 @@ sint8* HeapUtils_sbrk (size_t size);
  * Output           : None.
  * Return           : sint8* - A pointer to the allocated memory or NULL if allocation fails.
  * Notes            : The function loops until memory is successfully allocated, extending the heap 
- *                    as necessary. It handles cases where no suitable free space exists, creating 
- *                    or resizing blocks based on the provided flag.
+ *                    as necessary, or returns NULL once the heap can't grow anymore. It handles cases 
+ *                    where no suitable free space exists, creating or resizing blocks based on the 
+ *                    provided flag.
  */
 sint8* HeapUtils_sbrkResize(size_t ReqSize,sint8 flag);
 
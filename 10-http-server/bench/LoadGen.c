@@ -0,0 +1,545 @@
+/*
+ * File Name        : LoadGen.c
+ * Description      : HTTP load generator measuring the throughput and latency of HttpServer.
+ * Functions        :
+ *                    - main: Parses the options, runs the client threads and prints the report.
+ *                    - RunThread: Drives the connections of one thread with epoll.
+ *                    - SendRequest/ReadResponse: One request at a time per connection, keep-alive or not.
+ *                    - Record/Percentile: Latency histogram with a bounded relative error (HDR style).
+ * Notes            : Closed loop (default): every connection sends its next request as soon as the
+ *                    previous response arrived. Open loop (-r): requests are scheduled at a fixed total
+ *                    rate and latency is measured from the scheduled time, so a stalled server isn't
+ *                    hidden by the client waiting for it (coordinated omission).
+ *                    Usage: LoadGen [-H host] [-p port] [-c connections] [-t threads] [-d seconds]
+ *                                   [-r requests/s] [-x] -u path [-u path ...]
+ */
+
+/*===================================  Includes ==============================*/
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/*==================================  Definations =============================*/
+#define MAX_PATHS 64
+#define MAX_THREADS 64
+#define HEADER_BUF 8192
+
+// histogram: exact below 128 us, then 64 sub-buckets per power of two (< 1.6% error)
+#define SUB_BUCKETS 64
+#define BUCKETS (2 * SUB_BUCKETS + 40 * SUB_BUCKETS)
+
+/*==================================  Structures =============================*/
+typedef struct Client
+{
+    int Fd;
+    int Connected;
+    const char *Request; // request being sent
+    size_t RequestLength;
+    size_t Sent;
+    char Header[HEADER_BUF]; // response head received so far
+    size_t HeaderLength;
+    long long BodyLeft;  // body bytes still expected once the head is complete, -1 before
+    int Close;           // the server closes after this response
+    int Busy;            // a request is in flight
+    long long Start;     // time the request was sent, or scheduled in open loop (us)
+} Client;
+
+typedef struct Thread
+{
+    pthread_t Id;
+    int Index;
+    int Connections;
+    Client *Clients;
+    unsigned long long Completed;
+    unsigned long long Errors;
+    unsigned long long Bytes;
+    unsigned long long Histogram[BUCKETS];
+    unsigned int Seed;
+} Thread;
+
+/*============================  Static Variables ==============================*/
+static struct sockaddr_in Address;
+static char *Requests[MAX_PATHS];
+static size_t RequestLengths[MAX_PATHS];
+static int PathCount;
+static int KeepAlive = 1;
+static double Rate;        // total requests per second, 0 for closed loop
+static long long Interval; // open loop: time between two requests of a connection (us)
+static long long EndTime;
+
+/*============================  Function Implementation =======================*/
+static long long NowUs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+static int BucketOf(long long value)
+{
+    if (value < 2 * SUB_BUCKETS)
+    {
+        return (value < 0) ? 0 : (int)value;
+    }
+
+    // value >> shift lands in [SUB_BUCKETS, 2 * SUB_BUCKETS)
+    int shift = 63 - __builtin_clzll((unsigned long long)value) - 6;
+    int index = 2 * SUB_BUCKETS + (shift - 1) * SUB_BUCKETS + (int)((value >> shift) - SUB_BUCKETS);
+    return (index < BUCKETS) ? index : BUCKETS - 1;
+}
+
+static long long ValueOf(int bucket)
+{
+    if (bucket < 2 * SUB_BUCKETS)
+    {
+        return bucket;
+    }
+    int shift = (bucket - 2 * SUB_BUCKETS) / SUB_BUCKETS + 1;
+    long long sub = (bucket - 2 * SUB_BUCKETS) % SUB_BUCKETS + SUB_BUCKETS;
+    return ((sub + 1) << shift) - 1; // highest value of the bucket
+}
+
+static void Record(Thread *thread, long long latency)
+{
+    thread->Histogram[BucketOf(latency)]++;
+}
+
+static long long Percentile(const unsigned long long *histogram, unsigned long long total, double percent)
+{
+    unsigned long long rank = (unsigned long long)(total * percent / 100.0);
+    unsigned long long seen = 0;
+
+    for (int i = 0; i < BUCKETS; ++i)
+    {
+        seen += histogram[i];
+        if (seen > rank || (seen == total && histogram[i] > 0))
+        {
+            return ValueOf(i);
+        }
+    }
+    return 0;
+}
+
+static void CloseClient(int epfd, Client *client)
+{
+    if (client->Fd >= 0)
+    {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, client->Fd, NULL);
+        close(client->Fd);
+    }
+    client->Fd = -1;
+    client->Connected = 0;
+}
+
+static int Connect(int epfd, Client *client)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int option = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+
+    if (connect(fd, (struct sockaddr *)&Address, sizeof(Address)) < 0 && errno != EINPROGRESS)
+    {
+        close(fd);
+        return -1;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    ev.data.ptr = client;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+    client->Fd = fd;
+    client->Connected = 1;
+    return 0;
+}
+
+static void SendRequest(Thread *thread, int epfd, Client *client, long long start)
+{
+    int path = rand_r(&thread->Seed) % PathCount;
+
+    client->Request = Requests[path];
+    client->RequestLength = RequestLengths[path];
+    client->Sent = 0;
+    client->HeaderLength = 0;
+    client->BodyLeft = -1;
+    client->Close = !KeepAlive;
+    client->Busy = 1;
+    client->Start = start;
+
+    if (!client->Connected && Connect(epfd, client) == -1)
+    {
+        thread->Errors++;
+        client->Busy = 0;
+    }
+}
+
+static int Flush(Client *client)
+{
+    while (client->Sent < client->RequestLength)
+    {
+        ssize_t bytes = send(client->Fd, client->Request + client->Sent, client->RequestLength - client->Sent,
+                             MSG_NOSIGNAL);
+        if (bytes < 0)
+        {
+            return (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOTCONN) ? 0 : -1;
+        }
+        client->Sent += bytes;
+    }
+    return 0;
+}
+
+static void ParseHead(Thread *thread, Client *client, size_t headLength, size_t bodyReceived)
+{
+    // status line, Content-Length and Connection are all the client needs
+    int status = atoi(client->Header + 9);
+    if (status < 200 || status >= 400)
+    {
+        thread->Errors++;
+    }
+
+    client->BodyLeft = 0;
+    for (char *line = strstr(client->Header, "\r\n"); line != NULL && line < client->Header + headLength;
+         line = strstr(line + 2, "\r\n"))
+    {
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0)
+        {
+            client->BodyLeft = atoll(line + 17);
+        }
+        else if (strncasecmp(line + 2, "Connection: close", 17) == 0)
+        {
+            client->Close = 1;
+        }
+    }
+
+    // body bytes that came with the head
+    client->BodyLeft -= bodyReceived;
+}
+
+static int ReadResponse(Thread *thread, Client *client)
+{
+    char buffer[64 * 1024];
+
+    for (;;)
+    {
+        ssize_t bytes = recv(client->Fd, buffer, sizeof(buffer), 0);
+        if (bytes < 0)
+        {
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        if (bytes == 0)
+        {
+            return -1;
+        }
+        thread->Bytes += bytes;
+
+        if (client->BodyLeft < 0)
+        {
+            // still in the head: keep it until the empty line
+            size_t copy = bytes;
+            if (copy > HEADER_BUF - 1 - client->HeaderLength)
+            {
+                copy = HEADER_BUF - 1 - client->HeaderLength;
+            }
+            memcpy(client->Header + client->HeaderLength, buffer, copy);
+            size_t previous = client->HeaderLength;
+            client->HeaderLength += copy;
+            client->Header[client->HeaderLength] = '\0';
+
+            char *end = strstr(client->Header, "\r\n\r\n");
+            if (end == NULL)
+            {
+                if (client->HeaderLength == HEADER_BUF - 1)
+                {
+                    return -1;
+                }
+                continue;
+            }
+            size_t headLength = end + 4 - client->Header;
+            ParseHead(thread, client, headLength, previous + bytes - headLength);
+        }
+        else
+        {
+            client->BodyLeft -= bytes;
+        }
+
+        if (client->BodyLeft <= 0)
+        {
+            return 1; // complete, one request per connection at a time so nothing follows
+        }
+    }
+}
+
+static void *RunThread(void *argument)
+{
+    Thread *thread = argument;
+    struct epoll_event events[256];
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    long long now = NowUs();
+    for (int i = 0; i < thread->Connections; ++i)
+    {
+        Client *client = &thread->Clients[i];
+        client->Fd = -1;
+        if (Rate > 0)
+        {
+            // open loop: the first requests are spread over one interval
+            client->Start = now + Interval * i / thread->Connections;
+        }
+        else
+        {
+            SendRequest(thread, epfd, client, now);
+        }
+    }
+
+    while ((now = NowUs()) < EndTime)
+    {
+        // open loop: send the requests that are due, find when the next one is
+        long long wait = EndTime - now;
+        if (Rate > 0)
+        {
+            for (int i = 0; i < thread->Connections; ++i)
+            {
+                Client *client = &thread->Clients[i];
+                if (client->Busy)
+                {
+                    continue;
+                }
+                if (client->Start <= now)
+                {
+                    SendRequest(thread, epfd, client, client->Start);
+                    if (client->Busy && Flush(client) == -1)
+                    {
+                        thread->Errors++;
+                        CloseClient(epfd, client);
+                        client->Busy = 0;
+                    }
+                }
+                else if (client->Start - now < wait)
+                {
+                    wait = client->Start - now;
+                }
+            }
+        }
+
+        int ready = epoll_wait(epfd, events, 256, (int)(wait / 1000) + 1);
+        for (int i = 0; i < ready; ++i)
+        {
+            Client *client = events[i].data.ptr;
+            if (!client->Busy)
+            {
+                continue;
+            }
+
+            int done = 0;
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN))
+            {
+                done = -1;
+            }
+            if (done == 0 && (events[i].events & EPOLLOUT) && Flush(client) == -1)
+            {
+                done = -1;
+            }
+            if (done == 0 && (events[i].events & EPOLLIN))
+            {
+                done = ReadResponse(thread, client);
+            }
+            if (done == 0)
+            {
+                continue;
+            }
+
+            long long finished = NowUs();
+            client->Busy = 0;
+            if (done < 0)
+            {
+                thread->Errors++;
+                CloseClient(epfd, client);
+            }
+            else
+            {
+                thread->Completed++;
+                Record(thread, finished - client->Start);
+                if (client->Close)
+                {
+                    CloseClient(epfd, client);
+                }
+            }
+
+            // closed loop: next request right away, open loop: at the next scheduled time
+            if (Rate > 0)
+            {
+                client->Start += Interval;
+            }
+            else if (finished < EndTime)
+            {
+                SendRequest(thread, epfd, client, finished);
+                if (client->Busy && client->Connected && Flush(client) == -1)
+                {
+                    thread->Errors++;
+                    CloseClient(epfd, client);
+                    client->Busy = 0;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < thread->Connections; ++i)
+    {
+        CloseClient(epfd, &thread->Clients[i]);
+    }
+    close(epfd);
+    return NULL;
+}
+
+static void Usage(const char *name)
+{
+    fprintf(stderr,
+            "Usage: %s [-H host] [-p port] [-c connections] [-t threads] [-d seconds] [-r requests/s] [-x]\n"
+            "          -u path [-u path ...]\n"
+            "  -r  open loop at this total rate (default: closed loop)\n"
+            "  -x  one connection per request (default: keep-alive)\n"
+            "  -u  request path, picked at random for every request when repeated\n",
+            name);
+    exit(EXIT_FAILURE);
+}
+
+/*==================================  Core Main ==============================*/
+int main(int argc, char **argv)
+{
+    const char *host = "127.0.0.1";
+    int port = 8080;
+    int connections = 64;
+    int threads = 1;
+    int seconds = 10;
+    const char *paths[MAX_PATHS];
+    int option;
+
+    while ((option = getopt(argc, argv, "H:p:c:t:d:r:xu:")) != -1)
+    {
+        switch (option)
+        {
+        case 'H':
+            host = optarg;
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'c':
+            connections = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atoi(optarg);
+            break;
+        case 'r':
+            Rate = atof(optarg);
+            break;
+        case 'x':
+            KeepAlive = 0;
+            break;
+        case 'u':
+            if (PathCount < MAX_PATHS)
+            {
+                paths[PathCount++] = optarg;
+            }
+            break;
+        default:
+            Usage(argv[0]);
+        }
+    }
+    if (PathCount == 0 || connections < 1 || threads < 1 || threads > MAX_THREADS || seconds < 1)
+    {
+        Usage(argv[0]);
+    }
+    if (threads > connections)
+    {
+        threads = connections;
+    }
+
+    Address.sin_family = AF_INET;
+    Address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &Address.sin_addr) != 1)
+    {
+        fprintf(stderr, "Invalid IPv4 address %s\n", host);
+        exit(EXIT_FAILURE);
+    }
+
+    // the requests are formatted once
+    for (int i = 0; i < PathCount; ++i)
+    {
+        char request[1024];
+        int length = snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: %s\r\n%s\r\n", paths[i], host,
+                              KeepAlive ? "" : "Connection: close\r\n");
+        Requests[i] = strdup(request);
+        RequestLengths[i] = length;
+    }
+    if (Rate > 0)
+    {
+        Interval = (long long)(1000000.0 * connections / Rate);
+    }
+
+    printf("%d connections, %d threads, %d s, %s, %s\n", connections, threads, seconds,
+           KeepAlive ? "keep-alive" : "connection per request",
+           Rate > 0 ? "open loop" : "closed loop");
+
+    Thread *pool = calloc(threads, sizeof(Thread));
+    Client *clients = calloc(connections, sizeof(Client));
+    long long start = NowUs();
+    EndTime = start + seconds * 1000000LL;
+    for (int i = 0, first = 0; i < threads; ++i)
+    {
+        pool[i].Index = i;
+        pool[i].Connections = connections / threads + (i < connections % threads);
+        pool[i].Clients = clients + first;
+        pool[i].Seed = 12345 + i;
+        first += pool[i].Connections;
+        pthread_create(&pool[i].Id, NULL, RunThread, &pool[i]);
+    }
+
+    // merge the per thread counters
+    static unsigned long long histogram[BUCKETS];
+    unsigned long long completed = 0, errors = 0, bytes = 0;
+    for (int i = 0; i < threads; ++i)
+    {
+        pthread_join(pool[i].Id, NULL);
+        completed += pool[i].Completed;
+        errors += pool[i].Errors;
+        bytes += pool[i].Bytes;
+        for (int j = 0; j < BUCKETS; ++j)
+        {
+            histogram[j] += pool[i].Histogram[j];
+        }
+    }
+    double elapsed = (NowUs() - start) / 1000000.0;
+
+    printf("requests   %llu in %.2f s, %llu errors\n", completed, elapsed, errors);
+    printf("throughput %.0f requests/s, %.2f MB/s\n", completed / elapsed, bytes / elapsed / (1024 * 1024));
+    if (completed > 0)
+    {
+        printf("latency    p50 %lld us, p90 %lld us, p99 %lld us, p99.9 %lld us, max %lld us\n",
+               Percentile(histogram, completed, 50), Percentile(histogram, completed, 90),
+               Percentile(histogram, completed, 99), Percentile(histogram, completed, 99.9),
+               Percentile(histogram, completed, 100));
+    }
+
+    free(clients);
+    free(pool);
+    return (errors > 0) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,24 @@
+#!/bin/bash
+# Benchmarks every server mode on localhost with LoadGen.
+# Usage: bench/run.sh [port] [LoadGen options...]
+# Default: 64 keep-alive connections, 2 threads, 10 s, closed loop, on a small file of the tree.
+
+cd "$(dirname "$0")/.." || exit 1
+make -s || exit 1
+
+PORT=${1:-8090}
+shift
+OPTIONS=${*:-"-c 64 -t 2 -d 10 -u $PWD/Readme.md"}
+
+for MODE in epoll uring fork workers; do
+    ./HttpServer "$PORT" "$MODE" > /dev/null 2>&1 &
+    SERVER=$!
+    sleep 0.5
+
+    echo "=== $MODE"
+    # shellcheck disable=SC2086
+    ./LoadGen -p "$PORT" $OPTIONS
+
+    kill "$SERVER"
+    wait "$SERVER" 2> /dev/null
+done
@@ -0,0 +1,256 @@
+/*
+ * File Name        : EventLoop.c
+ * Description      : Implements the event driven mode of the server with an edge-triggered epoll loop.
+ * Functions        :
+ *                    - RunEventLoop: Waits for events and dispatches them to the listener or the connections.
+ *                    - AcceptConnections: Accepts every pending connection and registers it in epoll.
+ *                    - CloseConnection: Releases a finished, failed or timed out connection.
+ *                    - ArmTimeout: Moves the connection timer when its timeout phase changes or it progresses.
+ *                    - RunConnection: Runs the state machine of a connection after an event or its CGI answer.
+ *                    - WatchWorker: CgiPool hook registering the socket of a CGI worker.
+ * Notes            : The listening socket is registered with a NULL pointer, connections with their
+ *                    Connection structure and CGI worker sockets with their CgiWorker tagged by
+ *                    EVENT_WORKER, so an event finds its connection or worker without any lookup.
+ *                    A worker event moves its exchanges on (CgiPool.h), the connections whose call
+ *                    ended are run at the end of the iteration; a worker that doesn't answer within
+ *                    cgi_timeout_ms gets the connection timer, the request is answered 504.
+ *                    Every connection has a timer in a timing wheel (TimerWheel.h), re-armed in O(1)
+ *                    after its events, so a client that stops sending or reading is closed after the
+ *                    timeout of what it was doing whatever the number of connections.
+ *                    On SIGQUIT (Lifecycle.h) the loop stops accepting and returns SUCESS once its
+ *                    connections are done, idle keep-alive ones end with their idle timeout.
+ */
+
+/*===================================  Includes ==============================*/
+#include "EventLoop.h"
+
+/*==================================  Definations =============================*/
+#define EVENT_WORKER 1 // low bit of the epoll data of a CGI worker socket, connections are aligned
+
+/*============================  Static Variables ==============================*/
+static TimerWheel Wheel; // timeouts of the open connections
+static int Epfd = -1;    // epoll set of the loop, for WatchWorker and CloseConnection
+
+/*============================  Function Implementation =======================*/
+static void CloseConnection(Connection *conn)
+{
+    // closing the socket isn't enough: a CGI worker forked and not executed yet still holds it, and
+    // the epoll set would report it after the connection is freed
+    TimerWheel_Disarm(&Wheel, &conn->Timeout);
+    epoll_ctl(Epfd, EPOLL_CTL_DEL, conn->Fd, NULL);
+    FreeConnection(conn);
+}
+
+static void ArmTimeout(Connection *conn)
+{
+    int timeout = UpdateTimeout(conn);
+    if (timeout > 0)
+    {
+        TimerWheel_Arm(&Wheel, &conn->Timeout, timeout);
+    }
+}
+
+static void RunConnection(Connection *conn)
+{
+    // a half closed peer may still wait for the response, the read returns 0 then
+    if (Handle_Requests(conn) == CONN_CLOSED)
+    {
+        CloseConnection(conn);
+        return;
+    }
+    ArmTimeout(conn);
+}
+
+static void ExpireConnection(Timer *timer)
+{
+    Connection *conn = (Connection *)((char *)timer - offsetof(Connection, Timeout));
+
+    // the CGI worker is too late, the request gets a 504 and the connection goes on
+    if (conn->State == CONN_WAITING)
+    {
+        CgiPool_Release(&conn->Cgi, 504);
+        RunConnection(conn);
+        return;
+    }
+    CloseConnection(conn);
+}
+
+static void WatchWorker(CgiWorker *worker, int events)
+{
+    struct epoll_event ev;
+
+    // registered once for both directions and edge-triggered, like the connections, and kept while the
+    // worker is idle so its exit is seen
+    if (events == 0)
+    {
+        if (worker->Watched)
+        {
+            epoll_ctl(Epfd, EPOLL_CTL_DEL, worker->Fd, NULL);
+            worker->Watched = 0;
+        }
+        return;
+    }
+    if (!worker->Watched)
+    {
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = (char *)worker + EVENT_WORKER;
+        if (epoll_ctl(Epfd, EPOLL_CTL_ADD, worker->Fd, &ev) == FALSE)
+        {
+            perror("epoll_ctl");
+            return;
+        }
+        worker->Watched = 1;
+    }
+}
+
+static void ResumeConnections(void)
+{
+    // the connections whose CGI call ended, in the order the calls ended
+    CgiCall *call;
+    while ((call = CgiPool_Next()) != NULL)
+    {
+        RunConnection((Connection *)((char *)call - offsetof(Connection, Cgi)));
+    }
+}
+
+static void AcceptConnections(int epfd, int server_fd)
+{
+    // edge-triggered: accept until the queue is empty or we miss connections
+    for (;;)
+    {
+        struct sockaddr_in peer;
+        socklen_t peerLength = sizeof(peer);
+        int client_fd = accept4(server_fd, (struct sockaddr *)&peer, &peerLength, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_fd == FALSE)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                printf("SERVER: accept failed (%s)\n", strerror(errno));
+            }
+            return;
+        }
+
+        Connection *conn = NewConnection(client_fd);
+        if (conn == NULL)
+        {
+            close(client_fd);
+            continue;
+        }
+        conn->Peer = peer;
+        SetClientSocket(client_fd);
+        ArmTimeout(conn);
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, client_fd, &ev) == FALSE)
+        {
+            perror("epoll_ctl");
+            CloseConnection(conn);
+        }
+    }
+}
+
+int RunEventLoop(int server_fd)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    if (SetNonBlocking(server_fd) == FALSE)
+    {
+        return FALSE;
+    }
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd == FALSE)
+    {
+        perror("epoll_create1");
+        return FALSE;
+    }
+
+    TimerWheel_Init(&Wheel);
+    AccessLog_Start();
+    Epfd = epfd;
+    CgiPool_SetWatch(WatchWorker);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL; // the listener
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, server_fd, &ev) == FALSE)
+    {
+        perror("epoll_ctl");
+        close(epfd);
+        return FALSE;
+    }
+
+    long long drainEnd = 0; // deadline of the connections once the process drains
+    int ret = FALSE;
+    for (;;)
+    {
+        if (Lifecycle_Poll(server_fd) && drainEnd == 0)
+        {
+            // the listening socket lives on in the process that replaces this one
+            epoll_ctl(epfd, EPOLL_CTL_DEL, server_fd, NULL);
+            close(server_fd);
+            StopKeepAlive();
+            drainEnd = TimerWheel_Clock() + DRAIN_TIMEOUT * 1000LL;
+            printf("Draining %zu connections (pid %d)\n", OpenConnections(), (int)getpid());
+        }
+        if (drainEnd != 0 && (OpenConnections() == 0 || TimerWheel_Clock() >= drainEnd))
+        {
+            ret = SUCESS;
+            break;
+        }
+
+        // wake up at the next tick of the wheel while connections have a deadline
+        int timeout = TimerWheel_NextTimeout(&Wheel);
+        if (drainEnd != 0 && (timeout < 0 || timeout > DRAIN_POLL_MS))
+        {
+            timeout = DRAIN_POLL_MS;
+        }
+        int ready = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+        Metrics_Wakeup();
+        if (ready == FALSE)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < ready; ++i)
+        {
+            Connection *conn = events[i].data.ptr;
+            if (conn == NULL)
+            {
+                AcceptConnections(epfd, server_fd);
+                continue;
+            }
+            if ((uintptr_t)conn & EVENT_WORKER)
+            {
+                // an error or hang up fails the exchange, its receive returns it
+                CgiPool_Progress((CgiWorker *)((char *)conn - EVENT_WORKER));
+                continue;
+            }
+
+            if (events[i].events & EPOLLERR)
+            {
+                CloseConnection(conn);
+                continue;
+            }
+            RunConnection(conn);
+        }
+
+        TimerWheel_Advance(&Wheel, ExpireConnection);
+        ResumeConnections();
+    }
+
+    CgiPool_SetWatch(NULL);
+    close(epfd);
+    return ret;
+}
@@ -0,0 +1,21 @@
+/*
+ * File Name        : EventLoop.h
+ * Description      : Declarations of the event driven mode, one process serving many connections with epoll.
+ * Functions        :
+ *                    - RunEventLoop: Accepts connections on a non-blocking listening socket and drives their state machines.
+ * Notes            : Sockets are registered edge-triggered for both directions, Handle_Requests reads or
+ *                    writes until the socket would block and epoll wakes the connection up again.
+ */
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+/*===================================  Includes ==============================*/
+#include "../utilities/HttpUtils.h"
+#include "Lifecycle.h"
+
+#include <sys/epoll.h>
+
+/*=================================  Prototypes ==============================*/
+int RunEventLoop(int server_fd);
+
+#endif
@@ -6,41 +6,102 @@
  *                    - acceptConnection: Accepts incoming client connections.
  *                    - handleRequest: Reads and parses HTTP requests, calls appropriate request handlers, and sends responses.
  *                    - handleClientFork: Forks a new process to process a client request independently.
+ *                    - ServeConnection: Runs the state machine of a forked child under the connection timeouts.
  * Notes            : This file contains the implementation of the server's main functionality and integrates other modules.
+ *                    Modes: "epoll" (default) serves every connection from one process with an event loop,
+ *                    "uring" does the same with io_uring (epoll when the kernel lacks it), "fork" forks a
+ *                    child per connection and "workers" runs one event loop per core, "uring" ones if asked.
+ *                    Every mode reloads on SIGHUP, upgrades to the binary found at argv[0] on SIGUSR2
+ *                    and drains on SIGQUIT, see Lifecycle.h.
  */
 
 /*===================================  Includes ==============================*/
 #include "HttpServer.h"
 
-/*==================================  Core Main ==============================*/
-int main(int argc, char **argv)
+/*============================  Function Implementation =======================*/
+static void ReapChildren(int sig)
 {
+    (void)sig;
+    int saved_errno = errno;
 
-    if (argc < 2)
+    // reap every finished child, several SIGCHLD can be merged into one
+    while (waitpid(-1, NULL, WNOHANG) > 0)
     {
-        fprintf(stderr, "Usage: %s <port>\n", argv[0]);
-        exit(EXIT_FAILURE);
     }
+    errno = saved_errno;
+}
+
+static void ServeConnection(Connection *conn)
+{
+    long long deadline = 0;
+
+    // non-blocking socket: poll for the next step until the deadline of the running timeout
+    while (Handle_Requests(conn) != CONN_CLOSED)
+    {
+        // the child serves a single connection, it waits for its CGI worker on the worker socket
+        if (conn->State == CONN_WAITING)
+        {
+            CgiPool_Wait(&conn->Cgi, Config->CgiTimeoutMs);
+            continue;
+        }
 
-    // open file descriptor for server and client
-    int server_fd, client_fd;
-    server_fd = SetServerSocket(argv[1]);
+        int timeout = UpdateTimeout(conn);
+        if (timeout > 0)
+        {
+            deadline = TimerWheel_Clock() + timeout;
+        }
+
+        struct pollfd pfd = {conn->Fd, (conn->State == CONN_WRITING) ? POLLOUT : POLLIN, 0};
+        long long left = deadline - TimerWheel_Clock();
+        int ready = (left > 0) ? poll(&pfd, 1, (int)left) : 0;
+        if (ready == 0)
+        {
+            break; // timed out
+        }
+        if (ready == FALSE && errno != EINTR)
+        {
+            perror("poll");
+            break;
+        }
+    }
+}
+
+int RunForkServer(int server_fd)
+{
+    int client_fd;
+    struct sockaddr_in peer;
+    socklen_t peerLength;
+
+    // children are reaped as soon as they exit so they never stay zombies
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = ReapChildren;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
 
     for (;;)
     { // Handle client connections iteratively
-        printf("Waiting for client connection ...\n");
-
         // Accept a connection. the listening socket ('server_fd') remains open
         //   and can be used to accept further connections.
-        client_fd = accept(server_fd, NULL, NULL);
+        // the children are left alone when draining, they finish their connection on their own
+        if (Lifecycle_Poll(server_fd))
+        {
+            printf("Stopped accepting (pid %d)\n", (int)getpid());
+            close(server_fd);
+            return SUCESS;
+        }
+
+        peerLength = sizeof(peer);
+        client_fd = accept4(server_fd, (struct sockaddr *)&peer, &peerLength, SOCK_CLOEXEC);
         if (client_fd == FALSE)
         {
-            printf("SERVER: accept failed (%s)\n", strerror(errno));
+            if (errno != EINTR)
+            {
+                printf("SERVER: accept failed (%s)\n", strerror(errno));
+            }
             continue;
         }
 
-        printf("Client connected\n");
-
         // Fork the current process to create a child process to handle concurrent requests
         int ret_pid = fork();
 
@@ -55,25 +116,104 @@ int main(int argc, char **argv)
         // child process
         else if (ret_pid == 0)
         {
-            CloseFd(server_fd);         // there's no need to open fd of server in child process
-            Handle_Requests(client_fd); // handle requests of client
-            CloseFd(client_fd);         // close fd of client after served
+            Connection conn;
+
+            // the CGI scripts of this child are waited for by ExecuteFile
+            signal(SIGCHLD, SIG_DFL);
+            CloseFd(server_fd); // there's no need to open fd of server in child process
 
-            getchar();
+            // the child times its connection out like the event loop does
+            SetNonBlocking(client_fd);
+            SetClientSocket(client_fd);
+            InitConnection(&conn, client_fd);
+            conn.Peer = peer;
+            AccessLog_Start();
+            ServeConnection(&conn);   // handle requests of client
+            ReleaseConnection(&conn); // close fd of client after served
+            CgiPool_Shutdown();       // the CGI workers started for this connection
+            AccessLog_Stop();         // the records of this connection are written before exiting
 
             exit(SUCESS); // exit from child process
         }
         else
         {
-            CloseFd(client_fd); // close fd of client after served
-
-            // Wait for the child process to complete with no blocking state for parent
-            // wait function syscall ensure to flush the childern process after termination to
-            // avoid to be zombies
-            int status = 0;
-            waitpid(-1, &status, WNOHANG);
+            CloseFd(client_fd); // close fd of client after served, the child is reaped by ReapChildren
         }
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+/*==================================  Core Main ==============================*/
+int main(int argc, char **argv)
+{
+    // SIGHUP, SIGUSR2 and SIGQUIT, and the listening sockets of the binary this one replaces;
+    // an upgrade runs the whole command line again, the configuration file is read anew
+    Lifecycle_Init(argv);
+
+    if (argc > 2 && strcmp(argv[1], "-c") == 0)
+    {
+        if (ServerConfig_Load(argv[2]) == -1)
+        {
+            exit(EXIT_FAILURE);
+        }
+        argc -= 2;
+        argv += 2;
+    }
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s [-c config] <port> [epoll|uring|fork|workers [count] [pin|nopin] [uring]]\n",
+                program_invocation_name);
+        exit(EXIT_FAILURE);
+    }
+
+    // a client closing early must not kill the server on the next write
+    signal(SIGPIPE, SIG_IGN);
+
+    // shared by every server process, each one writes it from its own logger thread
+    AccessLog_Open(Config->AccessLog);
+    Metrics_Init(); // the counters are mapped before any server process is forked
+    InitConnections();
+    MimeTypes_Init();
+
+    // the master opens a listening socket per worker
+    if (argc > 2 && strcmp(argv[2], "workers") == 0)
+    {
+        int count = (argc > 3) ? atoi(argv[3]) : Config->Workers;
+        int pin = (argc > 4 && strcmp(argv[4], "pin") == 0);
+        int uring = (argc > 5 && strcmp(argv[5], "uring") == 0);
+        return RunWorkers(argv[1], count, pin, uring);
+    }
+
+    if (argc > 2 && strcmp(argv[2], "fork") != 0 && strcmp(argv[2], "uring") != 0 &&
+        strcmp(argv[2], "epoll") != 0)
+    {
+        fprintf(stderr, "Unknown mode %s\n", argv[2]);
+        exit(EXIT_FAILURE);
+    }
+
+    // open file descriptor for server, or take the one of the binary we replace
+    int server_fd = Lifecycle_Listen(argv[1], 0);
+    Lifecycle_Ready();
+
+    int ret;
+    if (argc > 2 && strcmp(argv[2], "fork") == 0)
+    {
+        ret = RunForkServer(server_fd);
+    }
+    else if (argc > 2 && strcmp(argv[2], "uring") == 0)
+    {
+        ret = RunUringLoop(server_fd);
+    }
+    else
+    {
+        printf("Serving connections with epoll\n");
+        ret = RunEventLoop(server_fd);
+    }
+
+    // drained: the records of the last connections are written before exiting
+    CgiPool_Shutdown();
+    AccessLog_Stop();
+    return (ret == SUCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -1,10 +1,20 @@
 /*
  * File Name        : HttpServer.h
  * Description      : Contains declarations for server setup, connection handling, and utility functions.
- * Functions        : ..............
- * Notes            : ..............
+ * Functions        :
+ *                    - RunForkServer: Serves every accepted connection in a forked child.
+ * Notes            : The server mode is chosen on the command line, see main in HttpServer.c.
  */
 
 /*===================================  Includes ==============================*/
 #include "../utilities/ServerConfig.h"
 #include "../utilities/HttpUtils.h"
+#include "EventLoop.h"
+#include "UringLoop.h"
+#include "Workers.h"
+#include "Lifecycle.h"
+
+#include <poll.h>
+
+/*=================================  Prototypes ==============================*/
+int RunForkServer(int server_fd);
@@ -0,0 +1,218 @@
+/*
+ * File Name        : Lifecycle.c
+ * Description      : Implements graceful reloads and binary upgrades without refusing any connection.
+ * Functions        :
+ *                    - Notify: Signal handler, only raises the flag of the signal.
+ *                    - Lifecycle_Upgrade: Forks and execs the binary, the child keeps the listening sockets.
+ *                    - Lifecycle_Poll: Applies a reload in place (configuration, types, cache) for a single process.
+ *                    - Lifecycle_Listen: Takes an inherited listening socket back under FD_CLOEXEC.
+ * Notes            : The handlers are installed without SA_RESTART, so epoll_wait, io_uring_enter and
+ *                    accept return EINTR and the loops look at the flags right away; the master of the
+ *                    workers mode blocks the signals and takes them in sigsuspend (Workers.c).
+ *                    Everything the upgrade child needs is built before the fork: the server may run
+ *                    the logger thread, the child only clears FD_CLOEXEC and the signal mask it would
+ *                    inherit from the master, and calls execvpe.
+ */
+
+/*===================================  Includes ==============================*/
+#include "Lifecycle.h"
+
+/*============================  Static Variables ==============================*/
+static char **Argv;
+static int Inherited[LIFECYCLE_MAX_FDS]; // listening sockets handed over, -1 once taken or closed
+static int InheritedCount = 0;
+static pid_t UpgradeFrom = 0;            // previous binary, drained once this one listens
+static volatile sig_atomic_t ReloadRequested = 0;
+static volatile sig_atomic_t UpgradeRequested = 0;
+static volatile sig_atomic_t DrainRequested = 0;
+
+/*============================  Function Implementation =======================*/
+static void Notify(int sig)
+{
+    if (sig == SIGHUP)
+    {
+        ReloadRequested = 1;
+    }
+    else if (sig == SIGUSR2)
+    {
+        UpgradeRequested = 1;
+    }
+    else
+    {
+        DrainRequested = 1;
+    }
+}
+
+void Lifecycle_Init(char **argv)
+{
+    Argv = argv;
+
+    const char *list = getenv(LISTEN_FDS_ENV);
+    while (list != NULL && *list != '\0' && InheritedCount < LIFECYCLE_MAX_FDS)
+    {
+        char *end;
+        long fd = strtol(list, &end, 10);
+        if (end == list || fd < 0)
+        {
+            break;
+        }
+        Inherited[InheritedCount++] = (int)fd;
+        list = (*end == ',') ? end + 1 : end;
+    }
+    const char *from = getenv(UPGRADE_FROM_ENV);
+    if (from != NULL && atoi(from) == (int)getppid())
+    {
+        UpgradeFrom = atoi(from);
+    }
+
+    // the scripts run by this process, and its own upgrades, must not see them
+    unsetenv(LISTEN_FDS_ENV);
+    unsetenv(UPGRADE_FROM_ENV);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = Notify;
+    sigaction(SIGHUP, &sa, NULL);
+    sigaction(SIGUSR2, &sa, NULL);
+    sigaction(SIGQUIT, &sa, NULL);
+}
+
+int Lifecycle_Take(void)
+{
+    int events = 0;
+    if (ReloadRequested)
+    {
+        ReloadRequested = 0;
+        events |= LIFECYCLE_RELOAD;
+    }
+    if (UpgradeRequested)
+    {
+        UpgradeRequested = 0;
+        events |= LIFECYCLE_UPGRADE;
+    }
+    if (DrainRequested)
+    {
+        DrainRequested = 0;
+        events |= LIFECYCLE_DRAIN;
+    }
+    return events;
+}
+
+int Lifecycle_Poll(int server_fd)
+{
+    int events = Lifecycle_Take();
+    if (events & LIFECYCLE_RELOAD)
+    {
+        // no new process to start with the settings: they apply in place, to the next requests;
+        // the cached files go, their headers were built with the previous types
+        if (ServerConfig_Reload(1) == -1)
+        {
+            printf("Configuration unchanged, it has errors\n");
+        }
+        MimeTypes_Init();
+        FileCache_Clear();
+        Lifecycle_Reload();
+    }
+    if (events & LIFECYCLE_UPGRADE)
+    {
+        Lifecycle_Upgrade(&server_fd, 1);
+    }
+    return (events & LIFECYCLE_DRAIN) != 0;
+}
+
+int Lifecycle_Listen(char *port, int index)
+{
+    if (index >= InheritedCount || Inherited[index] < 0)
+    {
+        return SetServerSocket(port);
+    }
+
+    int fd = Inherited[index];
+    Inherited[index] = -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    printf("Server listening on inherited socket %d\n", fd);
+    return fd;
+}
+
+void Lifecycle_Ready(void)
+{
+    // fewer workers than before: the sockets left over would get connections nobody accepts
+    for (int i = 0; i < InheritedCount; ++i)
+    {
+        if (Inherited[i] >= 0)
+        {
+            close(Inherited[i]);
+            Inherited[i] = -1;
+        }
+    }
+
+    if (UpgradeFrom > 0)
+    {
+        printf("Upgrade done, draining the previous server (pid %d)\n", (int)UpgradeFrom);
+        kill(UpgradeFrom, SIGQUIT);
+        UpgradeFrom = 0;
+    }
+}
+
+pid_t Lifecycle_Upgrade(const int *fds, int count)
+{
+    char list[LIFECYCLE_MAX_FDS * 12] = "";
+    size_t used = 0;
+    for (int i = 0; i < count && i < LIFECYCLE_MAX_FDS; ++i)
+    {
+        used += snprintf(list + used, sizeof(list) - used, "%s%d", (i > 0) ? "," : "", fds[i]);
+    }
+
+    char listEnv[sizeof(LISTEN_FDS_ENV) + sizeof(list)];
+    char fromEnv[sizeof(UPGRADE_FROM_ENV) + 16];
+    snprintf(listEnv, sizeof(listEnv), "%s=%s", LISTEN_FDS_ENV, list);
+    snprintf(fromEnv, sizeof(fromEnv), "%s=%d", UPGRADE_FROM_ENV, (int)getpid());
+
+    extern char **environ;
+    size_t envCount = 0;
+    while (environ[envCount] != NULL)
+    {
+        envCount++;
+    }
+    char **envp = malloc((envCount + 3) * sizeof(char *));
+    if (envp == NULL)
+    {
+        perror("malloc");
+        return FALSE;
+    }
+    memcpy(envp, environ, envCount * sizeof(char *));
+    envp[envCount] = listEnv;
+    envp[envCount + 1] = fromEnv;
+    envp[envCount + 2] = NULL;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            fcntl(fds[i], F_SETFD, 0);
+        }
+        sigset_t none;
+        sigemptyset(&none);
+        sigprocmask(SIG_SETMASK, &none, NULL);
+        execvpe(Argv[0], Argv, envp);
+        perror("execvpe");
+        _exit(EXIT_FAILURE);
+    }
+    free(envp);
+
+    if (pid < 0)
+    {
+        perror("fork");
+        return FALSE;
+    }
+    printf("Upgrading: started %s (pid %d) with %d listening sockets\n", Argv[0], (int)pid, count);
+    return pid;
+}
+
+void Lifecycle_Reload(void)
+{
+    printf("Reloading (pid %d)\n", (int)getpid());
+    AccessLog_Reopen(Config->AccessLog);
+}
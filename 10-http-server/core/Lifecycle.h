@@ -0,0 +1,43 @@
+/*
+ * File Name        : Lifecycle.h
+ * Description      : Declarations of the reload, upgrade and drain signals of the server processes.
+ * Functions        :
+ *                    - Lifecycle_Init: Remembers the command line, the sockets handed over and installs the handlers.
+ *                    - Lifecycle_Take: Returns and clears the signals received since the previous call.
+ *                    - Lifecycle_Poll: Reloads (configuration file included) or upgrades a single process server,
+ *                      tells its loop to drain.
+ *                    - Lifecycle_Listen: Listening socket handed over by the previous binary, or a new one.
+ *                    - Lifecycle_Ready: Closes the unused sockets handed over and lets the previous binary drain.
+ *                    - Lifecycle_Upgrade: Executes the binary again with the listening sockets left open.
+ *                    - Lifecycle_Reload: Reopens the access log.
+ * Notes            : SIGHUP reloads, SIGUSR2 upgrades and SIGQUIT drains. A draining process stops
+ *                    accepting, answers its connections with "Connection: close" and exits once none is
+ *                    left, or after DRAIN_TIMEOUT. An upgrade execs argv[0] with the numbers of the
+ *                    listening sockets in LISTEN_FDS_ENV: their accept queues are never closed, so no
+ *                    connection attempt is refused while the binaries change. The new process sends
+ *                    SIGQUIT to the old one once it listens; if it fails to start the old one keeps serving.
+ */
+#ifndef LIFECYCLE_H
+#define LIFECYCLE_H
+
+/*===================================  Includes ==============================*/
+#include "../utilities/HttpUtils.h"
+
+/*================================  Definations ==============================*/
+#define LIFECYCLE_RELOAD 1                           // SIGHUP
+#define LIFECYCLE_UPGRADE 2                          // SIGUSR2
+#define LIFECYCLE_DRAIN 4                            // SIGQUIT
+#define LIFECYCLE_MAX_FDS 256                        // listening sockets handed over, one per worker
+#define LISTEN_FDS_ENV "HTTPSERVER_LISTEN_FDS"       // "fd,fd,..." in the order of the workers
+#define UPGRADE_FROM_ENV "HTTPSERVER_UPGRADE_FROM"   // pid of the process to drain once listening
+
+/*=================================  Prototypes ==============================*/
+void Lifecycle_Init(char **argv);
+int Lifecycle_Take(void);
+int Lifecycle_Poll(int server_fd);
+int Lifecycle_Listen(char *port, int index);
+void Lifecycle_Ready(void);
+pid_t Lifecycle_Upgrade(const int *fds, int count);
+void Lifecycle_Reload(void);
+
+#endif
@@ -0,0 +1,243 @@
+/*
+ * File Name        : UringLoop.c
+ * Description      : Implements the completion driven mode of the server with io_uring.
+ * Functions        :
+ *                    - RunUringLoop: Submits, waits and dispatches the completions to the listener or the connections.
+ *                    - AcceptConnection: Sets up a connection accepted by the multishot accept.
+ *                    - RunConnection: Runs the state machine after a completion and queues the next receive.
+ *                    - CloseConnection: Releases a connection, once the kernel is done with its operations.
+ *                    - PollWorker: CgiPool hook queuing a poll of the socket of a CGI worker.
+ * Notes            : Connections are the same as in the epoll loop (EventLoop.c), with the same timing
+ *                    wheel, only their reads and sends go through the ring (Uring.h). On a keep-alive
+ *                    connection a request costs no system call at all: its receive, its response and the
+ *                    next receive are queued and completed by the io_uring_enter of the loop iterations.
+ *                    Accepted sockets inherit TCP_NODELAY from the listener and stay blocking, io_uring
+ *                    waits for them itself. Draining (Lifecycle.h) cancels the multishot accept and
+ *                    otherwise works as in the epoll loop. CGI workers are waited for with one-shot
+ *                    polls (URING_POLL) queued when their exchange would block, the rest is the same as
+ *                    in the epoll loop.
+ */
+
+/*===================================  Includes ==============================*/
+#include "UringLoop.h"
+#include "EventLoop.h"
+
+/*============================  Static Variables ==============================*/
+static TimerWheel Wheel; // timeouts of the open connections
+
+/*============================  Function Implementation =======================*/
+static void DestroyConnection(Connection *conn)
+{
+    Uring_Release(&conn->Io);
+    FreeConnection(conn);
+}
+
+static void CloseConnection(Connection *conn)
+{
+    TimerWheel_Disarm(&Wheel, &conn->Timeout);
+    if (conn->Io.InFlight == 0)
+    {
+        DestroyConnection(conn);
+        return;
+    }
+
+    // the kernel still holds its buffers: cancel what is queued, the last completion frees it;
+    // a CGI call can't wait for that, its end would run the connection again
+    conn->Io.Closing = 1;
+    CgiPool_Release(&conn->Cgi, 504);
+    Uring_Cancel(conn->Fd);
+}
+
+static void ArmTimeout(Connection *conn)
+{
+    int timeout = UpdateTimeout(conn);
+    if (timeout > 0)
+    {
+        TimerWheel_Arm(&Wheel, &conn->Timeout, timeout);
+    }
+}
+
+static void RunConnection(Connection *conn)
+{
+    if (Handle_Requests(conn) == CONN_CLOSED)
+    {
+        CloseConnection(conn);
+        return;
+    }
+    ArmTimeout(conn);
+
+    // waiting for a request: receive it, the response is queued by the state machine itself
+    if (conn->State == CONN_READING)
+    {
+        Uring_Receive(&conn->Io, conn->Fd);
+    }
+}
+
+static void ExpireConnection(Timer *timer)
+{
+    Connection *conn = (Connection *)((char *)timer - offsetof(Connection, Timeout));
+
+    // the CGI worker is too late, the request gets a 504 and the connection goes on
+    if (conn->State == CONN_WAITING)
+    {
+        CgiPool_Release(&conn->Cgi, 504);
+        RunConnection(conn);
+        return;
+    }
+    CloseConnection(conn);
+}
+
+static void PollWorker(CgiWorker *worker, int events)
+{
+    // one poll at a time, its completion runs the exchange, which queues the next one if needed;
+    // a stopped worker's poll completes by itself with the hang up of its socket
+    if (events != 0 && !worker->Watched && Uring_Poll(worker, worker->Fd, events) == SUCESS)
+    {
+        worker->Watched = events;
+    }
+    else if (events != 0 && (events & ~worker->Watched))
+    {
+        // the idle poll waits for input, a send that blocks needs another one: its cancellation
+        // completes it and the exchange queues the right poll from there
+        Uring_Cancel(worker->Fd);
+    }
+}
+
+static void ResumeConnections(void)
+{
+    // the connections whose CGI call ended, in the order the calls ended
+    CgiCall *call;
+    while ((call = CgiPool_Next()) != NULL)
+    {
+        RunConnection((Connection *)((char *)call - offsetof(Connection, Cgi)));
+    }
+}
+
+static void AcceptConnection(int client_fd)
+{
+    Connection *conn = NewConnection(client_fd);
+    if (conn == NULL)
+    {
+        close(client_fd);
+        return;
+    }
+    conn->Io.Active = 1;
+
+    // the multishot accept has no room for the address, a call per connection
+    socklen_t peerLength = sizeof(conn->Peer);
+    getpeername(client_fd, (struct sockaddr *)&conn->Peer, &peerLength);
+    ArmTimeout(conn);
+    Uring_Receive(&conn->Io, client_fd);
+}
+
+int RunUringLoop(int server_fd)
+{
+    if (Uring_Init() == FALSE)
+    {
+        printf("io_uring unavailable (%s), serving connections with epoll\n", strerror(errno));
+        return RunEventLoop(server_fd);
+    }
+    printf("Serving connections with io_uring\n");
+
+    SetClientSocket(server_fd); // inherited by the accepted sockets
+    TimerWheel_Init(&Wheel);
+    AccessLog_Start();
+    if (Uring_Accept(server_fd) == FALSE)
+    {
+        perror("io_uring accept");
+        Uring_Exit();
+        return FALSE;
+    }
+    CgiPool_SetWatch(PollWorker);
+
+    long long drainEnd = 0; // deadline of the connections once the process drains
+    int ret = FALSE;
+    for (;;)
+    {
+        if (Lifecycle_Poll(server_fd) && drainEnd == 0)
+        {
+            // the listener is closed when its accept completes canceled, the cancel still names it
+            Uring_Cancel(server_fd);
+            StopKeepAlive();
+            drainEnd = TimerWheel_Clock() + DRAIN_TIMEOUT * 1000LL;
+            printf("Draining %zu connections (pid %d)\n", OpenConnections(), (int)getpid());
+        }
+        if (drainEnd != 0 && (OpenConnections() == 0 || TimerWheel_Clock() >= drainEnd))
+        {
+            ret = SUCESS;
+            break;
+        }
+
+        // submit what the previous completions queued and wait for the next ones
+        int timeout = TimerWheel_NextTimeout(&Wheel);
+        if (drainEnd != 0 && (timeout < 0 || timeout > DRAIN_POLL_MS))
+        {
+            timeout = DRAIN_POLL_MS;
+        }
+        if (Uring_Wait(timeout) == FALSE)
+        {
+            perror("io_uring_enter");
+            break;
+        }
+        Metrics_Wakeup();
+
+        struct io_uring_cqe cqe;
+        while (Uring_Next(&cqe))
+        {
+            if (URING_TAG(cqe.user_data) == URING_ACCEPT)
+            {
+                if (cqe.res >= 0)
+                {
+                    AcceptConnection(cqe.res);
+                }
+                else if (cqe.res != -ECONNABORTED && cqe.res != -EINTR && cqe.res != -ECANCELED)
+                {
+                    printf("SERVER: accept failed (%s)\n", strerror(-cqe.res));
+                }
+                // the multishot accept stops on errors, start it again unless draining
+                if (!(cqe.flags & IORING_CQE_F_MORE))
+                {
+                    if (drainEnd != 0)
+                    {
+                        close(server_fd);
+                    }
+                    else if (Uring_Accept(server_fd) == FALSE)
+                    {
+                        perror("io_uring accept");
+                    }
+                }
+                continue;
+            }
+            if (URING_TAG(cqe.user_data) == URING_POLL)
+            {
+                CgiWorker *worker = URING_OWNER(cqe.user_data);
+                worker->Watched = 0;
+                CgiPool_Progress(worker);
+                continue;
+            }
+
+            UringConn *io = Uring_Complete(&cqe);
+            if (io == NULL)
+            {
+                continue;
+            }
+            Connection *conn = (Connection *)((char *)io - offsetof(Connection, Io));
+            if (io->Closing)
+            {
+                if (io->InFlight == 0)
+                {
+                    DestroyConnection(conn);
+                }
+                continue;
+            }
+            RunConnection(conn);
+        }
+
+        TimerWheel_Advance(&Wheel, ExpireConnection);
+        ResumeConnections();
+    }
+
+    CgiPool_SetWatch(NULL);
+    Uring_Exit();
+    return ret;
+}
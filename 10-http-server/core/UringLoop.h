@@ -0,0 +1,19 @@
+/*
+ * File Name        : UringLoop.h
+ * Description      : Declarations of the io_uring event loop, the "uring" mode of the server.
+ * Functions        :
+ *                    - RunUringLoop: Serves the connections of a listening socket through one io_uring ring,
+ *                      or with epoll (RunEventLoop) when the kernel doesn't support what it needs.
+ * Notes            : One io_uring_enter per iteration submits every operation queued by the previous
+ *                    completions and waits for the next ones, with the timing wheel deadline as timeout.
+ */
+#ifndef URING_LOOP_H
+#define URING_LOOP_H
+
+/*===================================  Includes ==============================*/
+#include "../utilities/HttpUtils.h"
+
+/*=================================  Prototypes ==============================*/
+int RunUringLoop(int server_fd);
+
+#endif
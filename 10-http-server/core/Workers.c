@@ -0,0 +1,338 @@
+/*
+ * File Name        : Workers.c
+ * Description      : Implements the master/worker mode of the server.
+ * Functions        :
+ *                    - RunWorkers: Forks the workers, then supervises them and restarts dead ones.
+ *                    - StartWorker: Forks one worker, pins it to its CPU and runs its event loop (epoll or io_uring).
+ *                    - StopWorkers: Forwards a termination signal to the workers.
+ *                    - StartGeneration/RetireGeneration: SIGHUP starts new workers on the same sockets and
+ *                      drains the old ones with SIGQUIT.
+ *                    - ChildExited: Empty SIGCHLD handler, it only ends the sigsuspend of the master.
+ * Notes            : The master opens the listening sockets but never accepts: a worker only keeps its
+ *                    own, and its accept queue outlives it, so the connections waiting for a restarted,
+ *                    reloaded or upgraded worker are accepted by the next one instead of being reset.
+ *                    The master hands all of them to the binary started by SIGUSR2 (Lifecycle.h); when
+ *                    the new master sends SIGQUIT, this one drains its workers and exits after them.
+ *                    The master keeps its signals blocked and only takes them in sigsuspend, after it
+ *                    looked at the flags and reaped the workers, so none arrives unseen in between.
+ */
+
+/*===================================  Includes ==============================*/
+#include "Workers.h"
+#include "EventLoop.h"
+#include "UringLoop.h"
+
+/*=============================  Static Variables ============================*/
+static pid_t Workers[MAX_WORKERS];
+static pid_t Retiring[MAX_WORKERS];   // workers of the previous generation, draining after a reload
+static int Listeners[MAX_WORKERS];    // one reuseport socket per worker, kept open by the master
+static time_t StartTimes[MAX_WORKERS];
+static int WorkerCount = 0;
+static int WorkerSlots[MAX_WORKERS];  // metrics slot of each worker, given back when it is reaped
+static int RetiringSlots[MAX_WORKERS];
+static int UseUring = 0; // workers run RunUringLoop instead of RunEventLoop
+static volatile sig_atomic_t Stopping = 0;
+static sigset_t Unblocked;            // signal mask of the master before it supervises, for the workers
+
+/*============================  Function Implementation =======================*/
+static void StopWorkers(int sig)
+{
+    Stopping = sig;
+}
+
+static void ChildExited(int sig)
+{
+    (void)sig;
+}
+
+static pid_t StartWorker(int index, int pin)
+{
+    // a slot no running worker updates, so its gauges can start from zero
+    int slot = Metrics_TakeSlot();
+    if (slot < 0)
+    {
+        printf("Worker %d has no metrics slot left, its counters stay private\n", index);
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0)
+    {
+        if (pid < 0)
+        {
+            perror("fork");
+            Metrics_ReleaseSlot(slot);
+            slot = -1;
+        }
+        WorkerSlots[index] = slot;
+        return pid;
+    }
+
+    // worker: default signal handling, only SIGQUIT from the master drains it
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGHUP, SIG_IGN);
+    signal(SIGUSR2, SIG_IGN);
+    signal(SIGCHLD, SIG_DFL);
+    sigprocmask(SIG_SETMASK, &Unblocked, NULL);
+
+    if (pin)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(index % sysconf(_SC_NPROCESSORS_ONLN), &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == FALSE)
+        {
+            perror("sched_setaffinity");
+        }
+    }
+
+    // its own listening socket, the others are left to their workers
+    for (int i = 0; i < WorkerCount; ++i)
+    {
+        if (i != index)
+        {
+            close(Listeners[i]);
+        }
+    }
+
+    Metrics_SetSlot(slot);
+    printf("Worker %d (pid %d) started\n", index, (int)getpid());
+    int ret = UseUring ? RunUringLoop(Listeners[index]) : RunEventLoop(Listeners[index]);
+    CgiPool_Shutdown();
+    AccessLog_Stop(); // a drained worker writes its last records before exiting
+    exit(ret == SUCESS ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+static void StartGeneration(int pin)
+{
+    for (int i = 0; i < WorkerCount; ++i)
+    {
+        Workers[i] = StartWorker(i, pin);
+        StartTimes[i] = time(NULL);
+    }
+}
+
+static void RetireGeneration(void)
+{
+    // the new workers already accept on the same sockets, the old ones finish what they have
+    int slot = 0;
+    for (int i = 0; i < WorkerCount; ++i)
+    {
+        if (Workers[i] <= 0)
+        {
+            continue;
+        }
+        kill(Workers[i], SIGQUIT);
+        while (slot < MAX_WORKERS && Retiring[slot] > 0)
+        {
+            slot++;
+        }
+        if (slot < MAX_WORKERS)
+        {
+            Retiring[slot] = Workers[i];
+            RetiringSlots[slot] = WorkerSlots[i];
+        }
+        Workers[i] = 0;
+        WorkerSlots[i] = -1;
+    }
+}
+
+static int ReapRetired(pid_t pid)
+{
+    for (int i = 0; i < MAX_WORKERS; ++i)
+    {
+        if (Retiring[i] == pid)
+        {
+            Retiring[i] = 0;
+            Metrics_ReleaseSlot(RetiringSlots[i]);
+            RetiringSlots[i] = -1;
+            printf("Worker (pid %d) drained\n", (int)pid);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void SignalAll(int sig)
+{
+    for (int i = 0; i < MAX_WORKERS; ++i)
+    {
+        if (i < WorkerCount && Workers[i] > 0)
+        {
+            kill(Workers[i], sig);
+        }
+        if (Retiring[i] > 0)
+        {
+            kill(Retiring[i], sig);
+        }
+    }
+}
+
+static void WaitFor(pid_t *pid)
+{
+    while (*pid > 0 && waitpid(*pid, NULL, 0) == FALSE && errno == EINTR)
+    {
+        if (Stopping)
+        {
+            kill(*pid, SIGTERM); // stopped while draining
+        }
+    }
+    *pid = 0;
+}
+
+static void WaitWorkers(void)
+{
+    // by pid: an upgraded master is a child too, and outlives this one
+    for (int i = 0; i < MAX_WORKERS; ++i)
+    {
+        WaitFor(&Workers[i]);
+        WaitFor(&Retiring[i]);
+    }
+}
+
+int RunWorkers(char *port, int count, int pin, int uring)
+{
+    UseUring = uring;
+    if (count <= 0)
+    {
+        count = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (count > MAX_WORKERS)
+    {
+        count = MAX_WORKERS;
+    }
+    WorkerCount = count;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = StopWorkers;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sa.sa_handler = ChildExited;
+    sa.sa_flags = SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    // from here the signals are only delivered in sigsuspend
+    sigset_t blocked;
+    sigemptyset(&blocked);
+    sigaddset(&blocked, SIGCHLD);
+    sigaddset(&blocked, SIGHUP);
+    sigaddset(&blocked, SIGUSR2);
+    sigaddset(&blocked, SIGQUIT);
+    sigaddset(&blocked, SIGTERM);
+    sigaddset(&blocked, SIGINT);
+    sigprocmask(SIG_BLOCK, &blocked, &Unblocked);
+
+    for (int i = 0; i < count; ++i)
+    {
+        Listeners[i] = Lifecycle_Listen(port, i);
+    }
+    Lifecycle_Ready();
+
+    printf("Master %d starting %d workers\n", (int)getpid(), count);
+    StartGeneration(pin);
+
+    // supervise: restart every worker that dies until we are asked to stop or to drain
+    pid_t upgrade = 0;
+    while (!Stopping)
+    {
+        int events = Lifecycle_Take();
+        if (events & LIFECYCLE_DRAIN)
+        {
+            // the upgraded master serves on our sockets, the workers finish their connections
+            printf("Master %d draining its workers\n", (int)getpid());
+            RetireGeneration();
+            break;
+        }
+        if (events & LIFECYCLE_RELOAD)
+        {
+            // the new workers start with the new settings, the sockets (count, backlog) stay as they are
+            if (ServerConfig_Reload(0) == -1)
+            {
+                printf("Configuration unchanged, it has errors\n");
+            }
+            InitConnections();
+            MimeTypes_Init();
+            Lifecycle_Reload();
+            RetireGeneration();
+            StartGeneration(pin);
+        }
+        if ((events & LIFECYCLE_UPGRADE) && upgrade <= 0)
+        {
+            upgrade = Lifecycle_Upgrade(Listeners, count);
+        }
+
+        // nothing left to reap: wait for the next signal, one that came meanwhile is pending still
+        int status;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid == 0)
+        {
+            sigsuspend(&Unblocked);
+            continue;
+        }
+        if (pid == FALSE)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("waitpid");
+            break;
+        }
+
+        if (pid == upgrade)
+        {
+            // the new binary died before taking over, we keep serving
+            printf("Upgrade (pid %d) failed, exit status %d\n", (int)pid, WEXITSTATUS(status));
+            upgrade = 0;
+            continue;
+        }
+        if (ReapRetired(pid))
+        {
+            continue;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (Workers[i] != pid)
+            {
+                continue;
+            }
+
+            if (WIFSIGNALED(status))
+            {
+                printf("Worker %d (pid %d) killed by signal %d, restarting\n", i, (int)pid, WTERMSIG(status));
+            }
+            else
+            {
+                printf("Worker %d (pid %d) exited with %d, restarting\n", i, (int)pid, WEXITSTATUS(status));
+            }
+
+            Metrics_ReleaseSlot(WorkerSlots[i]);
+            WorkerSlots[i] = -1;
+
+            // don't spin if the worker can't even start (port taken, ...)
+            if (time(NULL) - StartTimes[i] < WORKER_RESTART_DELAY)
+            {
+                sleep(WORKER_RESTART_DELAY);
+            }
+            if (!Stopping)
+            {
+                Workers[i] = StartWorker(i, pin);
+                StartTimes[i] = time(NULL);
+            }
+            break;
+        }
+    }
+
+    // forward the termination to the workers and wait for them, a second SIGTERM interrupts it
+    sigprocmask(SIG_SETMASK, &Unblocked, NULL);
+    if (Stopping)
+    {
+        SignalAll(SIGTERM);
+    }
+    WaitWorkers();
+
+    return SUCESS;
+}
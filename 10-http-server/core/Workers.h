@@ -0,0 +1,25 @@
+/*
+ * File Name        : Workers.h
+ * Description      : Declarations of the multi-core mode, a master process supervising N event loop workers.
+ * Functions        :
+ *                    - RunWorkers: Starts the workers and restarts the ones that die.
+ * Notes            : Every worker has its own SO_REUSEPORT listening socket, the kernel spreads the
+ *                    incoming connections over them so the workers never share an accept queue.
+ */
+#ifndef WORKERS_H
+#define WORKERS_H
+
+/*===================================  Includes ==============================*/
+#include "../utilities/HttpUtils.h"
+#include "Lifecycle.h"
+
+#include <sched.h>
+
+/*================================  Definations ==============================*/
+#define MAX_WORKERS 256
+#define WORKER_RESTART_DELAY 1 // seconds to wait before restarting a worker that died right after its start
+
+/*=================================  Prototypes ==============================*/
+int RunWorkers(char *port, int count, int pin, int uring);
+
+#endif
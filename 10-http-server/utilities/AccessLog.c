@@ -0,0 +1,238 @@
+/*
+ * File Name        : AccessLog.c
+ * Description      : Implements the access log ring and its logger thread.
+ * Functions        :
+ *                    - AccessLog_Reopen: Replaces the file behind LogFd with dup3, the logger keeps its descriptor.
+ *                    - AccessLog_Write: Producer side, copies the record into the ring or counts a drop.
+ *                    - RunLogger: Consumer side, formats the published records and writes them in batches.
+ *                    - FormatRecord: One "key=value" line per record.
+ * Notes            : Head is only written by the producer and Tail by the logger, a release store after
+ *                    the copy and an acquire load before reading are the only synchronisation needed.
+ */
+
+/*===================================  Includes ==============================*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // dup3
+#endif
+#include "AccessLog.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/*============================  Static Variables ==============================*/
+static int LogFd = -1;
+static AccessRecord Ring[ACCESS_LOG_RING];
+static _Atomic size_t Head;            // next record written by the producer
+static _Atomic size_t Tail;            // next record read by the logger
+static _Atomic unsigned long Dropped;  // records lost to a full ring, not reported yet
+static _Atomic int Running;
+static pthread_t Logger;
+static int Started;
+
+/*============================  Function Implementation =======================*/
+long long AccessLog_Clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+int AccessLog_Open(const char *path)
+{
+    LogFd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (LogFd < 0)
+    {
+        perror("open access log");
+        return -1;
+    }
+    return 0;
+}
+
+int AccessLog_Reopen(const char *path)
+{
+    if (LogFd < 0)
+    {
+        return AccessLog_Open(path);
+    }
+
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        perror("reopen access log");
+        return -1;
+    }
+
+    // swapped atomically, the logger thread never sees a closed descriptor
+    dup3(fd, LogFd, O_CLOEXEC);
+    close(fd);
+    return 0;
+}
+
+void AccessLog_Write(const AccessRecord *record)
+{
+    if (!Started)
+    {
+        return;
+    }
+
+    size_t head = atomic_load_explicit(&Head, memory_order_relaxed);
+    if (head - atomic_load_explicit(&Tail, memory_order_acquire) == ACCESS_LOG_RING)
+    {
+        atomic_fetch_add_explicit(&Dropped, 1, memory_order_relaxed);
+        return;
+    }
+
+    Ring[head & (ACCESS_LOG_RING - 1)] = *record;
+    atomic_store_explicit(&Head, head + 1, memory_order_release);
+}
+
+static size_t FormatRecord(char *line, size_t size, const AccessRecord *record)
+{
+    static time_t second = -1;
+    static char date[32];
+    char client[INET_ADDRSTRLEN];
+    char path[ACCESS_LOG_PATH * 3];
+
+    // the date only changes once a second
+    if (record->Time.tv_sec != second)
+    {
+        struct tm tm;
+        gmtime_r(&record->Time.tv_sec, &tm);
+        strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &tm);
+        second = record->Time.tv_sec;
+    }
+    inet_ntop(AF_INET, &record->Client.sin_addr, client, sizeof(client));
+
+    // the target comes from the client, quotes and control characters are escaped
+    size_t length = 0;
+    for (const unsigned char *p = (const unsigned char *)record->Path; *p != '\0'; ++p)
+    {
+        if (*p < 0x20 || *p >= 0x7f || *p == '"' || *p == '\\')
+        {
+            length += snprintf(path + length, sizeof(path) - length, "%%%02X", *p);
+        }
+        else
+        {
+            path[length++] = *p;
+        }
+    }
+    path[length] = '\0';
+
+    int written = snprintf(line, size,
+                           "%s.%03ldZ client=%s:%u method=%s path=\"%s\" status=%d bytes=%llu duration_us=%lld\n",
+                           date, record->Time.tv_nsec / 1000000, client, ntohs(record->Client.sin_port),
+                           (record->Method[0] != '\0') ? record->Method : "-", path, record->Status,
+                           record->Bytes, record->Duration);
+    return (written < 0 || (size_t)written >= size) ? 0 : (size_t)written;
+}
+
+static void WriteAll(const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t bytes = write(LogFd, data, length);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            perror("write access log");
+            return;
+        }
+        data += bytes;
+        length -= bytes;
+    }
+}
+
+static void *RunLogger(void *argument)
+{
+    static char batch[64 * 1024];
+    (void)argument;
+
+    for (;;)
+    {
+        int running = atomic_load_explicit(&Running, memory_order_acquire);
+        size_t tail = atomic_load_explicit(&Tail, memory_order_relaxed);
+        size_t first = tail;
+        size_t head = atomic_load_explicit(&Head, memory_order_acquire);
+        size_t length = 0;
+
+        unsigned long dropped = atomic_exchange_explicit(&Dropped, 0, memory_order_relaxed);
+        if (dropped > 0)
+        {
+            length += snprintf(batch, sizeof(batch), "access log: %lu records dropped, the ring was full\n", dropped);
+        }
+
+        // everything published so far goes out in as few writes as the batch buffer allows
+        for (; tail != head; ++tail)
+        {
+            char line[ACCESS_LOG_PATH * 3 + 256];
+            size_t lineLength = FormatRecord(line, sizeof(line), &Ring[tail & (ACCESS_LOG_RING - 1)]);
+            atomic_store_explicit(&Tail, tail + 1, memory_order_release);
+
+            if (length + lineLength > sizeof(batch))
+            {
+                WriteAll(batch, length);
+                length = 0;
+            }
+            memcpy(batch + length, line, lineLength);
+            length += lineLength;
+        }
+        if (length > 0)
+        {
+            WriteAll(batch, length);
+        }
+
+        if (!running)
+        {
+            return NULL; // stopped and drained
+        }
+
+        // under load the ring is drained again right away, it must not fill up while sleeping
+        if (head - first >= ACCESS_LOG_RING / 8)
+        {
+            continue;
+        }
+        struct timespec pause = {0, ACCESS_LOG_FLUSH_MS * 1000000L};
+        nanosleep(&pause, NULL);
+    }
+}
+
+int AccessLog_Start(void)
+{
+    if (LogFd < 0 || Started)
+    {
+        return -1;
+    }
+
+    // a forked process starts with the ring it inherited, emptied
+    atomic_store(&Head, 0);
+    atomic_store(&Tail, 0);
+    atomic_store(&Dropped, 0);
+    atomic_store(&Running, 1);
+    if (pthread_create(&Logger, NULL, RunLogger, NULL) != 0)
+    {
+        perror("pthread_create access log");
+        return -1;
+    }
+    Started = 1;
+    return 0;
+}
+
+void AccessLog_Stop(void)
+{
+    if (!Started)
+    {
+        return;
+    }
+    atomic_store_explicit(&Running, 0, memory_order_release);
+    pthread_join(Logger, NULL);
+    Started = 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * File Name        : AccessLog.h
+ * Description      : Asynchronous access log, one line per response written by a logger thread.
+ * Functions        :
+ *                    - AccessLog_Open: Opens the log file, before the server processes are forked.
+ *                    - AccessLog_Reopen: Opens the file again under the same descriptor, after a rotation.
+ *                    - AccessLog_Start: Starts the logger thread of the calling process.
+ *                    - AccessLog_Write: Queues a record, never blocks.
+ *                    - AccessLog_Stop: Drains the queued records and stops the logger thread.
+ *                    - AccessLog_Clock: Monotonic clock in microseconds, for the durations.
+ * Notes            : Every server process (the epoll loop, each worker, each forked child) has its own
+ *                    single producer single consumer ring of ACCESS_LOG_RING records: the thread serving
+ *                    the connections only copies a record into it and publishes it with an atomic store,
+ *                    the logger thread formats the records and appends them to the file in batches.
+ *                    A full ring drops the record and counts it, the logger reports the drops in the log.
+ *                    The file is opened with O_APPEND, the batches of every process land whole.
+ */
+#ifndef ACCESS_LOG_H
+#define ACCESS_LOG_H
+
+/*===================================  Includes ==============================*/
+#include <netinet/in.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "ServerConfig.h"
+
+/*==================================  Structures =============================*/
+typedef struct AccessRecord
+{
+    struct timespec Time;         // end of the response, wall clock
+    struct sockaddr_in Client;
+    long long Duration;           // microseconds from the first byte of the request to the last of the response
+    unsigned long long Bytes;     // response bytes, headers included
+    int Status;
+    char Method[16];
+    char Path[ACCESS_LOG_PATH];   // request target, truncated
+} AccessRecord;
+
+/*=================================  Prototypes ==============================*/
+int AccessLog_Open(const char *path);
+int AccessLog_Reopen(const char *path);
+int AccessLog_Start(void);
+void AccessLog_Write(const AccessRecord *record);
+void AccessLog_Stop(void);
+long long AccessLog_Clock(void);
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * File Name        : BufferPool.c
+ * Description      : Implements the slab backed object pools.
+ * Functions        :
+ *                    - Pool_Get: Pops the free list, or carves a new slab into free objects.
+ *                    - Pool_Put: Pushes the object back on the free list.
+ * Notes            : Objects are rounded up to 64 bytes so two of them never share a cache line.
+ */
+
+/*===================================  Includes ==============================*/
+#include "BufferPool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*============================  Function Implementation =======================*/
+void *Pool_Get(Pool *pool)
+{
+    if (pool->Free == NULL)
+    {
+        size_t size = (pool->Size + 63) & ~(size_t)63;
+        char *slab = aligned_alloc(64, size * POOL_SLAB_OBJECTS);
+        if (slab == NULL)
+        {
+            perror("aligned_alloc");
+            return NULL;
+        }
+
+        // in address order, the first objects handed out share the first pages
+        for (size_t i = POOL_SLAB_OBJECTS; i > 0; --i)
+        {
+            void **object = (void **)(slab + (i - 1) * size);
+            *object = pool->Free;
+            pool->Free = object;
+        }
+        pool->Count += POOL_SLAB_OBJECTS;
+    }
+
+    void **object = pool->Free;
+    pool->Free = *object;
+    pool->InUse++;
+    return object;
+}
+
+void Pool_Put(Pool *pool, void *object)
+{
+    if (object == NULL)
+    {
+        return;
+    }
+    *(void **)object = pool->Free;
+    pool->Free = object;
+    pool->InUse--;
+}
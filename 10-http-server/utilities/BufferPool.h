@@ -0,0 +1,37 @@
+/*
+ * File Name        : BufferPool.h
+ * Description      : Fixed-size object pools carved from slabs, for the connections and their buffers.
+ * Functions        :
+ *                    - Pool_Get: Takes a free object, carving a new slab of POOL_SLAB_OBJECTS when none is left.
+ *                    - Pool_Put: Gives an object back to its pool.
+ * Notes            : A pool is declared with POOL_INITIALIZER(size), nothing is allocated before its first
+ *                    Get. Free objects are linked through their first bytes, getting and putting one is a
+ *                    pointer swap. Slabs are kept for the life of the process, so the pools grow to the
+ *                    peak number of busy connections and then serve every request without malloc. The
+ *                    pools of a process are only used by its event loop thread, they take no lock.
+ */
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+/*===================================  Includes ==============================*/
+#include <stddef.h>
+
+#include "ServerConfig.h"
+
+/*==================================  Definations =============================*/
+#define POOL_INITIALIZER(size) {(size), NULL, 0, 0}
+
+/*==================================  Structures =============================*/
+typedef struct Pool
+{
+    size_t Size;   // bytes of an object
+    void *Free;    // free objects, each starts with the pointer to the next one
+    size_t InUse;  // objects handed out
+    size_t Count;  // objects carved from the slabs
+} Pool;
+
+/*=================================  Prototypes ==============================*/
+void *Pool_Get(Pool *pool);
+void Pool_Put(Pool *pool, void *object);
+
+#endif
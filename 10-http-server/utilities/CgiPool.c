@@ -0,0 +1,765 @@
+/*
+ * File Name        : CgiPool.c
+ * Description      : Implements the persistent CGI worker pool.
+ * Functions        :
+ *                    - CgiPool_Submit: Queues a request on an idle, new or round-robin worker of the script.
+ *                    - CgiPool_Progress: Runs the exchanges of a worker until its socket would block, then
+ *                      checks the idle worker is still there.
+ *                    - CgiPool_Spawn: Forks and executes a one-shot script with its stdout on a pipe.
+ *                    - CgiPool_Release: Drops a call, a worker in the middle of its exchange is stopped.
+ *                    - StartWorker: Forks and executes a worker with its socket at CGI_WORKER_FD.
+ *                    - StopWorker: Kills and reaps a worker.
+ *                    - ReapWorker: Forgets an idle worker that exited, without waiting for it.
+ *                    - IsIdleAlive: Tells an idle worker's socket is open and silent.
+ *                    - Exchange: Sends the request of a call and receives its response, without blocking.
+ *                    - Drain: Reads the output of a one-shot script, then reaps it, without blocking.
+ *                    - StopScript: Kills and reaps a one-shot script, its slot is free once unwatched.
+ * Notes            : No worker is created per request and none is waited for: the event loop watches
+ *                    the worker sockets like the client ones. Completed calls are kept in a list until
+ *                    the loop takes them with CgiPool_Next, the connections are resumed from there.
+ *                    An idle worker stays watched, one that exits meanwhile is reaped and a new one is
+ *                    started when a call is given to it; a call whose worker failed before any byte of
+ *                    the response was read is sent once more to a fresh worker.
+ *                    A one-shot script has a slot of Spawned instead of a pool worker. Its exit is seen on
+ *                    a pidfd, so neither SIGCHLD nor a blocking wait is needed; a uring poll still queued
+ *                    keeps the slot until it completes, which the end of the script makes it do.
+ */
+
+/*===================================  Includes ==============================*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // pipe2
+#endif
+#include "CgiPool.h"
+#include "Metrics.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/*==================================  Definations =============================*/
+#define CGI_AGAIN 1 // Exchange: the socket would block, worker->Events tells for what
+
+/*============================  Static Variables ==============================*/
+static CgiScript Scripts[CGI_MAX_SCRIPTS];
+static size_t ScriptCount;
+static CgiWorker Spawned[CGI_MAX_SPAWNED]; // one-shot scripts running
+static CgiCall *Completed; // calls ended since the last CgiPool_Next, oldest first
+static CgiCall *CompletedTail;
+static void (*Watch)(CgiWorker *worker, int events); // event loop hook, NULL when calls are waited for
+
+/*============================  Function Implementation =======================*/
+static long long NowMs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+static void StopWorker(CgiWorker *worker)
+{
+    if (worker->Pid > 0)
+    {
+        if (Watch != NULL)
+        {
+            Watch(worker, 0);
+        }
+        kill(worker->Pid, SIGKILL);
+        waitpid(worker->Pid, NULL, 0);
+        close(worker->Fd);
+        Metrics_CgiWorkers(-1);
+    }
+    worker->Pid = 0;
+    worker->Fd = -1;
+    worker->Sent = worker->Received = 0;
+}
+
+static void ReapWorker(CgiWorker *worker)
+{
+    // exited on its own (an end of its script, a crash): its slot is free for a new worker; a busy one
+    // is left to its exchange, which fails and restarts it
+    if (worker->Pid > 0 && worker->Head == NULL && waitpid(worker->Pid, NULL, WNOHANG) == worker->Pid)
+    {
+        if (Watch != NULL)
+        {
+            Watch(worker, 0);
+        }
+        close(worker->Fd);
+        Metrics_CgiWorkers(-1);
+        worker->Pid = 0;
+        worker->Fd = -1;
+        worker->Sent = worker->Received = 0;
+    }
+}
+
+static int IsIdleAlive(CgiWorker *worker)
+{
+    // nothing is expected from an idle worker: an end of file, an error or unasked bytes all end it
+    char byte;
+    ssize_t bytes = recv(worker->Fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+}
+
+static int StartWorker(CgiWorker *worker)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) == -1)
+    {
+        perror("socketpair");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0)
+    {
+        // the worker goes away with the server process that owns it
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        signal(SIGPIPE, SIG_DFL);
+
+        // the socket must survive execv at its well known fd
+        if (sv[1] == CGI_WORKER_FD)
+        {
+            fcntl(sv[1], F_SETFD, 0);
+        }
+        else if (dup2(sv[1], CGI_WORKER_FD) == -1)
+        {
+            _exit(EXIT_FAILURE);
+        }
+
+        char *argv[] = {(char *)worker->Path, NULL};
+        execv(worker->Path, argv);
+        perror("execv");
+        _exit(EXIT_FAILURE);
+    }
+
+    close(sv[1]);
+    worker->Pid = pid;
+    worker->Fd = sv[0];
+    worker->Sent = worker->Received = 0;
+    Metrics_CgiWorkers(1);
+    return 0;
+}
+
+static void Enqueue(CgiWorker *worker, CgiCall *call)
+{
+    call->Worker = worker;
+    call->Next = NULL;
+    if (worker->Tail != NULL)
+    {
+        worker->Tail->Next = call;
+    }
+    else
+    {
+        worker->Head = call;
+        Metrics_CgiBusy(1);
+    }
+    worker->Tail = call;
+    worker->Queued++;
+}
+
+static void Unqueue(CgiWorker *worker, CgiCall *call)
+{
+    // the head is the call being exchanged, its successor starts from the first byte
+    CgiCall **link = &worker->Head;
+    CgiCall *prev = NULL;
+    while (*link != call)
+    {
+        prev = *link;
+        link = &(*link)->Next;
+    }
+    *link = call->Next;
+    if (worker->Tail == call)
+    {
+        worker->Tail = prev;
+    }
+    if (prev == NULL)
+    {
+        worker->Sent = worker->Received = 0;
+    }
+    if (--worker->Queued == 0)
+    {
+        Metrics_CgiBusy(-1);
+    }
+    call->Worker = NULL;
+    call->Next = NULL;
+}
+
+static void Complete(CgiCall *call, int status)
+{
+    // the caller finds it with CgiPool_Next
+    call->Status = status;
+    if (status != 200)
+    {
+        free(call->Body);
+        call->Body = NULL;
+        call->BodyLength = 0;
+    }
+    call->Listed = 1;
+    call->Next = NULL;
+    if (CompletedTail != NULL)
+    {
+        CompletedTail->Next = call;
+    }
+    else
+    {
+        Completed = call;
+    }
+    CompletedTail = call;
+}
+
+static int Exchange(CgiWorker *worker, CgiCall *call)
+{
+    CgiFrame request = {CGI_REQUEST, (uint32_t)call->RequestLength};
+    size_t total = sizeof(request) + call->RequestLength;
+
+    // the frame and the request head go out together, resumed where the socket filled up
+    while (worker->Sent < total)
+    {
+        struct iovec iov[2];
+        struct msghdr msg;
+        size_t skip = worker->Sent;
+        int count = 0;
+        if (skip < sizeof(request))
+        {
+            iov[count].iov_base = (char *)&request + skip;
+            iov[count++].iov_len = sizeof(request) - skip;
+            skip = 0;
+        }
+        else
+        {
+            skip -= sizeof(request);
+        }
+        iov[count].iov_base = (char *)call->Request + skip;
+        iov[count++].iov_len = call->RequestLength - skip;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t bytes = sendmsg(worker->Fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            worker->Events = POLLOUT;
+            return CGI_AGAIN;
+        }
+        if (bytes <= 0)
+        {
+            return 502; // the worker died or closed its socket
+        }
+        worker->Sent += bytes;
+    }
+
+    // then the response frame, and the body it announces
+    for (;;)
+    {
+        char *data;
+        size_t length;
+        if (worker->Received < sizeof(CgiFrame))
+        {
+            data = (char *)&worker->Frame + worker->Received;
+            length = sizeof(CgiFrame) - worker->Received;
+        }
+        else
+        {
+            if (worker->Frame.Type != CGI_RESPONSE || worker->Frame.Length > CGI_MAX_RESPONSE)
+            {
+                return 502;
+            }
+            if (call->Body == NULL && (call->Body = malloc(worker->Frame.Length + 1)) == NULL)
+            {
+                return 503;
+            }
+            size_t got = worker->Received - sizeof(CgiFrame);
+            if (got == worker->Frame.Length)
+            {
+                call->BodyLength = got;
+                return 200;
+            }
+            data = call->Body + got;
+            length = worker->Frame.Length - got;
+        }
+
+        ssize_t bytes = recv(worker->Fd, data, length, MSG_DONTWAIT);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            worker->Events = POLLIN;
+            return CGI_AGAIN;
+        }
+        if (bytes <= 0)
+        {
+            return 502;
+        }
+        worker->Received += bytes;
+    }
+}
+
+static int Drain(CgiWorker *worker, CgiCall *call)
+{
+    // the output of the script until it closes it, grown as it comes
+    while (worker->Fd != worker->PidFd)
+    {
+        if (call->BodyLength == worker->Capacity)
+        {
+            if (worker->Capacity == CGI_MAX_RESPONSE)
+            {
+                return 502;
+            }
+            size_t capacity = (worker->Capacity > 0) ? worker->Capacity * 2 : 4 * _1K;
+            if (capacity > CGI_MAX_RESPONSE)
+            {
+                capacity = CGI_MAX_RESPONSE;
+            }
+            char *body = realloc(call->Body, capacity + 1);
+            if (body == NULL)
+            {
+                return 503;
+            }
+            call->Body = body;
+            worker->Capacity = capacity;
+        }
+
+        ssize_t bytes = read(worker->Fd, call->Body + call->BodyLength, worker->Capacity - call->BodyLength);
+        if (bytes > 0)
+        {
+            call->BodyLength += bytes;
+            continue;
+        }
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            worker->Events = POLLIN;
+            return CGI_AGAIN;
+        }
+
+        // end of the output: the pidfd is watched in place of the pipe until the script exits
+        if (Watch != NULL)
+        {
+            Watch(worker, 0);
+        }
+        close(worker->Fd);
+        worker->Fd = worker->PidFd;
+    }
+
+    int status = 0;
+    pid_t pid = waitpid(worker->Pid, &status, WNOHANG);
+    if (pid == 0)
+    {
+        worker->Events = POLLIN;
+        return CGI_AGAIN;
+    }
+    worker->Pid = 0;
+
+    // the output is the answer, a failure only counts without any
+    if (call->BodyLength == 0 && (pid < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0))
+    {
+        return 500;
+    }
+    return 200;
+}
+
+static void StopScript(CgiWorker *worker)
+{
+    if (Watch != NULL)
+    {
+        Watch(worker, 0);
+    }
+    if (worker->Pid > 0)
+    {
+        kill(-worker->Pid, SIGKILL);
+        waitpid(worker->Pid, NULL, 0);
+    }
+    if (worker->Fd != worker->PidFd)
+    {
+        close(worker->Fd);
+    }
+    close(worker->PidFd);
+    worker->Pid = 0;
+    worker->Fd = worker->PidFd = -1;
+    worker->Head = worker->Tail = NULL;
+    worker->Capacity = 0;
+}
+
+static CgiScript *FindScript(const char *path)
+{
+    for (size_t i = 0; i < ScriptCount; ++i)
+    {
+        if (strcmp(Scripts[i].Path, path) == 0)
+        {
+            return &Scripts[i];
+        }
+    }
+
+    if (ScriptCount == CGI_MAX_SCRIPTS)
+    {
+        return NULL;
+    }
+    CgiScript *script = &Scripts[ScriptCount];
+    script->Path = strdup(path);
+    if (script->Path == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < CGI_MAX_POOL_SIZE; ++i)
+    {
+        memset(&script->Workers[i], 0, sizeof(CgiWorker));
+        script->Workers[i].Fd = -1;
+        script->Workers[i].Path = script->Path;
+    }
+    script->Next = 0;
+    ScriptCount++;
+    return script;
+}
+
+int CgiPool_Submit(CgiCall *call, const char *path, const char *request, size_t requestLength)
+{
+    memset(call, 0, sizeof(*call));
+    call->Request = request;
+    call->RequestLength = requestLength;
+
+    CgiScript *script = FindScript(path);
+    if (script == NULL)
+    {
+        return 503;
+    }
+
+    // an idle worker takes the call, then a new one while the script has fewer than cgi_workers,
+    // otherwise it waits behind the calls of the next worker in turn; the ones that exited are replaced
+    CgiWorker *worker = NULL;
+    for (int i = 0; i < Config->CgiWorkers && worker == NULL; ++i)
+    {
+        ReapWorker(&script->Workers[i]);
+        if (script->Workers[i].Pid > 0 && script->Workers[i].Head == NULL)
+        {
+            worker = &script->Workers[i];
+        }
+    }
+    for (int i = 0; i < Config->CgiWorkers && worker == NULL; ++i)
+    {
+        if (script->Workers[i].Pid == 0 && script->Workers[i].Head == NULL)
+        {
+            if (StartWorker(&script->Workers[i]) == -1)
+            {
+                return 503;
+            }
+            worker = &script->Workers[i];
+        }
+    }
+    if (worker == NULL)
+    {
+        // cgi_workers may have been lowered by a reload
+        if (script->Next >= (size_t)Config->CgiWorkers)
+        {
+            script->Next = 0;
+        }
+        worker = &script->Workers[script->Next];
+        script->Next = (script->Next + 1) % Config->CgiWorkers;
+    }
+
+    Enqueue(worker, call);
+    if (worker->Head == call)
+    {
+        CgiPool_Progress(worker);
+    }
+    return 0;
+}
+
+int CgiPool_Spawn(CgiCall *call, const char *path)
+{
+    memset(call, 0, sizeof(*call));
+
+    // a free slot, not watched anymore: a uring poll of its last script may still be queued
+    CgiWorker *worker = NULL;
+    for (size_t i = 0; i < CGI_MAX_SPAWNED && worker == NULL; ++i)
+    {
+        if (Spawned[i].Head == NULL && !Spawned[i].Watched)
+        {
+            worker = &Spawned[i];
+        }
+    }
+    if (worker == NULL)
+    {
+        return 503;
+    }
+
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == -1)
+    {
+        perror("pipe2");
+        return 503;
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return 503;
+    }
+    if (pid == 0)
+    {
+        // its own process group, so a timeout kills what it started too;
+        // dup2 clears the close-on-exec flag of stdout only
+        setpgid(0, 0);
+        signal(SIGPIPE, SIG_DFL);
+        if (dup2(pipefd[1], STDOUT_FILENO) == -1)
+        {
+            _exit(EXIT_FAILURE);
+        }
+        char *argv[] = {(char *)path, NULL};
+        execv(path, argv);
+
+        // nothing was written to the pipe yet, the empty output turns into an error
+        perror("execv");
+        _exit(EXIT_FAILURE);
+    }
+    close(pipefd[1]);
+
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd == -1)
+    {
+        perror("pidfd_open");
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        close(pipefd[0]);
+        return 503;
+    }
+    fcntl(pipefd[0], F_SETFL, O_NONBLOCK);
+
+    worker->OneShot = 1;
+    worker->Pid = pid;
+    worker->Fd = pipefd[0];
+    worker->PidFd = pidfd;
+    worker->Capacity = 0;
+    worker->Head = worker->Tail = call;
+    call->Worker = worker;
+    CgiPool_Progress(worker);
+    return 0;
+}
+
+void CgiPool_Progress(CgiWorker *worker)
+{
+    if (worker->OneShot)
+    {
+        if (worker->Head == NULL)
+        {
+            return; // a late poll completion, the slot is free already
+        }
+        CgiCall *call = worker->Head;
+        int status = Drain(worker, call);
+        if (status == CGI_AGAIN)
+        {
+            if (Watch != NULL)
+            {
+                Watch(worker, worker->Events);
+            }
+            return;
+        }
+        StopScript(worker);
+        call->Worker = NULL;
+        Complete(call, status);
+        return;
+    }
+
+    while (worker->Head != NULL)
+    {
+        // a worker that couldn't be restarted fails the calls left on it
+        int status = (worker->Pid > 0) ? Exchange(worker, worker->Head) : 503;
+        if (status == CGI_AGAIN)
+        {
+            if (Watch != NULL)
+            {
+                Watch(worker, worker->Events);
+            }
+            return;
+        }
+
+        CgiCall *call = worker->Head;
+        if (status == 502 && worker->Received == 0 && !call->Retried && worker->Pid > 0)
+        {
+            // nothing of the response was read, the worker was likely gone before the call reached
+            // it (it exited after its last answer): the call goes once more to a fresh worker
+            call->Retried = 1;
+            StopWorker(worker);
+            StartWorker(worker);
+            continue;
+        }
+
+        Unqueue(worker, call);
+        if (status != 200 && worker->Pid > 0)
+        {
+            // the worker can't be trusted to be in sync with the protocol anymore
+            fprintf(stderr, "SERVER: CGI worker %d of %s failed (%d), restarting it\n", worker->Pid, worker->Path,
+                    status);
+            StopWorker(worker);
+            if (worker->Head != NULL)
+            {
+                StartWorker(worker);
+            }
+        }
+        Complete(call, status);
+    }
+
+    // idle: its socket stays watched, so a worker that exits now is replaced before it gets a call
+    if (worker->Pid > 0 && !IsIdleAlive(worker))
+    {
+        StopWorker(worker);
+    }
+    else if (worker->Pid > 0 && Watch != NULL)
+    {
+        Watch(worker, POLLIN);
+    }
+}
+
+CgiCall *CgiPool_Next(void)
+{
+    CgiCall *call = Completed;
+    if (call != NULL)
+    {
+        Completed = call->Next;
+        if (Completed == NULL)
+        {
+            CompletedTail = NULL;
+        }
+        call->Next = NULL;
+        call->Listed = 0;
+    }
+    return call;
+}
+
+void CgiPool_Release(CgiCall *call, int status)
+{
+    // ended already: out of the completed list, the caller takes its result
+    if (call->Listed)
+    {
+        CgiCall **link = &Completed;
+        CgiCall *prev = NULL;
+        while (*link != call)
+        {
+            prev = *link;
+            link = &(*link)->Next;
+        }
+        *link = call->Next;
+        if (CompletedTail == call)
+        {
+            CompletedTail = prev;
+        }
+        call->Next = NULL;
+        call->Listed = 0;
+        return;
+    }
+
+    CgiWorker *worker = call->Worker;
+    if (worker == NULL)
+    {
+        return;
+    }
+    if (worker->OneShot)
+    {
+        // a script that hasn't ended is killed, its output so far is dropped
+        StopScript(worker);
+        call->Worker = NULL;
+        free(call->Body);
+        call->Body = NULL;
+        call->BodyLength = 0;
+        call->Status = status;
+        return;
+    }
+
+    // a worker with part of the exchange done would answer it late, it is replaced
+    int started = (worker->Head == call && (worker->Sent > 0 || worker->Received > 0));
+    Unqueue(worker, call);
+    if (started)
+    {
+        fprintf(stderr, "SERVER: CGI worker %d of %s stopped, its request was given up (%d)\n", worker->Pid,
+                worker->Path, status);
+        StopWorker(worker);
+        if (worker->Head != NULL)
+        {
+            StartWorker(worker);
+        }
+    }
+    if (worker->Head != NULL && worker->Sent == 0)
+    {
+        CgiPool_Progress(worker);
+    }
+
+    free(call->Body);
+    call->Body = NULL;
+    call->BodyLength = 0;
+    call->Status = status;
+}
+
+void CgiPool_Wait(CgiCall *call, int timeoutMs)
+{
+    long long deadline = NowMs() + timeoutMs;
+
+    // fork mode: the connection has nothing else to do, wait on the worker socket itself
+    while (call->Status == 0 && call->Worker != NULL)
+    {
+        CgiWorker *worker = call->Worker;
+        struct pollfd pfd = {worker->Fd, worker->Events, 0};
+        long long left = deadline - NowMs();
+        int ready = (left > 0) ? poll(&pfd, 1, (int)left) : 0;
+        if (ready == 0)
+        {
+            CgiPool_Release(call, 504);
+            return;
+        }
+        if (ready > 0)
+        {
+            CgiPool_Progress(worker);
+        }
+    }
+}
+
+void CgiPool_SetWatch(void (*watch)(CgiWorker *worker, int events))
+{
+    Watch = watch;
+}
+
+void CgiPool_Shutdown(void)
+{
+    for (size_t i = 0; i < ScriptCount; ++i)
+    {
+        for (size_t j = 0; j < CGI_MAX_POOL_SIZE; ++j)
+        {
+            StopWorker(&Scripts[i].Workers[j]);
+        }
+        free(Scripts[i].Path);
+    }
+    ScriptCount = 0;
+    for (size_t i = 0; i < CGI_MAX_SPAWNED; ++i)
+    {
+        if (Spawned[i].Head != NULL)
+        {
+            Spawned[i].Head->Worker = NULL;
+            StopScript(&Spawned[i]);
+        }
+    }
+    Completed = CompletedTail = NULL;
+}
@@ -0,0 +1,85 @@
+/*
+ * File Name        : CgiPool.h
+ * Description      : Pool of persistent CGI workers, started once per script and reused for every request.
+ * Functions        :
+ *                    - CgiPool_Submit: Queues a request on a worker of the script and starts sending it.
+ *                    - CgiPool_Spawn: Starts a one-shot ".cgi" script for a call, its output is the answer.
+ *                    - CgiPool_Progress: Moves the exchange of a worker on after an event on its socket.
+ *                    - CgiPool_Next: Returns the calls completed since the last time, one at a time.
+ *                    - CgiPool_Release: Detaches a call from the pool, ending it if it still runs.
+ *                    - CgiPool_Wait: Blocks until a call completes or times out, for the fork mode.
+ *                    - CgiPool_SetWatch: Installs the event loop hook watching the worker sockets.
+ *                    - CgiPool_Shutdown: Stops every worker of the process.
+ * Notes            : Workers speak the framed protocol of CgiProtocol.h over a socketpair. A worker
+ *                    serves the calls queued on it in order, its socket is never waited on: a send or
+ *                    receive that would block hands the socket to the Watch hook and the event loop
+ *                    calls CgiPool_Progress when it is ready, so one process keeps every worker busy.
+ *                    A call ends with Status 200 and its Body, or 502 (crash, protocol error), 503 (no
+ *                    worker could be started) or 504 (released by the caller's timeout); a worker that
+ *                    fails a call is killed and restarted for the calls behind it, and an idle worker
+ *                    that exits is replaced by the next call. The pool belongs to
+ *                    the process, every server worker has its own and the CGI workers exit with it (end
+ *                    of file on their socket, or PR_SET_PDEATHSIG). A one-shot script is driven the same
+ *                    way through a CgiWorker of its own: its stdout pipe, then its pidfd until it exits;
+ *                    a 500 tells it failed without any output.
+ */
+#ifndef CGI_POOL_H
+#define CGI_POOL_H
+
+/*===================================  Includes ==============================*/
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "ServerConfig.h"
+#include "CgiProtocol.h"
+
+/*==================================  Structures =============================*/
+typedef struct CgiCall
+{
+    struct CgiWorker *Worker; // worker the call is queued on, NULL once it ended
+    struct CgiCall *Next;     // next call of the worker queue or of the completed list
+    const char *Request;      // raw request head, kept by the caller until the call ends
+    size_t RequestLength;
+    char *Body;               // response body of a 200, freed by the caller
+    size_t BodyLength;
+    int Status;               // 0 while running, then 200, 500, 502, 503 or 504
+    int Listed;               // in the completed list, not returned by CgiPool_Next yet
+    int Retried;              // sent again to a fresh worker, the first one failed before answering
+} CgiCall;
+
+typedef struct CgiWorker
+{
+    pid_t Pid;          // 0 when not running
+    int Fd;             // server end of the socketpair
+    const char *Path;   // script, to restart the worker
+    CgiCall *Head;      // call being exchanged, the others wait behind it
+    CgiCall *Tail;
+    size_t Queued;
+    size_t Sent;        // bytes of the request frame and head sent for Head
+    size_t Received;    // bytes of the response frame and body received for Head
+    CgiFrame Frame;     // response frame of Head
+    short Events;       // POLLIN or POLLOUT, what the exchange waits for
+    int Watched;        // state of the Watch hook (registered socket, events of the queued poll)
+    int OneShot;        // runs a ".cgi" script for Head: Fd is its stdout, then PidFd once it's closed
+    int PidFd;
+    size_t Capacity;    // allocated size of the body of Head, for a one-shot script
+} CgiWorker;
+
+typedef struct CgiScript
+{
+    char *Path;
+    CgiWorker Workers[CGI_MAX_POOL_SIZE]; // Config->CgiWorkers are used
+    size_t Next; // round-robin dispatch once every worker is busy
+} CgiScript;
+
+/*=================================  Prototypes ==============================*/
+int CgiPool_Submit(CgiCall *call, const char *path, const char *request, size_t requestLength);
+int CgiPool_Spawn(CgiCall *call, const char *path);
+void CgiPool_Progress(CgiWorker *worker);
+CgiCall *CgiPool_Next(void);
+void CgiPool_Release(CgiCall *call, int status);
+void CgiPool_Wait(CgiCall *call, int timeoutMs);
+void CgiPool_SetWatch(void (*watch)(CgiWorker *worker, int events));
+void CgiPool_Shutdown(void);
+
+#endif
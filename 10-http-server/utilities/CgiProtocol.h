@@ -0,0 +1,100 @@
+/*
+ * File Name        : CgiProtocol.h
+ * Description      : Framed protocol spoken between the server and its persistent CGI workers.
+ * Functions        :
+ *                    - CgiWorker_ReadRequest: Worker side, waits for the next request.
+ *                    - CgiWorker_WriteResponse: Worker side, sends the body answering it.
+ * Notes            : A worker is a ".fcgi" program started once and kept running. It finds its end of a
+ *                    Unix stream socket at fd CGI_WORKER_FD and loops: read a CGI_REQUEST frame (the raw
+ *                    request head), write one CGI_RESPONSE frame (the HTML body). Each frame is a
+ *                    CgiFrame header in host byte order followed by Length payload bytes. The worker
+ *                    should exit when the socket reaches end of file, the server closed it.
+ *                    Workers only need this header:
+ *
+ *                        char request[8192];
+ *                        ssize_t length;
+ *                        while ((length = CgiWorker_ReadRequest(request, sizeof(request))) >= 0)
+ *                            CgiWorker_WriteResponse("Hello\n", 6);
+ */
+#ifndef CGI_PROTOCOL_H
+#define CGI_PROTOCOL_H
+
+/*===================================  Includes ==============================*/
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/*==================================  Definations =============================*/
+#define CGI_WORKER_FD 3 // socket of a worker, inherited from the server
+
+// frame types
+#define CGI_REQUEST 1  // server -> worker: raw request head
+#define CGI_RESPONSE 2 // worker -> server: response body
+
+/*==================================  Structures =============================*/
+typedef struct CgiFrame
+{
+    uint32_t Type;
+    uint32_t Length; // payload bytes following the header
+} CgiFrame;
+
+/*============================  Function Implementation =======================*/
+static inline int CgiWorker_Transfer(char *data, size_t length, int writing)
+{
+    while (length > 0)
+    {
+        ssize_t bytes = writing ? write(CGI_WORKER_FD, data, length) : read(CGI_WORKER_FD, data, length);
+        if (bytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytes <= 0)
+        {
+            return -1;
+        }
+        data += bytes;
+        length -= bytes;
+    }
+    return 0;
+}
+
+static inline ssize_t CgiWorker_ReadRequest(char *request, size_t size)
+{
+    CgiFrame frame;
+    char skip[256];
+
+    if (CgiWorker_Transfer((char *)&frame, sizeof(frame), 0) == -1 || frame.Type != CGI_REQUEST)
+    {
+        return -1;
+    }
+
+    // what doesn't fit the caller's buffer is read and dropped
+    size_t kept = (frame.Length < size) ? frame.Length : size;
+    if (CgiWorker_Transfer(request, kept, 0) == -1)
+    {
+        return -1;
+    }
+    for (size_t left = frame.Length - kept; left > 0;)
+    {
+        size_t chunk = (left < sizeof(skip)) ? left : sizeof(skip);
+        if (CgiWorker_Transfer(skip, chunk, 0) == -1)
+        {
+            return -1;
+        }
+        left -= chunk;
+    }
+    return (ssize_t)kept;
+}
+
+static inline int CgiWorker_WriteResponse(const char *body, size_t length)
+{
+    CgiFrame frame = {CGI_RESPONSE, (uint32_t)length};
+
+    if (CgiWorker_Transfer((char *)&frame, sizeof(frame), 1) == -1)
+    {
+        return -1;
+    }
+    return CgiWorker_Transfer((char *)body, length, 1);
+}
+
+#endif
@@ -0,0 +1,339 @@
+/*
+ * File Name        : DirListing.c
+ * Description      : Implements the directory listings.
+ * Functions        :
+ *                    - ReadEntries: Collects the entries of a directory with getdents64.
+ *                    - CompareEntries: Order of the entries for the requested sort.
+ *                    - DirListing_Render: Sorts the entries and formats the requested page.
+ *                    - RenderPage/PageLink: HTML of one page and of the links to its neighbours.
+ *                    - Append/AppendEscaped/AppendUrl: Growing output buffer of the page.
+ * Notes            : Names are HTML escaped, links are percent-encoded then HTML escaped and absolute
+ *                    so they work with or without a final slash in the directory path.
+ */
+
+/*===================================  Includes ==============================*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // qsort_r
+#endif
+#include "DirListing.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*==================================  Structures =============================*/
+typedef struct DirEntry
+{
+    size_t Name;          // offset of the name in the names buffer
+    unsigned char Type;   // DT_* of getdents64
+    long long Size;       // only read when sorting by size or time
+    long long Modified;   // nanoseconds
+} DirEntry;
+
+typedef struct Linux_Dirent64
+{
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} Linux_Dirent64;
+
+typedef struct Buffer
+{
+    char *Data;
+    size_t Length;
+    size_t Capacity;
+} Buffer;
+
+/*============================  Function Implementation =======================*/
+static int Reserve(Buffer *buffer, size_t length)
+{
+    if (buffer->Length + length <= buffer->Capacity)
+    {
+        return 0;
+    }
+
+    size_t capacity = (buffer->Capacity > 0) ? buffer->Capacity : 4096;
+    while (capacity < buffer->Length + length)
+    {
+        capacity *= 2;
+    }
+    char *data = realloc(buffer->Data, capacity);
+    if (data == NULL)
+    {
+        return -1;
+    }
+    buffer->Data = data;
+    buffer->Capacity = capacity;
+    return 0;
+}
+
+static int Append(Buffer *buffer, const char *format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (length < 0 || Reserve(buffer, length + 1) == -1)
+    {
+        return -1;
+    }
+
+    va_start(args, format);
+    vsnprintf(buffer->Data + buffer->Length, length + 1, format, args);
+    va_end(args);
+    buffer->Length += length;
+    return 0;
+}
+
+static int AppendEscaped(Buffer *buffer, const char *text)
+{
+    for (; *text != '\0'; ++text)
+    {
+        const char *escape = NULL;
+        switch (*text)
+        {
+        case '&':
+            escape = "&amp;";
+            break;
+        case '<':
+            escape = "&lt;";
+            break;
+        case '>':
+            escape = "&gt;";
+            break;
+        case '"':
+            escape = "&quot;";
+            break;
+        }
+
+        size_t length = (escape != NULL) ? strlen(escape) : 1;
+        if (Reserve(buffer, length) == -1)
+        {
+            return -1;
+        }
+        memcpy(buffer->Data + buffer->Length, (escape != NULL) ? escape : text, length);
+        buffer->Length += length;
+    }
+    return 0;
+}
+
+static int ReadEntries(int fd, int withStat, Buffer *names, DirEntry **entries, size_t *count)
+{
+    char records[64 * 1024];
+    size_t capacity = 0;
+
+    *entries = NULL;
+    *count = 0;
+    for (;;)
+    {
+        // one call returns as many records as fit, no per-entry allocation or call
+        long bytes = syscall(SYS_getdents64, fd, records, sizeof(records));
+        if (bytes < 0)
+        {
+            return -1;
+        }
+        if (bytes == 0)
+        {
+            return 0;
+        }
+
+        for (long offset = 0; offset < bytes;)
+        {
+            Linux_Dirent64 *record = (Linux_Dirent64 *)(records + offset);
+            offset += record->d_reclen;
+            if (strcmp(record->d_name, ".") == 0)
+            {
+                continue;
+            }
+
+            if (*count == capacity)
+            {
+                capacity = (capacity > 0) ? capacity * 2 : 256;
+                DirEntry *grown = realloc(*entries, capacity * sizeof(DirEntry));
+                if (grown == NULL)
+                {
+                    return -1;
+                }
+                *entries = grown;
+            }
+
+            size_t length = strlen(record->d_name) + 1;
+            if (Reserve(names, length) == -1)
+            {
+                return -1;
+            }
+            DirEntry *entry = &(*entries)[(*count)++];
+            entry->Name = names->Length;
+            entry->Type = record->d_type;
+            entry->Size = 0;
+            entry->Modified = 0;
+            memcpy(names->Data + names->Length, record->d_name, length);
+            names->Length += length;
+
+            struct stat sb;
+            if ((withStat || entry->Type == DT_UNKNOWN) &&
+                fstatat(fd, record->d_name, &sb, AT_SYMLINK_NOFOLLOW) == 0)
+            {
+                entry->Size = sb.st_size;
+                entry->Modified = sb.st_mtim.tv_sec * 1000000000LL + sb.st_mtim.tv_nsec;
+                if (entry->Type == DT_UNKNOWN && S_ISDIR(sb.st_mode))
+                {
+                    entry->Type = DT_DIR;
+                }
+            }
+        }
+    }
+}
+
+static int CompareEntries(const void *left, const void *right, void *argument)
+{
+    const DirEntry *a = left;
+    const DirEntry *b = right;
+    const DirQuery *query = ((void **)argument)[0];
+    const char *names = ((void **)argument)[1];
+
+    int order = 0;
+    if (query->Sort == LIST_BY_SIZE && a->Size != b->Size)
+    {
+        order = (a->Size < b->Size) ? -1 : 1;
+    }
+    else if (query->Sort == LIST_BY_TIME && a->Modified != b->Modified)
+    {
+        order = (a->Modified < b->Modified) ? -1 : 1;
+    }
+    else
+    {
+        order = strcmp(names + a->Name, names + b->Name);
+    }
+    return query->Descending ? -order : order;
+}
+
+int DirListing_FormatQuery(const DirQuery *query, char *text, size_t size)
+{
+    static const char *keys[] = {"name", "size", "mtime"};
+
+    return snprintf(text, size, "sort=%s&order=%s&per_page=%zu&page=%zu", keys[query->Sort],
+                    query->Descending ? "desc" : "asc", query->PerPage, query->Page);
+}
+
+static int AppendUrl(Buffer *buffer, const char *url)
+{
+    // everything but the unreserved characters and the separators is percent-encoded ('#', '?', '%', ' ')
+    for (const unsigned char *p = (const unsigned char *)url; *p != '\0'; ++p)
+    {
+        char encoded[4] = {(char)*p, '\0'};
+        if (!((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z') || (*p >= '0' && *p <= '9') ||
+              strchr("-._~/", *p) != NULL))
+        {
+            snprintf(encoded, sizeof(encoded), "%%%02X", *p);
+        }
+        if (AppendEscaped(buffer, encoded) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int PageLink(Buffer *page, const char *url, const DirQuery *query, size_t number, const char *label)
+{
+    char text[128];
+    DirQuery target = *query;
+
+    target.Page = number;
+    DirListing_FormatQuery(&target, text, sizeof(text));
+    if (Append(page, " <a href=\"") == -1 || AppendUrl(page, url) == -1 || Append(page, "?") == -1 ||
+        AppendEscaped(page, text) == -1)
+    {
+        return -1;
+    }
+    return Append(page, "\">%s</a>", label);
+}
+
+static int RenderPage(Buffer *page, const char *url, const DirQuery *query, const char *names,
+                      const DirEntry *entries, size_t count)
+{
+    size_t first = (query->Page - 1) * query->PerPage;
+    size_t last = (first < count) ? first + query->PerPage : first;
+    if (last > count)
+    {
+        last = count;
+    }
+    size_t pages = (count + query->PerPage - 1) / query->PerPage;
+    const char *separator = (url[0] != '\0' && url[strlen(url) - 1] == '/') ? "" : "/";
+
+    if (Append(page, "<html><body><h1>Directory Listing</h1><p>") == -1 || AppendEscaped(page, url) == -1 ||
+        Append(page, ": %zu entries, %zu to %zu shown</p><ul>", count, (first < last) ? first + 1 : 0,
+               (first < last) ? last : 0) == -1)
+    {
+        return -1;
+    }
+    for (size_t i = first; i < last; ++i)
+    {
+        const char *name = names + entries[i].Name;
+        const char *slash = (entries[i].Type == DT_DIR) ? "/" : "";
+        if (Append(page, "<li><a href=\"") == -1 || AppendUrl(page, url) == -1 ||
+            Append(page, "%s", separator) == -1 || AppendUrl(page, name) == -1 ||
+            Append(page, "%s\">", slash) == -1 || AppendEscaped(page, name) == -1 ||
+            Append(page, "%s</a></li>", slash) == -1)
+        {
+            return -1;
+        }
+    }
+    if (Append(page, "</ul><p>Page %zu of %zu", query->Page, pages) == -1 ||
+        (query->Page > 1 && PageLink(page, url, query, (query->Page <= pages) ? query->Page - 1 : pages,
+                                     "previous") == -1) ||
+        (query->Page < pages && PageLink(page, url, query, query->Page + 1, "next") == -1))
+    {
+        return -1;
+    }
+    return Append(page, "</p></body></html>");
+}
+
+int DirListing_Render(const char *path, const char *url, const DirQuery *query, char **html, size_t *length)
+{
+    Buffer names = {NULL, 0, 0};
+    Buffer page = {NULL, 0, 0};
+    DirEntry *entries = NULL;
+    size_t count = 0;
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    int ret = ReadEntries(fd, query->Sort != LIST_BY_NAME, &names, &entries, &count);
+    close(fd);
+    if (ret == 0 && count > 1)
+    {
+        void *argument[2] = {(void *)query, names.Data};
+        qsort_r(entries, count, sizeof(DirEntry), CompareEntries, argument);
+    }
+    if (ret == 0)
+    {
+        ret = RenderPage(&page, url, query, names.Data, entries, count);
+    }
+
+    free(names.Data);
+    free(entries);
+    if (ret == -1)
+    {
+        free(page.Data);
+        return -1;
+    }
+    *html = page.Data;
+    *length = page.Length;
+    return 0;
+}
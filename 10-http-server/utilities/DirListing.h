@@ -0,0 +1,39 @@
+/*
+ * File Name        : DirListing.h
+ * Description      : Renders the HTML listing of a directory, sorted and split in pages.
+ * Functions        :
+ *                    - DirListing_Render: Reads a whole directory and formats one page of it, linked under its URL.
+ *                    - DirListing_FormatQuery: Canonical text of a query, part of the cache key and ETag.
+ * Notes            : The entries are read with getdents64 into one growing buffer of names, there is no
+ *                    limit on their number. Sizes and times are only looked up (fstatat) when the listing
+ *                    is sorted by them. The page is rendered into a single heap buffer the caller owns,
+ *                    HttpUtils keeps it in the file cache until the directory changes.
+ */
+#ifndef DIR_LISTING_H
+#define DIR_LISTING_H
+
+/*===================================  Includes ==============================*/
+#include <stddef.h>
+
+#include "ServerConfig.h"
+
+/*==================================  Definations =============================*/
+// sort keys, the "sort" query parameter
+#define LIST_BY_NAME 0 // "name" (default)
+#define LIST_BY_SIZE 1 // "size"
+#define LIST_BY_TIME 2 // "mtime"
+
+/*==================================  Structures =============================*/
+typedef struct DirQuery
+{
+    int Sort;       // LIST_BY_*
+    int Descending; // "order=desc"
+    size_t Page;    // "page", from 1
+    size_t PerPage; // "per_page", up to LISTING_MAX_PAGE_SIZE
+} DirQuery;
+
+/*=================================  Prototypes ==============================*/
+int DirListing_Render(const char *path, const char *url, const DirQuery *query, char **html, size_t *length);
+int DirListing_FormatQuery(const DirQuery *query, char *text, size_t size);
+
+#endif
@@ -0,0 +1,385 @@
+/*
+ * File Name        : FileCache.c
+ * Description      : Implements the static file cache, a chained hash table over an LRU list.
+ * Functions        :
+ *                    - FileCache_Lookup: Finds a path, revalidates it against the file system when due.
+ *                    - FileCache_Insert: Copies a file to the heap.
+ *                    - FileCache_InsertCompressed: Stores the gzip compression of a file, done once.
+ *                    - FileCache_InsertData: Stores contents generated from a file or directory.
+ *                    - FileCache_SetOrigin: Records the identity of the file compressed by a .gz sibling.
+ *                    - FileCache_SetHeaders: Formats the headers sent with the entry.
+ *                    - FileCache_Release: Frees an entry once it is dropped and no longer sent.
+ *                    - FileCache_Clear: Drops every entry, the ones being sent are freed by their release.
+ *                    - Evict: Drops least recently used entries until a new one fits the limits.
+ * Notes            : The limits are the cache_entries, cache_bytes, cache_max_file and cache_revalidate
+ *                    settings of Config.
+ */
+
+/*===================================  Includes ==============================*/
+#include "FileCache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+/*============================  Static Variables ==============================*/
+static FileCacheEntry *Buckets[CACHE_BUCKETS];
+static FileCacheEntry *Newest; // head of the LRU list
+static FileCacheEntry *Oldest; // tail of the LRU list, evicted first
+static size_t EntryCount;
+static size_t CachedBytes;
+
+/*============================  Function Implementation =======================*/
+static unsigned int HashPath(const char *path)
+{
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)path; *p != '\0'; ++p)
+    {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
+static void Unlink(FileCacheEntry *entry)
+{
+    if (entry->Prev != NULL)
+    {
+        entry->Prev->Next = entry->Next;
+    }
+    else
+    {
+        Newest = entry->Next;
+    }
+
+    if (entry->Next != NULL)
+    {
+        entry->Next->Prev = entry->Prev;
+    }
+    else
+    {
+        Oldest = entry->Prev;
+    }
+
+    entry->Prev = entry->Next = NULL;
+}
+
+static void PushFront(FileCacheEntry *entry)
+{
+    entry->Prev = NULL;
+    entry->Next = Newest;
+    if (Newest != NULL)
+    {
+        Newest->Prev = entry;
+    }
+    else
+    {
+        Oldest = entry;
+    }
+    Newest = entry;
+}
+
+static void FreeEntry(FileCacheEntry *entry)
+{
+    free((void *)entry->Data);
+    free(entry->Headers);
+    free(entry->Origin);
+    free(entry->Source);
+    free(entry->Path);
+    free(entry);
+}
+
+static void Drop(FileCacheEntry *entry)
+{
+    // out of the table and the LRU list, freed with its last reference
+    FileCacheEntry **link = &Buckets[entry->Hash & (CACHE_BUCKETS - 1)];
+    while (*link != entry)
+    {
+        link = &(*link)->HashNext;
+    }
+    *link = entry->HashNext;
+
+    Unlink(entry);
+    EntryCount--;
+    CachedBytes -= entry->Size;
+    FileCache_Release(entry);
+}
+
+static void Evict(size_t size)
+{
+    while (Oldest != NULL && (EntryCount >= Config->CacheEntries || CachedBytes + size > Config->CacheBytes))
+    {
+        Drop(Oldest);
+    }
+}
+
+static int IsUnchanged(const FileCacheEntry *entry, const struct stat *sb)
+{
+    // a directory listing is checked against the directory, its mtime changes with the entries
+    return (S_ISREG(sb->st_mode) || S_ISDIR(sb->st_mode)) && sb->st_dev == entry->Device && sb->st_ino == entry->Inode &&
+           (size_t)sb->st_size == entry->SourceSize && sb->st_mtim.tv_sec == entry->Modified.tv_sec &&
+           sb->st_mtim.tv_nsec == entry->Modified.tv_nsec;
+}
+
+static int IsOriginUnchanged(const FileCacheEntry *entry)
+{
+    // a .gz sibling is only sent for the version of the file it was checked against
+    struct stat sb;
+    if (entry->Origin == NULL)
+    {
+        return 1;
+    }
+    return lstat(entry->Origin, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_dev == entry->OriginDevice &&
+           sb.st_ino == entry->OriginInode && (size_t)sb.st_size == entry->OriginSize &&
+           sb.st_mtim.tv_sec == entry->OriginModified.tv_sec && sb.st_mtim.tv_nsec == entry->OriginModified.tv_nsec;
+}
+
+static const char *LoadContents(int fd, size_t size)
+{
+    // a copy, unlike a mapping it stays valid when another program truncates the file;
+    // a file shorter than its stat isn't cached
+    char *data = malloc(size + 1);
+    if (data == NULL)
+    {
+        return NULL;
+    }
+    for (size_t done = 0; done < size;)
+    {
+        ssize_t bytes = pread(fd, data + done, size - done, done);
+        if (bytes <= 0)
+        {
+            free(data);
+            return NULL;
+        }
+        done += bytes;
+    }
+    return data;
+}
+
+FileCacheEntry *FileCache_Lookup(const char *path)
+{
+    unsigned int hash = HashPath(path);
+    FileCacheEntry *entry = Buckets[hash & (CACHE_BUCKETS - 1)];
+
+    while (entry != NULL && (entry->Hash != hash || strcmp(entry->Path, path) != 0))
+    {
+        entry = entry->HashNext;
+    }
+    if (entry == NULL)
+    {
+        return NULL;
+    }
+
+    // trust the entry for cache_revalidate seconds, then check its source is still the same file
+    time_t now = time(NULL);
+    if (now - entry->Checked >= Config->CacheRevalidate)
+    {
+        struct stat sb;
+        if (lstat(entry->Source, &sb) == -1 || !IsUnchanged(entry, &sb) || !IsOriginUnchanged(entry))
+        {
+            Drop(entry);
+            return NULL;
+        }
+        entry->Checked = now;
+    }
+
+    Unlink(entry);
+    PushFront(entry);
+    entry->Refs++;
+    return entry;
+}
+
+static FileCacheEntry *Store(const char *key, const char *source, const struct stat *sb, const char *data,
+                             size_t size)
+{
+    FileCacheEntry *old = FileCache_Lookup(key);
+    if (old != NULL)
+    {
+        // a newer version of the file replaces the entry
+        FileCache_Release(old);
+        Drop(old);
+    }
+    Evict(size);
+
+    FileCacheEntry *entry = calloc(1, sizeof(FileCacheEntry));
+    if (entry != NULL)
+    {
+        entry->Path = strdup(key);
+        entry->Source = strdup(source);
+    }
+    if (entry == NULL || entry->Path == NULL || entry->Source == NULL)
+    {
+        if (entry != NULL)
+        {
+            free(entry->Path);
+            free(entry->Source);
+            free(entry);
+        }
+        free((void *)data);
+        return NULL;
+    }
+
+    entry->Data = data;
+    entry->Size = size;
+    entry->Hash = HashPath(key);
+    entry->Device = sb->st_dev;
+    entry->Inode = sb->st_ino;
+    entry->SourceSize = sb->st_size;
+    entry->Modified = sb->st_mtim;
+    entry->Checked = time(NULL);
+    entry->Refs = 2; // the cache and the caller
+
+    FileCacheEntry **bucket = &Buckets[entry->Hash & (CACHE_BUCKETS - 1)];
+    entry->HashNext = *bucket;
+    *bucket = entry;
+    PushFront(entry);
+    EntryCount++;
+    CachedBytes += size;
+
+    return entry;
+}
+
+FileCacheEntry *FileCache_Insert(const char *key, const char *source, int fd, const struct stat *sb)
+{
+    size_t size = sb->st_size;
+    if (!S_ISREG(sb->st_mode) || size > Config->CacheMaxFile)
+    {
+        return NULL;
+    }
+
+    const char *data = LoadContents(fd, size);
+    if (data == NULL)
+    {
+        return NULL;
+    }
+    return Store(key, source, sb, data, size);
+}
+
+FileCacheEntry *FileCache_InsertCompressed(const char *key, const char *source, int fd, const struct stat *sb)
+{
+    z_stream stream;
+
+    size_t size = sb->st_size;
+    if (!S_ISREG(sb->st_mode) || size > Config->CacheMaxFile)
+    {
+        return NULL;
+    }
+
+    const char *data = LoadContents(fd, size);
+    if (data == NULL)
+    {
+        return NULL;
+    }
+
+    // windowBits 15 + 16 writes the gzip wrapper instead of the zlib one
+    memset(&stream, 0, sizeof(stream));
+    char *compressed = NULL;
+    size_t length = 0;
+    if (deflateInit2(&stream, GZIP_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK)
+    {
+        size_t bound = deflateBound(&stream, size);
+        compressed = malloc(bound);
+        if (compressed != NULL)
+        {
+            stream.next_in = (Bytef *)data;
+            stream.avail_in = size;
+            stream.next_out = (Bytef *)compressed;
+            stream.avail_out = bound;
+            if (deflate(&stream, Z_FINISH) == Z_STREAM_END)
+            {
+                length = stream.total_out;
+            }
+            else
+            {
+                free(compressed);
+                compressed = NULL;
+            }
+        }
+        deflateEnd(&stream);
+    }
+
+    free((void *)data);
+    if (compressed == NULL)
+    {
+        return NULL;
+    }
+    return Store(key, source, sb, compressed, length);
+}
+
+FileCacheEntry *FileCache_InsertData(const char *key, const char *source, char *data, size_t size,
+                                     const struct stat *sb)
+{
+    // generated contents, the cache owns the buffer from now on
+    if (size > Config->CacheMaxFile)
+    {
+        free(data);
+        return NULL;
+    }
+    return Store(key, source, sb, data, size);
+}
+
+int FileCache_SetOrigin(FileCacheEntry *entry, const char *origin, const struct stat *sb)
+{
+    entry->Origin = strdup(origin);
+    if (entry->Origin == NULL)
+    {
+        // without it the entry can't be revalidated, the caller still sends it
+        Drop(entry);
+        return -1;
+    }
+    entry->OriginDevice = sb->st_dev;
+    entry->OriginInode = sb->st_ino;
+    entry->OriginSize = sb->st_size;
+    entry->OriginModified = sb->st_mtim;
+    return 0;
+}
+
+int FileCache_SetHeaders(FileCacheEntry *entry, const char *type, const char *extra)
+{
+    char headers[_1K];
+
+    // the first response formats them, later ones reuse them
+    if (entry->Headers != NULL)
+    {
+        return 0;
+    }
+
+    int length = snprintf(headers, sizeof(headers),
+                          "HTTP/1.1 200 OK\r\n"
+                          "Content-Type: %s\r\n"
+                          "Content-Length: %zu\r\n"
+                          "%s",
+                          type, entry->Size, extra);
+    if (length < 0 || (size_t)length >= sizeof(headers))
+    {
+        return -1;
+    }
+
+    entry->Headers = malloc(length + 1);
+    if (entry->Headers == NULL)
+    {
+        return -1;
+    }
+    memcpy(entry->Headers, headers, length + 1);
+    entry->HeadersLength = length;
+    return 0;
+}
+
+void FileCache_Release(FileCacheEntry *entry)
+{
+    if (entry != NULL && --entry->Refs == 0)
+    {
+        FreeEntry(entry);
+    }
+}
+
+void FileCache_Clear(void)
+{
+    // the entries being sent stay alive until their last response is out
+    while (Oldest != NULL)
+    {
+        Drop(Oldest);
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ * File Name        : FileCache.h
+ * Description      : Bounded LRU cache of static files, holding their contents and pre-built response headers.
+ * Functions        :
+ *                    - FileCache_Lookup: Returns the cached file of a path, revalidated at most every cache_revalidate seconds.
+ *                    - FileCache_Insert: Loads an opened file into the cache.
+ *                    - FileCache_InsertCompressed: Loads an opened file into the cache gzip compressed.
+ *                    - FileCache_InsertData: Keeps a generated body (directory listing) until its source changes.
+ *                    - FileCache_SetOrigin: Ties an entry read from a .gz sibling to the file it compresses.
+ *                    - FileCache_SetHeaders: Pre-builds the response headers of an entry.
+ *                    - FileCache_Release: Drops a reference taken by FileCache_Lookup or FileCache_Insert.
+ *                    - FileCache_Clear: Drops every entry, after a reload changed the types or the limits.
+ * Notes            : Files are copied to the heap, a cached body stays valid whatever happens to its file.
+ *                    An entry is found by a key, the path of the file or the path followed by an encoding
+ *                    for the compressed variants, and revalidated against its source file.
+ *                    An entry is referenced by every connection sending it, so an evicted or changed
+ *                    entry is only freed once the last response using it is sent.
+ *                    The cache belongs to the process, every worker has its own.
+ */
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+/*===================================  Includes ==============================*/
+#include <stddef.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "ServerConfig.h"
+
+/*==================================  Structures =============================*/
+typedef struct FileCacheEntry
+{
+    char *Path;            // cache key
+    char *Source;          // file the contents come from, checked on revalidation
+    unsigned int Hash;
+    const char *Data;      // file contents, compressed for a compressed variant
+    size_t Size;
+    const char *Type;      // Content-Type of the source file (MimeTypes.h), set by the file server
+    char *Headers;         // status line, Content-Type, Content-Length and the extra header lines
+                           // (validators), without Connection and the final empty line
+    size_t HeadersLength;
+    dev_t Device;          // identity of the source file, compared on revalidation
+    ino_t Inode;
+    size_t SourceSize;
+    struct timespec Modified;
+    char *Origin;          // file a .gz sibling source compresses, NULL for other entries,
+                           // the entry is dropped when either file changes
+    dev_t OriginDevice;
+    ino_t OriginInode;
+    size_t OriginSize;
+    struct timespec OriginModified;
+    time_t Checked;        // last revalidation
+    int Refs;              // the cache's own reference plus one per connection sending it,
+                           // an entry dropped from the cache only waits for its last sender
+    struct FileCacheEntry *HashNext;
+    struct FileCacheEntry *Prev, *Next; // LRU list, most recently used first
+} FileCacheEntry;
+
+/*=================================  Prototypes ==============================*/
+FileCacheEntry *FileCache_Lookup(const char *path);
+FileCacheEntry *FileCache_Insert(const char *key, const char *source, int fd, const struct stat *sb);
+FileCacheEntry *FileCache_InsertCompressed(const char *key, const char *source, int fd, const struct stat *sb);
+FileCacheEntry *FileCache_InsertData(const char *key, const char *source, char *data, size_t size,
+                                     const struct stat *sb);
+int FileCache_SetOrigin(FileCacheEntry *entry, const char *origin, const struct stat *sb);
+int FileCache_SetHeaders(FileCacheEntry *entry, const char *type, const char *extra);
+void FileCache_Release(FileCacheEntry *entry);
+void FileCache_Clear(void);
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * File Name        : HttpParser.c
+ * Description      : Implements the incremental request head parser.
+ * Functions        :
+ *                    - HttpParser_Parse: Parses the complete lines received since the previous call.
+ *                    - ParseRequestLine: Splits and validates "METHOD SP path SP HTTP/1.x".
+ *                    - ParseHeaderLine: Splits and validates "name: value".
+ * Notes            : Line ends are found with memchr, which glibc implements with vector instructions,
+ *                    so the bytes are scanned 16 or 32 at a time and each byte only once. The fields of
+ *                    a line are checked with a lookup table of the token characters.
+ */
+
+/*===================================  Includes ==============================*/
+#include "HttpParser.h"
+
+#include <string.h>
+#include <strings.h>
+
+/*==================================  Definations =============================*/
+// tchar of RFC 9110: the characters allowed in methods and header names
+static const char *TokenChars = "!#$%&'*+-.^_`|~0123456789"
+                                "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+/*============================  Function Implementation =======================*/
+static int IsToken(unsigned char c)
+{
+    static unsigned char table[256];
+    static int ready = 0;
+
+    if (!ready)
+    {
+        for (const char *p = TokenChars; *p != '\0'; ++p)
+        {
+            table[(unsigned char)*p] = 1;
+        }
+        ready = 1;
+    }
+    return table[c];
+}
+
+static int Fail(HttpRequest *req, int code)
+{
+    req->Error = code;
+    req->State = PARSE_ERROR;
+    return PARSE_ERROR;
+}
+
+static HttpSlice Slice(size_t start, size_t end)
+{
+    HttpSlice slice = {(uint32_t)start, (uint32_t)(end - start)};
+    return slice;
+}
+
+static int ParseRequestLine(HttpRequest *req, const char *buf, size_t start, size_t end)
+{
+    size_t pos = start;
+
+    // method: a token followed by a single space
+    while (pos < end && IsToken(buf[pos]))
+    {
+        pos++;
+    }
+    if (pos == start || pos == end || buf[pos] != ' ')
+    {
+        return Fail(req, 400);
+    }
+    req->Method = Slice(start, pos);
+
+    // path: visible characters up to the next space
+    size_t pathStart = ++pos;
+    while (pos < end && (unsigned char)buf[pos] > ' ' && buf[pos] != 0x7f)
+    {
+        pos++;
+    }
+    if (pos == pathStart || pos == end || buf[pos] != ' ')
+    {
+        return Fail(req, 400);
+    }
+    req->Path = Slice(pathStart, pos);
+
+    // version: HTTP/1.x is the only one served
+    size_t versionStart = ++pos;
+    if (end - versionStart != 8 || memcmp(buf + versionStart, "HTTP/", 5) != 0 ||
+        buf[versionStart + 6] != '.' || buf[versionStart + 5] < '0' || buf[versionStart + 5] > '9' ||
+        buf[versionStart + 7] < '0' || buf[versionStart + 7] > '9')
+    {
+        return Fail(req, 400);
+    }
+    if (buf[versionStart + 5] != '1')
+    {
+        return Fail(req, 505);
+    }
+    req->Version = Slice(versionStart, end);
+    req->Minor = buf[versionStart + 7] - '0';
+
+    req->State = PARSE_HEADERS;
+    return PARSE_HEADERS;
+}
+
+static int ParseHeaderLine(HttpRequest *req, const char *buf, size_t start, size_t end)
+{
+    size_t pos = start;
+
+    // name: a token directly followed by the colon, a leading space is an obsolete line folding
+    while (pos < end && IsToken(buf[pos]))
+    {
+        pos++;
+    }
+    if (pos == start || pos == end || buf[pos] != ':')
+    {
+        return Fail(req, 400);
+    }
+    if (req->HeaderCount == HTTP_MAX_HEADERS)
+    {
+        return Fail(req, 431);
+    }
+
+    HttpHeader *header = &req->Headers[req->HeaderCount++];
+    header->Name = Slice(start, pos);
+
+    // value: without the optional spaces around it
+    size_t valueStart = pos + 1;
+    while (valueStart < end && (buf[valueStart] == ' ' || buf[valueStart] == '\t'))
+    {
+        valueStart++;
+    }
+    while (end > valueStart && (buf[end - 1] == ' ' || buf[end - 1] == '\t'))
+    {
+        end--;
+    }
+    header->Value = Slice(valueStart, end);
+
+    return PARSE_HEADERS;
+}
+
+void HttpParser_Init(HttpRequest *req)
+{
+    req->State = PARSE_REQUEST_LINE;
+    req->Pos = req->Scan = req->Length = 0;
+    req->Error = 0;
+    req->Minor = 0;
+    req->HeaderCount = 0;
+}
+
+int HttpParser_Parse(HttpRequest *req, const char *buf, size_t len, size_t capacity)
+{
+    while (req->State == PARSE_REQUEST_LINE || req->State == PARSE_HEADERS)
+    {
+        // resume the search for the line end where the previous call stopped
+        const char *newline = memchr(buf + req->Scan, '\n', len - req->Scan);
+        if (newline == NULL)
+        {
+            req->Scan = len;
+            if (len >= capacity)
+            {
+                // the line can't complete in the buffer
+                return Fail(req, (req->State == PARSE_REQUEST_LINE) ? 414 : 431);
+            }
+            return req->State;
+        }
+
+        size_t start = req->Pos;
+        size_t next = newline - buf + 1;
+        size_t end = next - 1;
+        if (end > start && buf[end - 1] == '\r')
+        {
+            end--; // CRLF, a bare LF is accepted too
+        }
+        req->Pos = req->Scan = next;
+
+        if (req->State == PARSE_REQUEST_LINE)
+        {
+            // empty lines before the request line are ignored
+            if (end > start)
+            {
+                ParseRequestLine(req, buf, start, end);
+            }
+        }
+        else if (end == start)
+        {
+            req->Length = next;
+            req->State = PARSE_DONE;
+        }
+        else
+        {
+            ParseHeaderLine(req, buf, start, end);
+        }
+    }
+
+    return req->State;
+}
+
+const HttpSlice *HttpParser_FindHeader(const HttpRequest *req, const char *buf, const char *name)
+{
+    for (size_t i = 0; i < req->HeaderCount; ++i)
+    {
+        if (HttpParser_Equals(buf, &req->Headers[i].Name, name))
+        {
+            return &req->Headers[i].Value;
+        }
+    }
+    return NULL;
+}
+
+int HttpParser_Equals(const char *buf, const HttpSlice *slice, const char *str)
+{
+    return strlen(str) == slice->Length && strncasecmp(buf + slice->Offset, str, slice->Length) == 0;
+}
+
+const char *HttpParser_Reason(int code)
+{
+    switch (code)
+    {
+    case 400:
+        return "Bad Request";
+    case 414:
+        return "URI Too Long";
+    case 431:
+        return "Request Header Fields Too Large";
+    case 505:
+        return "HTTP Version Not Supported";
+    default:
+        return "Error";
+    }
+}
@@ -0,0 +1,65 @@
+/*
+ * File Name        : HttpParser.h
+ * Description      : Incremental HTTP/1.x request head parser working in place on the connection buffer.
+ * Functions        :
+ *                    - HttpParser_Init: Resets the parser for a new request.
+ *                    - HttpParser_Parse: Resumes parsing with the bytes received so far.
+ *                    - HttpParser_FindHeader: Looks a header up by name.
+ *                    - HttpParser_Equals: Compares a slice with a string, ignoring case.
+ *                    - HttpParser_Reason: Reason phrase of the error a request is rejected with.
+ * Notes            : Nothing is copied, the method, path, version and headers are slices (offset and
+ *                    length) into the buffer. The parser keeps its position between calls, so the
+ *                    lines already parsed are not scanned again when more bytes arrive.
+ */
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+/*===================================  Includes ==============================*/
+#include <stddef.h>
+#include <stdint.h>
+
+/*==================================  Definations =============================*/
+#define HTTP_MAX_HEADERS 64 // more header lines are rejected with 431
+
+// parser states
+#define PARSE_REQUEST_LINE 0
+#define PARSE_HEADERS 1
+#define PARSE_DONE 2
+#define PARSE_ERROR 3
+
+/*==================================  Structures =============================*/
+typedef struct HttpSlice
+{
+    uint32_t Offset; // first byte in the buffer
+    uint32_t Length;
+} HttpSlice;
+
+typedef struct HttpHeader
+{
+    HttpSlice Name;
+    HttpSlice Value; // without the surrounding spaces
+} HttpHeader;
+
+typedef struct HttpRequest
+{
+    int State;     // PARSE_REQUEST_LINE, PARSE_HEADERS, PARSE_DONE or PARSE_ERROR
+    size_t Pos;    // start of the line being parsed, the bytes before it are done
+    size_t Scan;   // offset up to which the line was already searched for its end
+    size_t Length; // length of the request head (up to the empty line) once done
+    int Error;     // status code to reject the request with once PARSE_ERROR
+    HttpSlice Method;
+    HttpSlice Path;
+    HttpSlice Version;
+    int Minor; // x of HTTP/1.x
+    HttpHeader Headers[HTTP_MAX_HEADERS];
+    size_t HeaderCount;
+} HttpRequest;
+
+/*=================================  Prototypes ==============================*/
+void HttpParser_Init(HttpRequest *req);
+int HttpParser_Parse(HttpRequest *req, const char *buf, size_t len, size_t capacity);
+const HttpSlice *HttpParser_FindHeader(const HttpRequest *req, const char *buf, const char *name);
+int HttpParser_Equals(const char *buf, const HttpSlice *slice, const char *str);
+const char *HttpParser_Reason(int code);
+
+#endif
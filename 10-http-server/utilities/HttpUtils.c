@@ -11,24 +11,29 @@
 /*===================================  Includes ==============================*/
 #include "HttpUtils.h"
 
+/*============================  Static Variables ==============================*/
+static Pool Connections = POOL_INITIALIZER(sizeof(Connection));
+static Pool IoBuffers = POOL_INITIALIZER(SERVER_BUF);            // In, and Out until it grows larger
+static Pool Requests = POOL_INITIALIZER(sizeof(RequestState));
+static int Draining = 0; // the process is exiting, responses close their connection
+
 /*============================  Function Implementation =======================*/
 int SetServerSocket(char *port)
 {
     int opt = 1;
     struct sockaddr_in svaddr;
     int server_fd;
-    ssize_t numBytes;
-    char buf[SERVER_BUF];
 
     // Creating socket file descriptor
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
     {
         printf("SERVER: socket create failed (%s)\n", strerror(errno));
         exit(EXIT_FAILURE);
     }
 
-    // Forcefully attaching socket to the port
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &opt, sizeof(opt)))
+    // Forcefully attaching socket to the port, several workers may listen on it with their own socket
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)))
     {
         perror("setsockopt");
         exit(EXIT_FAILURE);
@@ -46,7 +51,7 @@ int SetServerSocket(char *port)
         exit(1);
     }
 
-    if (listen(server_fd, BACKLOG) == FALSE)
+    if (listen(server_fd, Config->Backlog) == FALSE)
     {
         printf("SERVER: listen failed (%s)\n", strerror(errno));
         exit(1);
@@ -58,269 +63,1586 @@ int SetServerSocket(char *port)
     return server_fd;
 }
 
-void Handle_Requests(int cfd)
+int SetNonBlocking(int fd)
 {
-    char RecBuf[SERVER_BUF] = {0};
-    char path[_1K / 4];
-    struct stat sb;
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == FALSE || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == FALSE)
+    {
+        perror("fcntl");
+        return FALSE;
+    }
+    return SUCESS;
+}
 
-    if ((read(cfd, RecBuf, sizeof(RecBuf) - 1)) < 0)
+int SetClientSocket(int fd)
+{
+    // responses are written in one go, don't let Nagle delay the tail of a keep-alive response
+    int option = 1;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option)) == FALSE)
     {
-        perror("Failed to read from client");
-        close(cfd);
-        exit(FALSE);
+        perror("setsockopt TCP_NODELAY");
+        return FALSE;
+    }
+    return SUCESS;
+}
+
+Connection *NewConnection(int fd)
+{
+    Connection *conn = Pool_Get(&Connections);
+    if (conn != NULL)
+    {
+        InitConnection(conn, fd);
+    }
+    return conn;
+}
+
+void FreeConnection(Connection *conn)
+{
+    ReleaseConnection(conn);
+    Pool_Put(&Connections, conn);
+}
+
+void InitConnections(void)
+{
+    // the pools are empty until the first connection, their buffers follow the configuration;
+    // once a slab is carved its buffers keep their size, a reload only resizes them in the master
+    if (IoBuffers.Count == 0)
+    {
+        IoBuffers.Size = Config->BufferSize;
     }
+}
+
+size_t OpenConnections(void)
+{
+    return Connections.InUse;
+}
 
-    ParsePath(RecBuf, path, sizeof(path));
-    printf("path: %s\n\n", path);
+void StopKeepAlive(void)
+{
+    Draining = 1;
+}
+
+void InitConnection(Connection *conn, int fd)
+{
+    memset(conn, 0, sizeof(*conn));
+    conn->Fd = fd;
+    conn->State = CONN_READING;
+    conn->FileFd = FALSE;
+    conn->KeepAlive = 1;
+    conn->Phase = TIMEOUT_NONE;
+    Metrics_Connection(1);
+}
 
-    if (lstat(path, &sb) == FALSE)
+int AcquireBuffers(Connection *conn)
+{
+    if (conn->In != NULL)
     {
-        ErrorResponse(cfd, 404, "Requested file is Not Found");
-        perror("lstat");
-        exit(EXIT_FAILURE);
+        return SUCESS;
     }
 
-    if (S_ISDIR(sb.st_mode))
+    conn->In = Pool_Get(&IoBuffers);
+    conn->Request = Pool_Get(&Requests);
+    if (conn->In == NULL || conn->Request == NULL)
     {
-        ListContent(cfd, path);
+        ReleaseBuffers(conn);
+        return FALSE;
     }
-    else if (S_ISREG(sb.st_mode))
+    HttpParser_Init(&conn->Request->Req);
+    conn->Request->ExtraLen = 0;
+    return SUCESS;
+}
+
+void ReleaseBuffers(Connection *conn)
+{
+    Pool_Put(&IoBuffers, conn->In);
+    Pool_Put(&Requests, conn->Request);
+    conn->In = NULL;
+    conn->Request = NULL;
+    conn->InLen = 0;
+
+    // a response larger than a pooled buffer grew Out on the heap
+    if (conn->OutCap == IoBuffers.Size)
     {
-        FileOperation(cfd, path);
+        Pool_Put(&IoBuffers, conn->Out);
     }
     else
     {
-        ErrorResponse(cfd, 403, "Forbidden");
+        free(conn->Out);
     }
+    conn->Out = NULL;
+    conn->OutLen = conn->OutSent = conn->OutCap = 0;
 }
 
-void CloseFd(int fd)
+void ReleaseConnection(Connection *conn)
 {
-    if (close(fd) == FALSE)
+    if (conn->FileFd != FALSE)
     {
-        printf("SERVER: close failed (%s)\n", strerror(errno));
-        exit(FALSE);
+        close(conn->FileFd);
+        conn->FileFd = FALSE;
+    }
+    WriteLog(conn); // a response cut short is logged too
+    FileCache_Release(conn->Cached);
+    conn->Cached = NULL;
+    // a request still with a CGI worker is dropped, the worker is restarted if it was answering it
+    CgiPool_Release(&conn->Cgi, 504);
+    free(conn->Cgi.Body);
+    conn->Cgi.Body = NULL;
+    ReleaseBuffers(conn);
+    if (conn->Fd != FALSE)
+    {
+        close(conn->Fd);
+        conn->Fd = FALSE;
+        Metrics_Connection(-1);
     }
+    conn->State = CONN_CLOSED;
 }
 
-void ParsePath(const char *buffer, char *path, size_t pathSize)
+int Handle_Requests(Connection *conn)
 {
-    // Ensure the inputs are valid
-    if (buffer == NULL || path == NULL)
+    // Run the connection state machine until it is done or the socket would block
+    while (conn->State != CONN_CLOSED)
     {
-        fprintf(stderr, "Invalid input to ParsePath function\n");
-        return;
+        if (conn->State == CONN_READING)
+        {
+            if (HasRequest(conn) == FALSE)
+            {
+                // answer the pipelined requests served so far before waiting for more
+                if (conn->OutLen > 0)
+                {
+                    conn->State = CONN_WRITING;
+                    continue;
+                }
+
+                int ret = ReadRequest(conn);
+                if (ret == AGAIN)
+                {
+                    break; // wait for the rest of the request
+                }
+                if (ret == FALSE)
+                {
+                    conn->State = CONN_CLOSED;
+                    break;
+                }
+            }
+
+            ServeRequest(conn);
+            if (conn->State == CONN_WAITING)
+            {
+                continue; // ExecuteWorker or ExecuteFile handed the request to a CGI process
+            }
+
+            // a streamed or cached file must go out before the next response is appended
+            if (conn->FileFd != FALSE || conn->Cached != NULL || !conn->KeepAlive)
+            {
+                conn->State = CONN_WRITING;
+            }
+        }
+        else if (conn->State == CONN_WAITING)
+        {
+            if (conn->Cgi.Status == 0)
+            {
+                break; // the loop runs the connection again when the worker answers or times out
+            }
+
+            // the request is answered like any other from here
+            conn->State = CONN_READING;
+            WorkerResponse(conn);
+            FinishResponse(conn);
+            ConsumeRequest(conn);
+            if (!conn->KeepAlive)
+            {
+                conn->State = CONN_WRITING;
+            }
+        }
+        else if (conn->State == CONN_WRITING)
+        {
+            int ret = FlushOutput(conn);
+            if (ret == AGAIN)
+            {
+                break; // wait until the socket is writable again
+            }
+
+            // the last response queued is out, its duration is known
+            WriteLog(conn);
+
+            // persistent connection: go back to the next request, maybe already buffered
+            conn->State = (ret == SUCESS && conn->KeepAlive) ? CONN_READING : CONN_CLOSED;
+        }
     }
 
-    // Find the first space (after the HTTP method)
-    const char *methodEnd = strchr(buffer, ' ');
-    if (methodEnd == NULL)
+    return conn->State;
+}
+
+int HasRequest(Connection *conn)
+{
+    if (conn->In == NULL)
     {
-        fprintf(stderr, "Invalid HTTP request format\n");
-        return;
+        return FALSE; // idle, nothing received
     }
 
-    // Find the second space (end of the path)
-    const char *pathEnd = strchr(methodEnd + 1, ' ');
-    if (pathEnd == NULL)
+    // parse the lines received since the previous call
+    int state = HttpParser_Parse(&conn->Request->Req, conn->In, conn->InLen, IoBuffers.Size - 1);
+    if (state == PARSE_DONE)
     {
-        fprintf(stderr, "Invalid HTTP request format\n");
-        return;
+        conn->ReqLen = conn->Request->Req.Length;
+        return SUCESS;
     }
 
-    // Calculate the length of the path and copy it to the output
-    size_t pathLength = pathEnd - (methodEnd + 1);
-    if (pathLength >= pathSize)
+    // malformed or too large, ServeRequest rejects it
+    if (state == PARSE_ERROR)
     {
-        fprintf(stderr, "Path buffer too small\n");
-        return;
+        conn->ReqLen = conn->InLen;
+        return SUCESS;
     }
-
-    strncpy(path, methodEnd + 1, pathLength);
-    path[pathLength] = '\0'; // Null-terminate the string
+    return FALSE;
 }
 
-void ListContent(int cfd, char *path)
+int ReadRequest(Connection *conn)
 {
-    char *Elements[MAX_ELEMENTS] = {NULL}; // Array to store filenames
-    size_t ElementNumber = 0;              // Counter for the number of elements
-    char response[_1K];
+    if (AcquireBuffers(conn) == FALSE)
+    {
+        return FALSE;
+    }
 
-    // Read directory entries and store filenames in Elements
-    if (read_directory(path, Elements, &ElementNumber) != SUCESS)
+    for (;;)
     {
-        ErrorResponse(cfd, 500, "Error in Reading Content");
-        printf("Error in Reading Content\n"); // Close the directory stream on error
-        exit(EXIT_FAILURE);
+        // drop the body of the previous request that arrived after it was answered
+        if (conn->Discard > 0 && conn->InLen > 0)
+        {
+            size_t drop = (conn->Discard < conn->InLen) ? conn->Discard : conn->InLen;
+            memmove(conn->In, conn->In + drop, conn->InLen - drop);
+            conn->InLen -= drop;
+            conn->Discard -= drop;
+        }
+
+        if (conn->Discard == 0 && HasRequest(conn) == SUCESS)
+        {
+            return SUCESS;
+        }
+
+        char *buf = conn->In + conn->InLen;
+        size_t space = IoBuffers.Size - 1 - conn->InLen;
+        ssize_t bytes = conn->Io.Active ? Uring_Read(&conn->Io, buf, space) : read(conn->Fd, buf, space);
+        if (bytes > 0)
+        {
+            if (conn->InLen == 0)
+            {
+                conn->RequestStart = AccessLog_Clock();
+            }
+            conn->InLen += bytes;
+            conn->Transferred += bytes;
+        }
+        else if (bytes == 0)
+        {
+            // peer closed before completing a request
+            return FALSE;
+        }
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            // between requests: the responses are sent and logged, the connection idles without buffers
+            if (conn->InLen == 0 && !conn->LogPending)
+            {
+                ReleaseBuffers(conn);
+            }
+            return AGAIN;
+        }
+        else if (errno != EINTR)
+        {
+            if (errno != ECONNRESET)
+            {
+                perror("Failed to read from client");
+            }
+            return FALSE;
+        }
     }
+}
+
+void ServeRequest(Connection *conn)
+{
+    char path[MAX_PATH_LENGTH];
+    char value[64];
+    struct stat sb;
 
-    snprintf(response, sizeof(response),
-             "HTTP/1.1 200 OK\r\n"
-             "Content-Type: text/html\r\n\r\n"
-             "<html><body><h1>Directory Listing</h1><ul>");
-    write(cfd, response, strlen(response));
+    conn->Status = 0;
+    conn->Head = 0;
+    conn->Request->ExtraLen = 0;
+    conn->Route = ROUTE_OTHER;
 
-    // Process and print information for each file
-    for (size_t i = 0; i < ElementNumber; ++i)
+    if (conn->Request->Req.State == PARSE_ERROR)
     {
-        snprintf(response, sizeof(response), "<li><a href=\"%s\">%s</a></li>", Elements[i], Elements[i]);
-        write(cfd, response, strlen(response));
+        // the rest of the buffer can't be delimited, answer and close
+        conn->KeepAlive = 0;
+        ErrorResponse(conn, conn->Request->Req.Error, (char *)HttpParser_Reason(conn->Request->Req.Error));
+        FinishResponse(conn);
+        ConsumeRequest(conn);
+        return;
     }
 
-    // Cleanup
-    cleanup(Elements, ElementNumber);
-}
+    // HTTP/1.1 connections persist unless the client closes them, HTTP/1.0 ones only on request
+    int http10 = (conn->Request->Req.Minor == 0);
+    if (FindHeader(conn, "Connection", value, sizeof(value)) == SUCESS)
+    {
+        if (strcasecmp(value, "close") == 0)
+        {
+            conn->KeepAlive = 0;
+        }
+        else if (strcasecmp(value, "keep-alive") == 0 && http10)
+        {
+            http10 = 0;
+        }
+    }
+    if (http10 || Draining)
+    {
+        conn->KeepAlive = 0;
+    }
 
-int read_directory(const char *path, char *Elements[], size_t *elementCount)
-{
-    DIR *dp = opendir(path); // Open directory
-    if (dp == NULL)
+    // a chunked body (or any other transfer coding) isn't decoded, it can't be skipped to the next request
+    int chunked = (FindHeader(conn, "Transfer-Encoding", value, sizeof(value)) == SUCESS);
+    if (chunked)
     {
-        return FALSE; // Failed to open directory
+        conn->KeepAlive = 0;
     }
 
-    struct dirent *entry;
-    while ((entry = readdir(dp)) != NULL)
+    // a request body isn't used, it is skipped to find the next request
+    if (!chunked && FindHeader(conn, "Content-Length", value, sizeof(value)) == SUCESS)
     {
-        // Check if the number of elements has reached the maximum limit
-        if (*elementCount >= MAX_ELEMENTS)
+        char *end;
+        conn->Discard = strtoull(value, &end, 10);
+        if (*end != '\0' || value[0] < '0' || value[0] > '9')
         {
-            fprintf(stderr, "Too many elements\n");
-            closedir(dp); // Close directory before returning
-            return FALSE;
+            conn->KeepAlive = 0;
+            conn->Discard = 0;
+            ErrorResponse(conn, 400, "Bad Request");
+            FinishResponse(conn);
+            ConsumeRequest(conn);
+            return;
         }
+    }
 
-        // Allocate memory for storing the file name
-        Elements[*elementCount] = malloc(strlen(entry->d_name) + 1);
-        if (Elements[*elementCount] == NULL)
+    // only GET and HEAD are served, a HEAD response is the GET one without its body
+    const HttpSlice *method = &conn->Request->Req.Method;
+    conn->Head = (method->Length == 4 && memcmp(conn->In + method->Offset, "HEAD", 4) == 0);
+    int get = conn->Head || (method->Length == 3 && memcmp(conn->In + method->Offset, "GET", 3) == 0);
+
+    if (!get)
+    {
+        ErrorResponse(conn, 501, "Not Implemented");
+    }
+    else if (chunked)
+    {
+        ErrorResponse(conn, 411, "Length Required");
+    }
+    else if (ParsePath(conn, path, sizeof(path)) == FALSE)
+    {
+        ErrorResponse(conn, 414, "URI Too Long");
+    }
+    else if (strcmp(path + Config->RootLength, METRICS_PATH) == 0)
+    {
+        MetricsResponse(conn);
+    }
+    else if (EscapesRoot(path + Config->RootLength))
+    {
+        ErrorResponse(conn, 403, "Forbidden");
+    }
+    else if (ServeCached(conn, path) == FALSE)
+    {
+        if (lstat(path, &sb) == FALSE)
+        {
+            ErrorResponse(conn, 404, "Requested file is Not Found");
+        }
+        else if (S_ISDIR(sb.st_mode))
         {
-            perror("malloc error");
-            closedir(dp); // Close directory before returning
-            return -1;
+            ListContent(conn, path, &sb);
         }
-        strcpy(Elements[*elementCount], entry->d_name); // Copy filename
-        (*elementCount)++;
+        else if (S_ISREG(sb.st_mode))
+        {
+            FileOperation(conn, path);
+        }
+        else
+        {
+            ErrorResponse(conn, 403, "Forbidden");
+        }
+    }
+
+    // a CGI worker or script answers later, Handle_Requests finishes the response then
+    if (conn->State == CONN_WAITING)
+    {
+        return;
     }
+    FinishResponse(conn);
+    ConsumeRequest(conn);
+}
+
+void ConsumeRequest(Connection *conn)
+{
+    LogResponse(conn);
+
+    // keep the pipelined bytes that follow the request (and its body) for the next one
+    size_t used = conn->ReqLen;
+    size_t body = conn->InLen - used;
+    if (body > conn->Discard)
+    {
+        body = conn->Discard;
+    }
+    used += body;
+    conn->Discard -= body;
 
-    closedir(dp);  // Close directory
-    return SUCESS; // Success
+    memmove(conn->In, conn->In + used, conn->InLen - used);
+    conn->InLen -= used;
+    conn->ReqLen = 0;
+    conn->Requests++;
+    HttpParser_Init(&conn->Request->Req);
+    if (conn->InLen > 0)
+    {
+        conn->RequestStart = AccessLog_Clock(); // the next pipelined request is already here
+    }
 }
 
-void cleanup(char *Elements[], size_t elementCount)
+void LogResponse(Connection *conn)
 {
-    for (size_t i = 0; i < elementCount; ++i)
+    // a previous response still queued behind this one is logged as it is
+    WriteLog(conn);
+
+    AccessRecord *log = &conn->Request->Log;
+    const HttpRequest *req = &conn->Request->Req;
+    const char *buf = conn->In;
+    size_t length = req->Method.Length;
+    if (req->State == PARSE_ERROR || length >= sizeof(log->Method))
+    {
+        length = 0;
+    }
+    memcpy(log->Method, buf + req->Method.Offset, length);
+    log->Method[length] = '\0';
+
+    length = (req->State == PARSE_ERROR) ? 0 : req->Path.Length;
+    if (length >= sizeof(log->Path))
     {
-        free(Elements[i]); // Free allocated memory for each filename
+        length = sizeof(log->Path) - 1;
     }
+    memcpy(log->Path, buf + req->Path.Offset, length);
+    log->Path[length] = '\0';
+
+    // headers and body built in Out, plus what is sent from the file or the cache after them
+    log->Status = conn->Status;
+    log->Bytes = (conn->OutLen - conn->BodyStart) + conn->FileRemaining +
+                 ((conn->Cached != NULL) ? conn->CachedEnd - conn->CachedSent : 0);
+    log->Client = conn->Peer;
+    conn->LogStart = conn->RequestStart;
+    conn->LogRoute = conn->Route;
+    conn->LogPending = 1;
 }
 
-void ErrorResponse(int cfd, int code, char *message)
+void WriteLog(Connection *conn)
 {
-    char response[_1K];
-    snprintf(response, sizeof(response),
-             "HTTP/1.1 %d %s\r\n"
-             "Content-Type: text/html\r\n\r\n"
-             "<html><body><h1>%d %s</h1></body></html>",
-             code, message, code, message);
-    write(cfd, response, strlen(response));
+    if (!conn->LogPending)
+    {
+        return;
+    }
+    conn->LogPending = 0;
+    conn->Request->Log.Duration = AccessLog_Clock() - conn->LogStart;
+    clock_gettime(CLOCK_REALTIME, &conn->Request->Log.Time);
+    AccessLog_Write(&conn->Request->Log);
+    Metrics_Response(conn->LogRoute, conn->Request->Log.Status, conn->Request->Log.Bytes, conn->Request->Log.Duration);
 }
 
-void FileOperation(int cfd, char *path)
+int UpdateTimeout(Connection *conn)
 {
-    char *ret = strstr(path, ".cgi");
-    if (ret != NULL)
+    // the phase follows what the connection is waiting for
+    int phase;
+    if (conn->State == CONN_WAITING)
     {
-        ExecuteFile(cfd, path);
+        phase = TIMEOUT_CGI;
+    }
+    else if (conn->State == CONN_WRITING)
+    {
+        phase = TIMEOUT_WRITE;
+    }
+    else if (conn->Discard > 0)
+    {
+        phase = TIMEOUT_BODY;
+    }
+    else if (conn->InLen > 0 || conn->Requests == 0)
+    {
+        phase = TIMEOUT_HEADER; // a new connection must send its first request in time too
     }
     else
     {
-        CatFile(cfd, path);
+        phase = TIMEOUT_IDLE;
+    }
+
+    // a head trickled in byte by byte doesn't move its deadline, body and response bytes do
+    size_t mark = (phase == TIMEOUT_BODY || phase == TIMEOUT_WRITE) ? conn->Transferred : conn->Requests;
+    if (phase == conn->Phase && mark == conn->PhaseMark)
+    {
+        return 0; // the running deadline is kept
+    }
+    conn->Phase = phase;
+    conn->PhaseMark = mark;
+
+    switch (phase)
+    {
+    case TIMEOUT_CGI:
+        return Config->CgiTimeoutMs;
+    case TIMEOUT_WRITE:
+        return Config->WriteTimeout * 1000;
+    case TIMEOUT_BODY:
+        return Config->BodyTimeout * 1000;
+    case TIMEOUT_HEADER:
+        return Config->HeaderTimeout * 1000;
+    default:
+        return Config->KeepAliveTimeout * 1000;
+    }
+}
+
+int FindHeader(Connection *conn, const char *name, char *value, size_t valueSize)
+{
+    const HttpSlice *slice = HttpParser_FindHeader(&conn->Request->Req, conn->In, name);
+    if (slice == NULL)
+    {
+        return FALSE;
+    }
+
+    // copied as a C string, truncated to the value buffer
+    size_t length = slice->Length;
+    if (length >= valueSize)
+    {
+        length = valueSize - 1;
+    }
+    memcpy(value, conn->In + slice->Offset, length);
+    value[length] = '\0';
+    return SUCESS;
+}
+
+int FindQuery(Connection *conn, const char *name, char *value, size_t valueSize)
+{
+    const char *target = conn->In + conn->Request->Req.Path.Offset;
+    const char *end = target + conn->Request->Req.Path.Length;
+    const char *param = memchr(target, '?', conn->Request->Req.Path.Length);
+    size_t nameLength = strlen(name);
+
+    // "name=value" pairs separated by '&', the first match wins
+    while (param != NULL && param < end)
+    {
+        param++;
+        const char *next = memchr(param, '&', end - param);
+        if (next == NULL)
+        {
+            next = end;
+        }
+        if ((size_t)(next - param) > nameLength && strncmp(param, name, nameLength) == 0 &&
+            param[nameLength] == '=')
+        {
+            size_t length = next - param - nameLength - 1;
+            if (length >= valueSize)
+            {
+                length = valueSize - 1;
+            }
+            memcpy(value, param + nameLength + 1, length);
+            value[length] = '\0';
+            return SUCESS;
+        }
+        param = next;
     }
+    return FALSE;
+}
+
+void StartResponse(Connection *conn, int code, const char *reason, const char *type)
+{
+    // the headers are inserted by FinishResponse once the body length is known
+    conn->Status = code;
+    conn->Reason = reason;
+    conn->ContentType = type;
+    conn->BodyStart = conn->OutLen;
+    conn->FileRemaining = 0;
 }
 
-void ExecuteFile(int cfd, char *path)
+void FinishResponse(Connection *conn)
 {
-    int pid;
+    char headers[_1K];
+    RequestState *request = conn->Request;
+    size_t body = conn->OutLen - conn->BodyStart;
+    int length;
+
+    if (conn->Cached != NULL && conn->Status == 200 && conn->Cached->Headers != NULL)
+    {
+        // the cached file comes with its status line, type, length and validators already formatted
+        length = snprintf(headers, sizeof(headers), "%sConnection: %s\r\n\r\n", conn->Cached->Headers,
+                          conn->KeepAlive ? "keep-alive" : "close");
+    }
+    else if (conn->Status == 304)
+    {
+        // no body and no Content-Length, it would announce the length of the unsent representation
+        length = snprintf(headers, sizeof(headers),
+                          "HTTP/1.1 304 Not Modified\r\n"
+                          "%.*s"
+                          "Connection: %s\r\n\r\n",
+                          (int)request->ExtraLen, request->Extra, conn->KeepAlive ? "keep-alive" : "close");
+    }
+    else
+    {
+        length = snprintf(headers, sizeof(headers),
+                          "HTTP/1.1 %d %s\r\n"
+                          "Content-Type: %s\r\n"
+                          "Content-Length: %llu\r\n"
+                          "%.*s"
+                          "Connection: %s\r\n\r\n",
+                          conn->Status, conn->Reason, conn->ContentType,
+                          (unsigned long long)(body + conn->FileRemaining +
+                                               (conn->Cached ? conn->CachedEnd - conn->CachedSent : 0)),
+                          (int)request->ExtraLen, request->Extra, conn->KeepAlive ? "keep-alive" : "close");
+    }
 
-    int pipefd[2];
-    if (pipe(pipefd) == FALSE)
+    if (ReserveOutput(conn, length) == FALSE)
     {
-        ErrorResponse(cfd, 500, "Error in pipe");
+        conn->KeepAlive = 0;
         return;
     }
+    memmove(conn->Out + conn->BodyStart + length, conn->Out + conn->BodyStart, body);
+    memcpy(conn->Out + conn->BodyStart, headers, length);
+    conn->OutLen += length;
 
-    pid = fork();
-    if (pid < 0)
+    // HEAD: the headers announce the body of a GET, nothing of it is sent
+    if (conn->Head)
     {
-        ErrorResponse(cfd, 404, "Error in fork");
-        perror("Error in fork");
-        exit(EXIT_FAILURE);
+        conn->OutLen = conn->BodyStart + length;
+        if (conn->FileFd != FALSE)
+        {
+            close(conn->FileFd);
+            conn->FileFd = FALSE;
+            conn->FileRemaining = 0;
+            SetCork(conn->Fd, 0);
+        }
+        FileCache_Release(conn->Cached);
+        conn->Cached = NULL;
+        conn->CachedSent = conn->CachedEnd = 0;
+        return;
     }
-    // child
-    else if (pid == 0)
+
+    // a small cached body is copied after its headers, the next pipelined response can follow it
+    if (conn->Cached != NULL && conn->CachedEnd - conn->CachedSent <= CACHE_INLINE_SIZE &&
+        AppendOutput(conn, conn->Cached->Data + conn->CachedSent, conn->CachedEnd - conn->CachedSent) == SUCESS)
     {
-        close(pipefd[0]);               // close output fd
-        dup2(pipefd[1], STDOUT_FILENO); // redirect stdout of child to the output of pipe into child
-        close(pipefd[1]);
+        FileCache_Release(conn->Cached);
+        conn->Cached = NULL;
+    }
+}
 
-        // Execute the CGI script (provide absolute path if needed)
-        char *argv[] = {path, NULL}; // The path to the CGI script
-        execv(path, argv);
+void AddHeader(Connection *conn, const char *format, ...)
+{
+    va_list args;
+    RequestState *request = conn->Request;
 
-        ErrorResponse(cfd, 404, "Error in execv child process");
-        perror("execvp");
-        exit(EXIT_FAILURE);
+    // extra header lines of the response being built, silently dropped when they don't fit
+    va_start(args, format);
+    int length = vsnprintf(request->Extra + request->ExtraLen, sizeof(request->Extra) - request->ExtraLen, format, args);
+    va_end(args);
+
+    if (length > 0 && request->ExtraLen + length < sizeof(request->Extra))
+    {
+        request->ExtraLen += length;
     }
-    // parent
     else
     {
-        close(pipefd[1]); // Close unused write end, we will write into cfd
-        char buffer[_1K];
-        ssize_t bytes_read;
+        request->Extra[request->ExtraLen] = '\0';
+    }
+}
+
+const char *CachePolicy(const char *path)
+{
+    static const struct
+    {
+        const char *Prefix;
+        const char *Policy;
+    } policies[] = CACHE_POLICIES;
+
+    // the first matching prefix wins
+    for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); ++i)
+    {
+        if (strncmp(path, policies[i].Prefix, strlen(policies[i].Prefix)) == 0)
+        {
+            return policies[i].Policy;
+        }
+    }
+    return NULL;
+}
+
+void FormatETag(char *etag, size_t etagSize, ino_t inode, off_t size, struct timespec modified, int gzip)
+{
+    // the tag changes whenever the file is replaced, resized or written, and differs per encoding
+    snprintf(etag, etagSize, "\"%llx-%llx-%llx%s\"", (unsigned long long)inode, (unsigned long long)size,
+             (unsigned long long)modified.tv_sec * 1000000000ULL + modified.tv_nsec, gzip ? "-gz" : "");
+}
+
+int CheckConditional(Connection *conn, const char *path, const char *etag, struct timespec modified)
+{
+    char date[64];
+    char value[_1K / 2];
+    struct tm tm;
 
-        // Write HTTP response headers
-        const char *response = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n\r\n";
-        write(cfd, response, strlen(response));
+    gmtime_r(&modified.tv_sec, &tm);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
 
-        // Read from pipe and write to client
-        while ((bytes_read = read(pipefd[0], buffer, sizeof(buffer))) > 0)
+    AddHeader(conn, "ETag: %s\r\nLast-Modified: %s\r\n", etag, date);
+    const char *policy = CachePolicy(path);
+    if (policy != NULL)
+    {
+        AddHeader(conn, "Cache-Control: %s\r\n", policy);
+    }
+
+    int current = 0;
+    if (FindHeader(conn, "If-None-Match", value, sizeof(value)) == SUCESS)
+    {
+        // a list of entity tags, compared weakly as GET allows
+        for (char *save, *tag = strtok_r(value, ",", &save); tag != NULL; tag = strtok_r(NULL, ",", &save))
         {
-            write(cfd, buffer, bytes_read);
+            tag += strspn(tag, " \t");
+            tag[strcspn(tag, " \t")] = '\0';
+            if (strncmp(tag, "W/", 2) == 0)
+            {
+                tag += 2;
+            }
+            if (strcmp(tag, "*") == 0 || strcmp(tag, etag) == 0)
+            {
+                current = 1;
+                break;
+            }
         }
+    }
+    else if (FindHeader(conn, "If-Modified-Since", value, sizeof(value)) == SUCESS)
+    {
+        // only used without If-None-Match, the date has a one second resolution
+        memset(&tm, 0, sizeof(tm));
+        char *end = strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        current = (end != NULL && *end == '\0' && modified.tv_sec <= timegm(&tm));
+    }
 
-        close(pipefd[0]); // Close read end of pipe
-        int status = 0;
-        wait(&status); // Wait for child process to complete
+    if (!current)
+    {
+        return FALSE;
     }
+
+    StartResponse(conn, 304, "Not Modified", NULL);
+    return SUCESS;
 }
 
-void CatFile(int cfd, char *path)
+int ReserveOutput(Connection *conn, size_t length)
 {
-    int fd = open(path, O_RDONLY);
-    if (fd < 0)
+    if (conn->OutLen + length <= conn->OutCap)
     {
-        ErrorResponse(cfd, 500, "Error in Reading File");
-        return;
+        return SUCESS;
+    }
+
+    size_t cap = (conn->OutCap == 0) ? IoBuffers.Size : conn->OutCap;
+    while (cap < conn->OutLen + length)
+    {
+        cap *= 2;
+    }
+
+    // most responses fit a pooled buffer, larger ones move to the heap (OutCap above IoBuffers.Size)
+    char *out;
+    if (cap == IoBuffers.Size)
+    {
+        out = Pool_Get(&IoBuffers);
+    }
+    else if (conn->OutCap == IoBuffers.Size)
+    {
+        out = malloc(cap);
+        if (out != NULL)
+        {
+            memcpy(out, conn->Out, conn->OutLen);
+            Pool_Put(&IoBuffers, conn->Out);
+        }
     }
+    else
+    {
+        out = realloc(conn->Out, cap);
+    }
+    if (out == NULL)
+    {
+        perror("realloc");
+        return FALSE;
+    }
+    conn->Out = out;
+    conn->OutCap = cap;
+    return SUCESS;
+}
+
+int AppendOutput(Connection *conn, const char *data, size_t length)
+{
+    if (ReserveOutput(conn, length) == FALSE)
+    {
+        return FALSE;
+    }
+
+    memcpy(conn->Out + conn->OutLen, data, length);
+    conn->OutLen += length;
+    return SUCESS;
+}
 
-    // Send HTTP headers
-    char response[_1K];
-    snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n\r\n");
-    ssize_t bytes_sent = write(cfd, response, strlen(response));
-    if (bytes_sent < 0)
+int AppendFormat(Connection *conn, const char *format, ...)
+{
+    char line[_1K];
+    va_list args;
+
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    if (length < 0)
+    {
+        return FALSE;
+    }
+    if ((size_t)length >= sizeof(line))
     {
-        perror("Write system call failed");
+        length = sizeof(line) - 1; // truncated like the snprintf calls it replaces
     }
+    return AppendOutput(conn, line, length);
+}
 
-    // Read and send the file content
-    ssize_t bytes;
-    while ((bytes = read(fd, response, sizeof(response))) > 0)
+int FlushOutput(Connection *conn)
+{
+    // send the buffered bytes (headers, generated bodies) and the cached body in the same calls
+    for (;;)
     {
-        bytes_sent = write(cfd, response, bytes);
-        if (bytes_sent < 0)
+        struct iovec iov[2];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+
+        if (conn->OutSent < conn->OutLen)
+        {
+            iov[msg.msg_iovlen].iov_base = conn->Out + conn->OutSent;
+            iov[msg.msg_iovlen++].iov_len = conn->OutLen - conn->OutSent;
+        }
+        if (conn->Cached != NULL && conn->CachedSent < conn->CachedEnd)
+        {
+            iov[msg.msg_iovlen].iov_base = (char *)conn->Cached->Data + conn->CachedSent;
+            iov[msg.msg_iovlen++].iov_len = conn->CachedEnd - conn->CachedSent;
+        }
+        if (msg.msg_iovlen == 0)
         {
-            perror("Write system call failed");
+            break;
         }
+
+        ssize_t bytes = conn->Io.Active ? Uring_SendMsg(&conn->Io, conn->Fd, &msg)
+                                        : sendmsg(conn->Fd, &msg, MSG_NOSIGNAL);
+        if (bytes < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return AGAIN;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EPIPE && errno != ECONNRESET)
+            {
+                perror("Write system call failed");
+            }
+            return FALSE;
+        }
+
+        size_t fromOut = conn->OutLen - conn->OutSent;
+        if ((size_t)bytes < fromOut)
+        {
+            fromOut = bytes;
+        }
+        conn->OutSent += fromOut;
+        conn->CachedSent += bytes - fromOut;
+        conn->Transferred += bytes;
     }
-}
\ No newline at end of file
+    conn->OutLen = conn->OutSent = 0;
+
+    if (conn->Cached != NULL)
+    {
+        FileCache_Release(conn->Cached);
+        conn->Cached = NULL;
+        conn->CachedSent = conn->CachedEnd = 0;
+    }
+
+    // then the file being streamed
+    if (conn->FileFd == FALSE)
+    {
+        return SUCESS;
+    }
+
+    int ret = SendFile(conn);
+    if (ret == AGAIN)
+    {
+        return AGAIN;
+    }
+
+    close(conn->FileFd);
+    conn->FileFd = FALSE;
+    SetCork(conn->Fd, 0); // push the last partial segment out now
+    return ret;
+}
+
+int SendFile(Connection *conn)
+{
+    while (conn->FileRemaining > 0)
+    {
+        // the kernel copies from the page cache to the socket, no userspace buffer involved,
+        // in the uring loop a read into the staging buffer linked to its send does the same
+        ssize_t bytes = conn->Io.Active ? Uring_SendFile(&conn->Io, conn->Fd, conn->FileFd, &conn->FileOffset,
+                                                         conn->FileRemaining)
+                                        : sendfile(conn->Fd, conn->FileFd, &conn->FileOffset, conn->FileRemaining);
+        if (bytes < 0 && !conn->Io.Active && (errno == EINVAL || errno == ENOSYS))
+        {
+            // the file system doesn't support sendfile, copy through the output buffer
+            bytes = CopyFile(conn);
+        }
+
+        if (bytes < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return AGAIN;
+            }
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno != EPIPE && errno != ECONNRESET)
+            {
+                perror("sendfile");
+            }
+            return FALSE;
+        }
+        if (bytes == 0)
+        {
+            // the file shrank: the announced length can't be honoured, close the connection
+            fprintf(stderr, "SERVER: file shrank while it was sent\n");
+            return FALSE;
+        }
+        conn->FileRemaining -= bytes;
+        conn->Transferred += bytes;
+    }
+    return SUCESS;
+}
+
+ssize_t CopyFile(Connection *conn)
+{
+    char chunk[SERVER_BUF];
+
+    size_t length = sizeof(chunk);
+    if ((off_t)length > conn->FileRemaining)
+    {
+        length = conn->FileRemaining;
+    }
+
+    ssize_t bytes = pread(conn->FileFd, chunk, length, conn->FileOffset);
+    if (bytes <= 0)
+    {
+        return bytes;
+    }
+
+    // only what the socket accepted is consumed, the rest is read again on the next call
+    ssize_t sent = send(conn->Fd, chunk, bytes, MSG_NOSIGNAL);
+    if (sent > 0)
+    {
+        conn->FileOffset += sent;
+    }
+    return sent;
+}
+
+void SetCork(int fd, int on)
+{
+    // corked, the headers and the first file bytes leave in full segments
+    setsockopt(fd, IPPROTO_TCP, TCP_CORK, &on, sizeof(on));
+}
+
+void CloseFd(int fd)
+{
+    if (close(fd) == FALSE)
+    {
+        printf("SERVER: close failed (%s)\n", strerror(errno));
+        exit(FALSE);
+    }
+}
+
+static int HexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+    {
+        return (c | 0x20) - 'a' + 10;
+    }
+    return -1;
+}
+
+int ParsePath(Connection *conn, char *path, size_t pathSize)
+{
+    // the parser already delimited the path, its %XX escapes are decoded for the file system calls
+    const char *target = conn->In + conn->Request->Req.Path.Offset;
+    size_t pathLength = conn->Request->Req.Path.Length;
+    const char *query = memchr(target, '?', pathLength);
+    if (query != NULL)
+    {
+        pathLength = query - target; // the query string is read by FindQuery
+    }
+    // under the document root, if there is one
+    size_t rootLength = Config->RootLength;
+    if (rootLength + pathLength >= pathSize)
+    {
+        fprintf(stderr, "Path buffer too small\n");
+        return FALSE;
+    }
+
+    memcpy(path, Config->Root, rootLength);
+    char *out = path + rootLength;
+    for (size_t i = 0; i < pathLength; ++i)
+    {
+        // a malformed escape, or one of a NUL byte, is kept as it is
+        int high, low;
+        if (target[i] == '%' && i + 2 < pathLength && (high = HexDigit(target[i + 1])) >= 0 &&
+            (low = HexDigit(target[i + 2])) >= 0 && (high | low) != 0)
+        {
+            *out++ = (char)(high * 16 + low);
+            i += 2;
+        }
+        else
+        {
+            *out++ = target[i];
+        }
+    }
+    *out = '\0'; // Null-terminate the string
+    return SUCESS;
+}
+
+int EscapesRoot(const char *url)
+{
+    // without a document root the whole file system is served anyway
+    if (Config->RootLength == 0)
+    {
+        return 0;
+    }
+    if (url[0] != '/')
+    {
+        return 1; // "*" or an absolute URI, nothing under the root
+    }
+
+    // a ".." segment climbs out of it
+    for (const char *segment = url; segment != NULL; segment = strchr(segment + 1, '/'))
+    {
+        if (strncmp(segment, "/..", 3) == 0 && (segment[3] == '/' || segment[3] == '\0'))
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void ListContent(Connection *conn, char *path, const struct stat *sb)
+{
+    char value[32];
+    char text[128];
+    char key[MAX_PATH_LENGTH + 160];
+    char etag[192];
+    DirQuery query = {LIST_BY_NAME, 0, 1, LISTING_PAGE_SIZE};
+
+    conn->Route = ROUTE_LISTING;
+
+    // unknown or invalid parameters fall back to the defaults
+    if (FindQuery(conn, "sort", value, sizeof(value)) == SUCESS)
+    {
+        if (strcmp(value, "size") == 0)
+        {
+            query.Sort = LIST_BY_SIZE;
+        }
+        else if (strcmp(value, "mtime") == 0)
+        {
+            query.Sort = LIST_BY_TIME;
+        }
+    }
+    if (FindQuery(conn, "order", value, sizeof(value)) == SUCESS)
+    {
+        query.Descending = (strcmp(value, "desc") == 0);
+    }
+    if (FindQuery(conn, "page", value, sizeof(value)) == SUCESS && strtoul(value, NULL, 10) > 0)
+    {
+        query.Page = strtoul(value, NULL, 10);
+    }
+    if (FindQuery(conn, "per_page", value, sizeof(value)) == SUCESS && strtoul(value, NULL, 10) > 0)
+    {
+        query.PerPage = strtoul(value, NULL, 10);
+        if (query.PerPage > LISTING_MAX_PAGE_SIZE)
+        {
+            query.PerPage = LISTING_MAX_PAGE_SIZE;
+        }
+    }
+    DirListing_FormatQuery(&query, text, sizeof(text));
+
+    // every page and order of a directory is cached until the directory changes
+    snprintf(key, sizeof(key), "%s\tlist?%s", path, text);
+    FileCacheEntry *entry = FileCache_Lookup(key);
+    Metrics_CacheLookup(entry != NULL);
+    if (entry == NULL)
+    {
+        char *html;
+        size_t length;
+        if (DirListing_Render(path, path + Config->RootLength, &query, &html, &length) == FALSE)
+        {
+            ErrorResponse(conn, 500, "Error in Reading Content");
+            perror("DirListing_Render");
+            return;
+        }
+        if (length > Config->CacheMaxFile)
+        {
+            StartResponse(conn, 200, "OK", "text/html");
+            AppendOutput(conn, html, length);
+            free(html);
+            return;
+        }
+        entry = FileCache_InsertData(key, path, html, length, sb);
+        if (entry == NULL)
+        {
+            ErrorResponse(conn, 500, "Error in Reading Content");
+            return;
+        }
+    }
+
+    // the validators come from the listed state of the directory, plus the page shown
+    FormatETag(etag, sizeof(etag), entry->Inode, entry->SourceSize, entry->Modified, 0);
+    size_t tagLength = strlen(etag);
+    snprintf(etag + tagLength - 1, sizeof(etag) - tagLength + 1, "-%s\"", text);
+    if (CheckConditional(conn, path, etag, entry->Modified) == SUCESS)
+    {
+        FileCache_Release(entry);
+        return;
+    }
+    entry->Type = "text/html";
+    FileCache_SetHeaders(entry, entry->Type, conn->Request->Extra);
+    StartFileResponse(conn, 200, entry->Type, entry, FALSE, entry->Size, 0, entry->Size);
+}
+
+void ErrorResponse(Connection *conn, int code, char *message)
+{
+    // validators of the failed representation don't apply to the error page
+    conn->Request->ExtraLen = 0;
+
+    // drop whatever body was started for this request
+    if (conn->Status != 0 && conn->OutLen > conn->BodyStart)
+    {
+        conn->OutLen = conn->BodyStart;
+    }
+
+    StartResponse(conn, code, message, "text/html");
+    AppendFormat(conn, "<html><body><h1>%d %s</h1></body></html>", code, message);
+}
+
+void FileOperation(Connection *conn, char *path)
+{
+    if (strstr(path, ".fcgi") != NULL)
+    {
+        conn->Route = ROUTE_FCGI;
+        ExecuteWorker(conn, path);
+    }
+    else if (strstr(path, ".cgi") != NULL)
+    {
+        conn->Route = ROUTE_CGI;
+        ExecuteFile(conn, path);
+    }
+    else
+    {
+        conn->Route = ROUTE_FILE;
+        CatFile(conn, path);
+    }
+}
+
+void ExecuteFile(Connection *conn, char *path)
+{
+    // the script runs beside the loop, its output is read as it comes and answered once it exits
+    if (CgiPool_Spawn(&conn->Cgi, path) != SUCESS)
+    {
+        ErrorResponse(conn, 503, "Service Unavailable");
+        return;
+    }
+    conn->State = CONN_WAITING;
+}
+
+void ExecuteWorker(Connection *conn, char *path)
+{
+    // the persistent worker of the script gets the raw request head, In keeps it until the answer
+    if (CgiPool_Submit(&conn->Cgi, path, conn->In, conn->ReqLen) != SUCESS)
+    {
+        ErrorResponse(conn, 503, "Service Unavailable");
+        return;
+    }
+    conn->State = CONN_WAITING;
+}
+
+void WorkerResponse(Connection *conn)
+{
+    // out of the pool's completed list if the loop hasn't taken it yet
+    CgiPool_Release(&conn->Cgi, 504);
+
+    if (conn->Cgi.Status == 500)
+    {
+        ErrorResponse(conn, 500, "Error in execv child process");
+    }
+    else if (conn->Cgi.Status == 502)
+    {
+        ErrorResponse(conn, 502, "Bad Gateway");
+    }
+    else if (conn->Cgi.Status == 503)
+    {
+        ErrorResponse(conn, 503, "Service Unavailable");
+    }
+    else if (conn->Cgi.Status == 504)
+    {
+        ErrorResponse(conn, 504, "Gateway Timeout");
+    }
+    else
+    {
+        StartResponse(conn, 200, "OK", "text/html");
+        AppendOutput(conn, conn->Cgi.Body, conn->Cgi.BodyLength);
+    }
+    free(conn->Cgi.Body);
+    conn->Cgi.Body = NULL;
+    conn->Cgi.Status = 0;
+}
+
+void MetricsResponse(Connection *conn)
+{
+    size_t length;
+
+    // the counters of every server process, added up when asked
+    char *text = Metrics_Render(&length);
+    if (text == NULL)
+    {
+        ErrorResponse(conn, 500, "Internal Server Error");
+        return;
+    }
+    StartResponse(conn, 200, "OK", "text/plain; version=0.0.4");
+    AddHeader(conn, "Cache-Control: no-store\r\n");
+    AppendOutput(conn, text, length);
+    free(text);
+}
+
+void CatFile(Connection *conn, char *path)
+{
+    struct stat sb;
+    char key[MAX_PATH_LENGTH + 8];
+    char etag[64];
+    off_t start, length;
+    FileCacheEntry *entry = NULL;
+
+    // the file wasn't served from the cache by ServeCached
+    Metrics_CacheLookup(0);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &sb) == FALSE)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        ErrorResponse(conn, 500, "Error in Reading File");
+        return;
+    }
+
+    // resolved on the file itself, before a .gz sibling replaces it, and kept with its cache entries
+    const char *type = MimeTypes_Resolve(path, fd);
+    int compressible = IsCompressible(type);
+    int gzip = compressible && AcceptsGzip(conn);
+    if (gzip)
+    {
+        // a .gz sibling at least as recent as the file is sent instead, otherwise it is compressed once
+        snprintf(key, sizeof(key), "%s\tgzip", path);
+        char sibling[MAX_PATH_LENGTH + 4];
+        snprintf(sibling, sizeof(sibling), "%s.gz", path);
+        struct stat gzsb;
+        int gzfd = open(sibling, O_RDONLY | O_CLOEXEC);
+        if (gzfd >= 0 && fstat(gzfd, &gzsb) == SUCESS && S_ISREG(gzsb.st_mode) &&
+            (gzsb.st_mtim.tv_sec > sb.st_mtim.tv_sec ||
+             (gzsb.st_mtim.tv_sec == sb.st_mtim.tv_sec && gzsb.st_mtim.tv_nsec >= sb.st_mtim.tv_nsec)))
+        {
+            close(fd);
+            fd = gzfd;
+            struct stat plain = sb;
+            sb = gzsb;
+            entry = FileCache_Insert(key, sibling, fd, &sb);
+            if (entry != NULL)
+            {
+                // revalidated against both files, a newer file must not get the older sibling
+                FileCache_SetOrigin(entry, path, &plain);
+            }
+        }
+        else
+        {
+            if (gzfd >= 0)
+            {
+                close(gzfd);
+            }
+            if ((size_t)sb.st_size >= GZIP_MIN_SIZE)
+            {
+                entry = FileCache_InsertCompressed(key, path, fd, &sb);
+            }
+            gzip = (entry != NULL);
+        }
+    }
+    if (!gzip)
+    {
+        // files within the cache limits are sent from memory from now on
+        entry = FileCache_Insert(path, path, fd, &sb);
+    }
+
+    AddFileHeaders(conn, compressible, gzip);
+    FormatETag(etag, sizeof(etag), sb.st_ino, sb.st_size, sb.st_mtim, gzip);
+    int current = CheckConditional(conn, path, etag, sb.st_mtim);
+    if (entry != NULL)
+    {
+        // the headers of a 200 are known now, they are reused by the cache hits
+        entry->Type = type;
+        FileCache_SetHeaders(entry, type, conn->Request->Extra);
+        close(fd);
+        fd = FALSE;
+    }
+
+    off_t size = (entry != NULL) ? (off_t)entry->Size : sb.st_size;
+    int status = (current == SUCESS) ? 304 : SelectRange(conn, etag, sb.st_mtim, size, &start, &length);
+    if (status == 304 || status == 416)
+    {
+        if (status == 416)
+        {
+            RangeNotSatisfiable(conn, size);
+        }
+        if (fd != FALSE)
+        {
+            close(fd);
+        }
+        FileCache_Release(entry);
+        return;
+    }
+    StartFileResponse(conn, status, type, entry, fd, size, start, length);
+}
+
+int ServeCached(Connection *conn, char *path)
+{
+    char key[MAX_PATH_LENGTH + 8];
+    char etag[64];
+    off_t start, length;
+    FileCacheEntry *entry = NULL;
+
+    // a hot file is served without any file system call until it is due for revalidation
+    int gzip = AcceptsGzip(conn);
+    if (gzip)
+    {
+        snprintf(key, sizeof(key), "%s\tgzip", path);
+        entry = FileCache_Lookup(key);
+    }
+    if (entry == NULL)
+    {
+        entry = FileCache_Lookup(path);
+        if (entry == NULL)
+        {
+            return FALSE;
+        }
+
+        // the compressed variant isn't cached yet, CatFile makes it
+        if (gzip && IsCompressible(entry->Type) && entry->Size >= GZIP_MIN_SIZE)
+        {
+            FileCache_Release(entry);
+            return FALSE;
+        }
+        gzip = 0;
+    }
+
+    conn->Route = ROUTE_FILE;
+    Metrics_CacheLookup(1);
+    AddFileHeaders(conn, IsCompressible(entry->Type), gzip);
+    FormatETag(etag, sizeof(etag), entry->Inode, entry->SourceSize, entry->Modified, gzip);
+    if (CheckConditional(conn, path, etag, entry->Modified) == SUCESS)
+    {
+        FileCache_Release(entry);
+        return SUCESS;
+    }
+
+    int status = SelectRange(conn, etag, entry->Modified, entry->Size, &start, &length);
+    if (status == 416)
+    {
+        RangeNotSatisfiable(conn, entry->Size);
+        FileCache_Release(entry);
+        return SUCESS;
+    }
+
+    StartFileResponse(conn, status, entry->Type, entry, FALSE, entry->Size, start, length);
+    return SUCESS;
+}
+
+void AddFileHeaders(Connection *conn, int compressible, int gzip)
+{
+    // caches must keep the encodings of a compressible file apart
+    if (compressible)
+    {
+        AddHeader(conn, "Vary: Accept-Encoding\r\n");
+    }
+    if (gzip)
+    {
+        AddHeader(conn, "Content-Encoding: gzip\r\n");
+    }
+    AddHeader(conn, "Accept-Ranges: bytes\r\n");
+}
+
+int IsCompressible(const char *type)
+{
+    // text and the formats written as text, images, media and archives are compressed already
+    return strncmp(type, "text/", 5) == 0 || strcmp(type, "application/json") == 0 ||
+           strcmp(type, "application/xml") == 0 || strcmp(type, "image/svg+xml") == 0 ||
+           strcmp(type, "application/wasm") == 0;
+}
+
+int AcceptsGzip(Connection *conn)
+{
+    char value[_1K / 2];
+
+    if (FindHeader(conn, "Accept-Encoding", value, sizeof(value)) == FALSE)
+    {
+        return 0;
+    }
+
+    // "gzip" or "*" in the list, unless refused with q=0
+    for (char *save, *coding = strtok_r(value, ",", &save); coding != NULL; coding = strtok_r(NULL, ",", &save))
+    {
+        coding += strspn(coding, " \t");
+        size_t nameLength = strcspn(coding, " \t;");
+        if ((nameLength == 4 && strncasecmp(coding, "gzip", 4) == 0) || (nameLength == 1 && coding[0] == '*'))
+        {
+            char *q = strstr(coding + nameLength, "q=");
+            return (q == NULL || strtod(q + 2, NULL) > 0);
+        }
+    }
+    return 0;
+}
+
+void StartFileResponse(Connection *conn, int status, const char *type, FileCacheEntry *entry, int fd, off_t size,
+                       off_t start, off_t length)
+{
+    StartResponse(conn, status, (status == 206) ? "Partial Content" : "OK", type);
+    if (status == 206)
+    {
+        AddHeader(conn, "Content-Range: bytes %lld-%lld/%lld\r\n", (long long)start,
+                  (long long)(start + length - 1), (long long)size);
+    }
+
+    // the selected bytes are sent from the cache, or from the file with sendfile at their offset
+    if (entry != NULL)
+    {
+        conn->Cached = entry;
+        conn->CachedSent = start;
+        conn->CachedEnd = start + length;
+        return;
+    }
+
+    // the fd is closed by FlushOutput at the end of the body
+    conn->FileFd = fd;
+    conn->FileOffset = start;
+    conn->FileRemaining = length;
+    SetCork(conn->Fd, 1);
+}
+
+int SelectRange(Connection *conn, const char *etag, struct timespec modified, off_t size, off_t *start,
+                off_t *length)
+{
+    char value[_1K / 2];
+
+    *start = 0;
+    *length = size;
+    if (FindHeader(conn, "Range", value, sizeof(value)) == FALSE)
+    {
+        return 200;
+    }
+
+    // If-Range: the range only applies to the representation the client already has part of
+    if (FindHeader(conn, "If-Range", value, sizeof(value)) == SUCESS)
+    {
+        if (value[0] == '"' || strncmp(value, "W/", 2) == 0)
+        {
+            // a weak tag never matches here, the parts could come from different versions
+            if (strcmp(value, etag) != 0)
+            {
+                return 200;
+            }
+        }
+        else
+        {
+            struct tm tm;
+            memset(&tm, 0, sizeof(tm));
+            char *end = strptime(value, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+            if (end == NULL || *end != '\0' || timegm(&tm) != modified.tv_sec)
+            {
+                return 200;
+            }
+        }
+        FindHeader(conn, "Range", value, sizeof(value));
+    }
+
+    // a single byte range: "first-last", "first-" or "-suffix", anything else sends the whole file
+    if (strncmp(value, "bytes=", 6) != 0 || strchr(value, ',') != NULL)
+    {
+        return 200;
+    }
+    char *spec = value + 6;
+    char *dash = strchr(spec, '-');
+    if (dash == NULL || (spec == dash && dash[1] == '\0'))
+    {
+        return 200;
+    }
+
+    char *end;
+    long long first, last;
+    if (spec == dash)
+    {
+        long long suffix = strtoll(dash + 1, &end, 10);
+        if (*end != '\0' || dash[1] < '0' || dash[1] > '9')
+        {
+            return 200;
+        }
+        if (suffix == 0 || size == 0)
+        {
+            return 416;
+        }
+        first = (suffix >= size) ? 0 : size - suffix;
+        last = size - 1;
+    }
+    else
+    {
+        first = strtoll(spec, &end, 10);
+        if (end != dash || spec[0] < '0' || spec[0] > '9')
+        {
+            return 200;
+        }
+        last = size - 1;
+        if (dash[1] != '\0')
+        {
+            last = strtoll(dash + 1, &end, 10);
+            if (*end != '\0' || dash[1] < '0' || dash[1] > '9' || last < first)
+            {
+                return 200;
+            }
+        }
+        if (first >= size)
+        {
+            return 416;
+        }
+        if (last >= size)
+        {
+            last = size - 1;
+        }
+    }
+
+    *start = first;
+    *length = last - first + 1;
+    return 206;
+}
+
+void RangeNotSatisfiable(Connection *conn, off_t size)
+{
+    ErrorResponse(conn, 416, "Range Not Satisfiable");
+    AddHeader(conn, "Content-Range: bytes */%lld\r\n", (long long)size);
+}
@@ -5,10 +5,40 @@
  *                    - formatHttpResponse: Generates an HTTP response string based on the provided status, headers, and body.
  *                    - parseRequestLine: Extracts and processes the HTTP request method, path, and version from the request line.
  *                    - isCgiFile: Determines if the requested file is a CGI script based on its extension.
+ *                    - Connection helpers: per-connection state machine, buffered output and non-blocking flush.
+ *                    - SendFile: zero-copy file body with sendfile, corked behind its headers.
+ *                    - ServeCached: static file body from the in-memory cache (FileCache.h).
+ *                    - CatFile: Content-Type from MimeTypes.h, resolved once per cached file.
+ *                    - CheckConditional: ETag/Last-Modified validators, 304 for If-None-Match/If-Modified-Since.
+ *                    - SelectRange: single byte range of Range/If-Range, sent as 206 Partial Content.
+ *                    - AcceptsGzip: Accept-Encoding negotiation, gzip variants from .gz siblings or the cache.
+ *                    - ExecuteWorker/WorkerResponse: ".fcgi" scripts answered by persistent workers
+ *                      (CgiPool.h) while the connection waits in CONN_WAITING, ".cgi" ones run once per
+ *                      request by ExecuteFile and are waited for the same way.
+ *                    - NewConnection/FreeConnection: connections from a slab (BufferPool.h).
+ *                    - ParsePath/EscapesRoot: file system path of a request under the configured document root.
+ *                    - OpenConnections/StopKeepAlive: what a draining process waits for, and responses
+ *                      that close their connection once it drains.
+ *                    - AcquireBuffers/ReleaseBuffers: pooled input, output and request state, held only
+ *                      while a request is received or answered so an idle connection is a few hundred bytes.
+ *                    - UpdateTimeout: header, body, idle, write stall and CGI worker timeout of a connection.
+ *                    - ListContent: sorted, paginated directory listings (DirListing.h), cached per page.
+ *                    - LogResponse/WriteLog: access log record and metrics (Metrics.h) of every response.
+ *                    - MetricsResponse: the METRICS_PATH endpoint.
+ *                    - ReadRequest/FlushOutput/SendFile: queue their reads and sends on the io_uring ring
+ *                      (Uring.h) instead of calling the system when the "uring" loop drives the connection.
  * Notes            : These utility functions simplify repetitive tasks and improve code readability.
+ *                    Handlers never write to the socket directly, they append the response to the
+ *                    connection and Handle_Requests flushes it, so the same code serves blocking
+ *                    (fork mode), non-blocking (epoll mode) and io_uring (uring mode) sockets.
  */
+#ifndef HTTP_UTILS_H
+#define HTTP_UTILS_H
 
 /*===================================  Includes ==============================*/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // accept4, splice and the other Linux specific calls
+#endif
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/ip.h>
@@ -22,31 +52,153 @@
 #include <asm-generic/socket.h>
 #include <signal.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/sendfile.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <time.h>
 #include <sys/sysmacros.h>
+#include <stdarg.h>
 
 #include "ServerConfig.h"
+#include "HttpParser.h"
+#include "FileCache.h"
+#include "CgiPool.h"
+#include "TimerWheel.h"
+#include "DirListing.h"
+#include "AccessLog.h"
+#include "Metrics.h"
+#include "Uring.h"
+#include "BufferPool.h"
+#include "MimeTypes.h"
 
 /*================================  Definations ==============================*/
 #define FALSE -1
 #define SUCESS 0
-#define MAX_ELEMENTS 255
 #define MAX_PATH_LENGTH 1024
 #define MAX_ARGUMENT 10
+#define AGAIN 1 // the socket isn't ready, retry when epoll reports it
+
+/* Connection states */
+#define CONN_READING 0 // waiting for the end of the request headers
+#define CONN_WRITING 1 // flushing the response
+#define CONN_CLOSED 2  // done, the connection can be released
+#define CONN_WAITING 3 // a CGI worker answers the request, the loop runs the connection when it's done
+
+/* Connection timeouts, the one running depends on what the connection waits for */
+#define TIMEOUT_NONE 0
+#define TIMEOUT_HEADER 1 // HEADER_TIMEOUT: request head, fixed deadline from its first byte
+#define TIMEOUT_BODY 2   // BODY_TIMEOUT: request body, restarted by every byte received
+#define TIMEOUT_IDLE 3   // KEEPALIVE_TIMEOUT: next request of a persistent connection
+#define TIMEOUT_WRITE 4  // WRITE_TIMEOUT: response, restarted by every byte sent
+#define TIMEOUT_CGI 5    // cgi_timeout_ms: answer of the CGI worker, a 504 when it expires
+
+/*=================================  Types ===================================*/
+typedef struct RequestState
+{
+    HttpRequest Req;     // parser state and slices of the request being received
+    char Extra[_1K / 2]; // extra header lines of the response (validators, Cache-Control)
+    size_t ExtraLen;
+    AccessRecord Log;    // access log record of the last response, written once it is sent
+} RequestState;
+
+typedef struct Connection
+{
+    int Fd;              // client socket
+    int State;           // CONN_READING, CONN_WRITING, CONN_CLOSED or CONN_WAITING
+    char *In;            // request bytes received so far, a pooled buffer_size buffer, NULL while idle
+    size_t InLen;
+    RequestState *Request; // pooled with In
+    char *Out; // response bytes not sent yet (headers and generated bodies), pooled up to buffer_size
+    size_t OutLen;
+    size_t OutSent;
+    size_t OutCap;
+    int FileFd;          // file streamed after Out, -1 if none
+    FileCacheEntry *Cached; // cached file sent after Out, NULL if none
+    size_t CachedSent;      // next byte of the cached file to send
+    size_t CachedEnd;       // end of the range of the cached file to send
+    off_t FileOffset;    // next byte of FileFd to send
+    off_t FileRemaining; // bytes of FileFd still to send
+    size_t ReqLen;       // length of the buffered request being served
+    size_t Discard;      // request body bytes still to skip
+    int KeepAlive;       // keep the connection open after the response
+    int Head;            // HEAD request, FinishResponse drops the body of its response
+    int Status;          // response being built
+    const char *Reason;
+    const char *ContentType;
+    size_t BodyStart; // offset of the response body in Out
+    size_t Requests;     // requests answered on the connection
+    size_t Transferred;  // bytes received and sent, the progress of the connection
+    int Phase;           // TIMEOUT_* running
+    size_t PhaseMark;    // Requests (head, idle) or Transferred (body, write) when it was armed
+    Timer Timeout;       // deadline of the phase in the event loop
+    struct sockaddr_in Peer; // client address, for the access log
+    long long RequestStart;  // first byte of the request being received (AccessLog_Clock)
+    long long LogStart;      // RequestStart of the response logged in Request->Log
+    int Route;               // ROUTE_* of the response being built, for the latency histograms
+    int LogRoute;
+    int LogPending;
+    UringConn Io;            // operations queued for the connection in the "uring" loop (Io.Active)
+    CgiCall Cgi;             // request queued on a CGI worker while CONN_WAITING, its head stays in In
+} Connection;
 
 /*=================================  Prototypes ==============================*/
 int SetServerSocket(char *port);
-void Handle_Requests(int cfd);
+int SetNonBlocking(int fd);
+int SetClientSocket(int fd);
+Connection *NewConnection(int fd);
+void FreeConnection(Connection *conn);
+void InitConnections(void);
+size_t OpenConnections(void);
+void StopKeepAlive(void);
+void InitConnection(Connection *conn, int fd);
+void ReleaseConnection(Connection *conn);
+int AcquireBuffers(Connection *conn);
+void ReleaseBuffers(Connection *conn);
+int Handle_Requests(Connection *conn);
+int HasRequest(Connection *conn);
+int ReadRequest(Connection *conn);
+void ServeRequest(Connection *conn);
+void ConsumeRequest(Connection *conn);
+void LogResponse(Connection *conn);
+void WriteLog(Connection *conn);
+int UpdateTimeout(Connection *conn);
+int FindHeader(Connection *conn, const char *name, char *value, size_t valueSize);
+int FindQuery(Connection *conn, const char *name, char *value, size_t valueSize);
+void StartResponse(Connection *conn, int code, const char *reason, const char *type);
+void FinishResponse(Connection *conn);
+void AddHeader(Connection *conn, const char *format, ...);
+const char *CachePolicy(const char *path);
+void FormatETag(char *etag, size_t etagSize, ino_t inode, off_t size, struct timespec modified, int gzip);
+int CheckConditional(Connection *conn, const char *path, const char *etag, struct timespec modified);
+int ReserveOutput(Connection *conn, size_t length);
+int AppendOutput(Connection *conn, const char *data, size_t length);
+int AppendFormat(Connection *conn, const char *format, ...);
+int FlushOutput(Connection *conn);
+int SendFile(Connection *conn);
+ssize_t CopyFile(Connection *conn);
+void SetCork(int fd, int on);
 void CloseFd(int fd);
-void ParsePath(const char *buffer, char *path, size_t pathSize);
-void ListContent(int cfd, char *path);
-int read_directory(const char *dir, char *Elements[], size_t *elementCount);
-void cleanup(char *Elements[], size_t elementCount);
-void ErrorResponse(int cfd, int code, char *message);
-void FileOperation(int cfd, char *path);
-void CatFile(int cfd, char *path);
-void ExecuteFile(int cfd, char *path);
\ No newline at end of file
+int ParsePath(Connection *conn, char *path, size_t pathSize);
+int EscapesRoot(const char *url);
+void ListContent(Connection *conn, char *path, const struct stat *sb);
+void ErrorResponse(Connection *conn, int code, char *message);
+void FileOperation(Connection *conn, char *path);
+void CatFile(Connection *conn, char *path);
+int ServeCached(Connection *conn, char *path);
+void StartFileResponse(Connection *conn, int status, const char *type, FileCacheEntry *entry, int fd, off_t size,
+                       off_t start, off_t length);
+int SelectRange(Connection *conn, const char *etag, struct timespec modified, off_t size, off_t *start,
+                off_t *length);
+void RangeNotSatisfiable(Connection *conn, off_t size);
+void AddFileHeaders(Connection *conn, int compressible, int gzip);
+int IsCompressible(const char *type);
+int AcceptsGzip(Connection *conn);
+void ExecuteFile(Connection *conn, char *path);
+void ExecuteWorker(Connection *conn, char *path);
+void WorkerResponse(Connection *conn);
+void MetricsResponse(Connection *conn);
+
+#endif
\ No newline at end of file
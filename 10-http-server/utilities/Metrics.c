@@ -0,0 +1,319 @@
+/*
+ * File Name        : Metrics.c
+ * Description      : Implements the shared metrics slots and their Prometheus exposition.
+ * Functions        :
+ *                    - METRIC_ADD: Relaxed atomic addition to a counter of the current slot.
+ *                    - METRIC_SUM: Value of a counter added over every slot.
+ *                    - Metrics_TakeSlot/Metrics_ReleaseSlot: Free list of the slots, kept by the master.
+ *                    - Metrics_Render: One sample per line, histograms with cumulative buckets.
+ * Notes            : Without the shared mapping (mmap failure) the counters of the process are still
+ *                    kept and exposed, only the other workers are missing.
+ */
+
+/*===================================  Includes ==============================*/
+#include "Metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*==================================  Definations =============================*/
+#define METRIC_ADD(counter, value) __atomic_fetch_add(&Current->counter, (value), __ATOMIC_RELAXED)
+#define METRIC_LOAD(slot, counter) __atomic_load_n(&Slots[slot].counter, __ATOMIC_RELAXED)
+#define METRIC_SUM(total, counter)            \
+    do                                        \
+    {                                         \
+        total = 0;                            \
+        for (int s = 0; s < SlotCount; ++s)   \
+        {                                     \
+            total += METRIC_LOAD(s, counter); \
+        }                                     \
+    } while (0)
+
+/*==================================  Structures =============================*/
+typedef struct MetricsSlot
+{
+    unsigned long long Statuses[600];          // responses by status code
+    unsigned long long Bytes;                  // response bytes, headers included
+    long long InFlight;                        // open connections
+    unsigned long long Connections;            // connections accepted
+    unsigned long long CacheHits;
+    unsigned long long CacheMisses;
+    long long CgiWorkers;                      // persistent CGI workers running
+    long long CgiBusy;                         // persistent CGI workers answering a request
+    unsigned long long Wakeups;                // epoll_wait or io_uring_enter calls of the event loop
+    unsigned long long Buckets[ROUTE_COUNT][METRICS_BUCKET_COUNT + 1];
+    unsigned long long DurationSum[ROUTE_COUNT]; // microseconds
+    unsigned long long Used;                   // the slot was taken by a worker once
+} __attribute__((aligned(64))) MetricsSlot;
+
+typedef struct Text
+{
+    char *Data;
+    size_t Length;
+    size_t Capacity;
+} Text;
+
+/*============================  Static Variables ==============================*/
+static MetricsSlot LocalSlot;
+static MetricsSlot *Slots = &LocalSlot;
+static int SlotCount = 1;
+static MetricsSlot *Current = &LocalSlot;
+static int FreeSlots[METRICS_SLOTS]; // slots no running worker owns, the lowest one on top
+static int FreeCount = 0;
+
+static const long long Bounds[METRICS_BUCKET_COUNT] = METRICS_BUCKETS;
+static const char *Routes[ROUTE_COUNT] = {"file", "listing", "cgi", "fcgi", "other"};
+
+/*============================  Function Implementation =======================*/
+
+int Metrics_Init(void)
+{
+    size_t size = METRICS_SLOTS * sizeof(MetricsSlot);
+    void *shared = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+    {
+        perror("mmap metrics");
+        return -1;
+    }
+    Slots = shared;
+    SlotCount = METRICS_SLOTS;
+    Current = &Slots[0];
+    Current->Used = 1;
+    for (int s = SlotCount - 1; s >= 0; --s)
+    {
+        FreeSlots[FreeCount++] = s;
+    }
+    return 0;
+}
+
+int Metrics_TakeSlot(void)
+{
+    return (FreeCount > 0) ? FreeSlots[--FreeCount] : -1;
+}
+
+void Metrics_ReleaseSlot(int slot)
+{
+    // only once its worker is reaped: a draining one still decrements its gauges
+    if (slot >= 0)
+    {
+        FreeSlots[FreeCount++] = slot;
+    }
+}
+
+void Metrics_SetSlot(int slot)
+{
+    Current = (slot >= 0) ? &Slots[slot] : &LocalSlot;
+
+    // the gauges of the previous owner of the slot died with it
+    __atomic_store_n(&Current->InFlight, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&Current->CgiWorkers, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&Current->CgiBusy, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&Current->Used, 1, __ATOMIC_RELAXED);
+}
+
+void Metrics_Connection(int delta)
+{
+    METRIC_ADD(InFlight, delta);
+    if (delta > 0)
+    {
+        METRIC_ADD(Connections, 1);
+    }
+}
+
+void Metrics_Response(int route, int status, unsigned long long bytes, long long durationUs)
+{
+    if (status >= 100 && status < 600)
+    {
+        METRIC_ADD(Statuses[status], 1);
+    }
+    METRIC_ADD(Bytes, bytes);
+
+    int bucket = 0;
+    while (bucket < METRICS_BUCKET_COUNT && durationUs > Bounds[bucket])
+    {
+        bucket++;
+    }
+    METRIC_ADD(Buckets[route][bucket], 1);
+    METRIC_ADD(DurationSum[route], durationUs);
+}
+
+void Metrics_CacheLookup(int hit)
+{
+    if (hit)
+    {
+        METRIC_ADD(CacheHits, 1);
+    }
+    else
+    {
+        METRIC_ADD(CacheMisses, 1);
+    }
+}
+
+void Metrics_CgiWorkers(int delta)
+{
+    METRIC_ADD(CgiWorkers, delta);
+}
+
+void Metrics_CgiBusy(int delta)
+{
+    METRIC_ADD(CgiBusy, delta);
+}
+
+void Metrics_Wakeup(void)
+{
+    METRIC_ADD(Wakeups, 1);
+}
+
+static int Print(Text *text, const char *format, ...)
+{
+    va_list args;
+
+    // grown by doubling, the exposition is a few kilobytes
+    for (;;)
+    {
+        va_start(args, format);
+        int length = vsnprintf(text->Data + text->Length, text->Capacity - text->Length, format, args);
+        va_end(args);
+        if (length < 0)
+        {
+            return -1;
+        }
+        if ((size_t)length < text->Capacity - text->Length)
+        {
+            text->Length += length;
+            return 0;
+        }
+
+        size_t capacity = (text->Capacity > 0) ? text->Capacity * 2 : 8192;
+        char *data = realloc(text->Data, capacity);
+        if (data == NULL)
+        {
+            return -1;
+        }
+        text->Data = data;
+        text->Capacity = capacity;
+    }
+}
+
+char *Metrics_Render(size_t *length)
+{
+    Text text = {NULL, 0, 0};
+    unsigned long long total;
+    long long gauge;
+    int failed = 0;
+
+    failed |= Print(&text, "# HELP httpserver_requests_total Responses sent, by status code.\n"
+                           "# TYPE httpserver_requests_total counter\n");
+    for (int code = 100; code < 600; ++code)
+    {
+        METRIC_SUM(total, Statuses[code]);
+        if (total > 0)
+        {
+            failed |= Print(&text, "httpserver_requests_total{code=\"%d\"} %llu\n", code, total);
+        }
+    }
+
+    METRIC_SUM(total, Bytes);
+    failed |= Print(&text, "# HELP httpserver_sent_bytes_total Response bytes, headers included.\n"
+                           "# TYPE httpserver_sent_bytes_total counter\n"
+                           "httpserver_sent_bytes_total %llu\n", total);
+    METRIC_SUM(total, Connections);
+    failed |= Print(&text, "# HELP httpserver_connections_total Connections accepted.\n"
+                           "# TYPE httpserver_connections_total counter\n"
+                           "httpserver_connections_total %llu\n", total);
+    METRIC_SUM(gauge, InFlight);
+    failed |= Print(&text, "# HELP httpserver_connections_in_flight Connections open.\n"
+                           "# TYPE httpserver_connections_in_flight gauge\n"
+                           "httpserver_connections_in_flight %lld\n", gauge);
+
+    unsigned long long hits, misses;
+    METRIC_SUM(hits, CacheHits);
+    METRIC_SUM(misses, CacheMisses);
+    failed |= Print(&text, "# HELP httpserver_file_cache_lookups_total File cache lookups, by result.\n"
+                           "# TYPE httpserver_file_cache_lookups_total counter\n"
+                           "httpserver_file_cache_lookups_total{result=\"hit\"} %llu\n"
+                           "httpserver_file_cache_lookups_total{result=\"miss\"} %llu\n"
+                           "# HELP httpserver_file_cache_hit_ratio Hits over lookups since the start.\n"
+                           "# TYPE httpserver_file_cache_hit_ratio gauge\n"
+                           "httpserver_file_cache_hit_ratio %.4f\n",
+                    hits, misses, (hits + misses > 0) ? (double)hits / (hits + misses) : 0.0);
+
+    long long workers, busy;
+    METRIC_SUM(workers, CgiWorkers);
+    METRIC_SUM(busy, CgiBusy);
+    failed |= Print(&text, "# HELP httpserver_cgi_workers Persistent CGI workers running.\n"
+                           "# TYPE httpserver_cgi_workers gauge\n"
+                           "httpserver_cgi_workers %lld\n"
+                           "# HELP httpserver_cgi_workers_busy Persistent CGI workers answering a request.\n"
+                           "# TYPE httpserver_cgi_workers_busy gauge\n"
+                           "httpserver_cgi_workers_busy %lld\n"
+                           "# HELP httpserver_cgi_utilization Busy over running persistent CGI workers.\n"
+                           "# TYPE httpserver_cgi_utilization gauge\n"
+                           "httpserver_cgi_utilization %.4f\n",
+                    workers, busy, (workers > 0) ? (double)busy / workers : 0.0);
+
+    METRIC_SUM(total, Wakeups);
+    failed |= Print(&text, "# HELP httpserver_loop_wakeups_total Waits of the event loops for events or completions.\n"
+                           "# TYPE httpserver_loop_wakeups_total counter\n"
+                           "httpserver_loop_wakeups_total %llu\n", total);
+
+    failed |= Print(&text, "# HELP httpserver_request_duration_seconds From the first request byte to the last "
+                           "response byte, by route.\n"
+                           "# TYPE httpserver_request_duration_seconds histogram\n");
+    for (int route = 0; route < ROUTE_COUNT; ++route)
+    {
+        unsigned long long cumulative = 0;
+        for (int bucket = 0; bucket <= METRICS_BUCKET_COUNT; ++bucket)
+        {
+            METRIC_SUM(total, Buckets[route][bucket]);
+            cumulative += total;
+            if (bucket < METRICS_BUCKET_COUNT)
+            {
+                failed |= Print(&text, "httpserver_request_duration_seconds_bucket{route=\"%s\",le=\"%g\"} %llu\n",
+                                Routes[route], Bounds[bucket] / 1e6, cumulative);
+            }
+            else
+            {
+                failed |= Print(&text, "httpserver_request_duration_seconds_bucket{route=\"%s\",le=\"+Inf\"} %llu\n",
+                                Routes[route], cumulative);
+            }
+        }
+        METRIC_SUM(total, DurationSum[route]);
+        failed |= Print(&text, "httpserver_request_duration_seconds_sum{route=\"%s\"} %.6f\n"
+                               "httpserver_request_duration_seconds_count{route=\"%s\"} %llu\n",
+                        Routes[route], total / 1e6, Routes[route], cumulative);
+    }
+
+    // per worker, to see how evenly the kernel spreads the connections
+    failed |= Print(&text, "# HELP httpserver_worker_connections_total Connections accepted, by worker slot.\n"
+                           "# TYPE httpserver_worker_connections_total counter\n");
+    for (int s = 0; s < SlotCount; ++s)
+    {
+        if (METRIC_LOAD(s, Used))
+        {
+            failed |= Print(&text, "httpserver_worker_connections_total{worker=\"%d\"} %llu\n", s,
+                            METRIC_LOAD(s, Connections));
+        }
+    }
+    failed |= Print(&text, "# HELP httpserver_worker_connections_in_flight Connections open, by worker slot.\n"
+                           "# TYPE httpserver_worker_connections_in_flight gauge\n");
+    for (int s = 0; s < SlotCount; ++s)
+    {
+        if (METRIC_LOAD(s, Used))
+        {
+            failed |= Print(&text, "httpserver_worker_connections_in_flight{worker=\"%d\"} %lld\n", s,
+                            METRIC_LOAD(s, InFlight));
+        }
+    }
+
+    if (failed)
+    {
+        free(text.Data);
+        return NULL;
+    }
+    *length = text.Length;
+    return text.Data;
+}
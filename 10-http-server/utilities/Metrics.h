@@ -0,0 +1,60 @@
+/*
+ * File Name        : Metrics.h
+ * Description      : Server metrics shared by every server process, exposed in the Prometheus text format.
+ * Functions        :
+ *                    - Metrics_Init: Maps the shared counters, before the server processes are forked.
+ *                    - Metrics_TakeSlot/Metrics_ReleaseSlot: Hands out the slots of the workers mode, -1 once
+ *                      every slot is owned.
+ *                    - Metrics_SetSlot: Selects the counters a worker process updates, its own ones for -1.
+ *                    - Metrics_Connection: Counts a connection opened (+1) or closed (-1).
+ *                    - Metrics_Response: Counts a response by status and route, with its bytes and duration.
+ *                    - Metrics_CacheLookup: Counts a file or listing sent from the cache (hit) or not (miss).
+ *                    - Metrics_CgiWorkers/Metrics_CgiBusy: Running and busy persistent CGI workers.
+ *                    - Metrics_Wakeup: Counts a wait of the event loop, the system calls it costs per request.
+ *                    - Metrics_Render: Formats the sum of every slot for "/__metrics".
+ * Notes            : The counters live in one anonymous shared mapping with a slot per worker, so each
+ *                    worker only updates its own cache lines and the endpoint, served by any of them,
+ *                    adds the slots up. Updates are relaxed atomic additions, no lock is ever taken:
+ *                    the forked children of the fork mode share slot 0. The master takes a free
+ *                    slot for every worker it starts and gives it back when it reaps it, so a slot never
+ *                    has two live owners; the gauges are reset by the next one, the counters keep adding.
+ */
+#ifndef METRICS_H
+#define METRICS_H
+
+/*===================================  Includes ==============================*/
+#include <stddef.h>
+
+#include "ServerConfig.h"
+
+/*==================================  Definations =============================*/
+// routes of the latency histograms
+#define ROUTE_FILE 0    // static files, from the cache or the file system
+#define ROUTE_LISTING 1 // directory listings
+#define ROUTE_CGI 2     // one-shot ".cgi" scripts
+#define ROUTE_FCGI 3    // persistent ".fcgi" workers
+#define ROUTE_OTHER 4   // errors, metrics
+#define ROUTE_COUNT 5
+
+// upper bounds of the latency buckets, in microseconds, the last bucket is +Inf
+#define METRICS_BUCKETS                                                                              \
+    {                                                                                                \
+        250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000, \
+            5000000                                                                                  \
+    }
+#define METRICS_BUCKET_COUNT 14
+
+/*=================================  Prototypes ==============================*/
+int Metrics_Init(void);
+int Metrics_TakeSlot(void);
+void Metrics_ReleaseSlot(int slot);
+void Metrics_SetSlot(int slot);
+void Metrics_Connection(int delta);
+void Metrics_Response(int route, int status, unsigned long long bytes, long long durationUs);
+void Metrics_CacheLookup(int hit);
+void Metrics_CgiWorkers(int delta);
+void Metrics_CgiBusy(int delta);
+void Metrics_Wakeup(void);
+char *Metrics_Render(size_t *length);
+
+#endif
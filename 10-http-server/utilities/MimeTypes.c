@@ -0,0 +1,209 @@
+/*
+ * File Name        : MimeTypes.c
+ * Description      : Implements the extension table and the magic number sniffing of the content types.
+ * Functions        :
+ *                    - MimeTypes_Init: Copies the built-in and configured mappings, sorts them and drops
+ *                      the built-in ones a "mime" setting replaces.
+ *                    - MimeTypes_Lookup: Lower-cases the extension of the last path segment and bsearches it.
+ *                    - MimeTypes_Sniff: Known signatures, HTML and XML prologues, then text or binary.
+ *                    - MimeTypes_Resolve: Reads the first MIME_SNIFF_SIZE bytes with pread when sniffing.
+ * Notes            : Extensions are compared case-insensitively, "INDEX.HTML" is text/html too.
+ */
+
+/*===================================  Includes ==============================*/
+#include "MimeTypes.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+/*==================================  Structures =============================*/
+typedef struct MimeEntry
+{
+    const char *Extension;
+    const char *Type;
+    size_t Rank; // 0 built in, then the order of the "mime" settings: the highest wins an extension
+} MimeEntry;
+
+typedef struct MimeSignature
+{
+    const char *Magic;
+    size_t Offset; // of the magic bytes in the file
+    size_t Length;
+    const char *Type;
+} MimeSignature;
+
+/*============================  Static Variables ==============================*/
+static const MimeEntry BuiltIn[] = {
+    {"avif", "image/avif", 0},        {"bmp", "image/bmp", 0},
+    {"c", "text/plain", 0},           {"conf", "text/plain", 0},
+    {"css", "text/css", 0},           {"csv", "text/csv", 0},
+    {"gif", "image/gif", 0},          {"gz", "application/gzip", 0},
+    {"h", "text/plain", 0},           {"htm", "text/html", 0},
+    {"html", "text/html", 0},         {"ico", "image/x-icon", 0},
+    {"jpeg", "image/jpeg", 0},        {"jpg", "image/jpeg", 0},
+    {"js", "text/javascript", 0},     {"json", "application/json", 0},
+    {"log", "text/plain", 0},         {"md", "text/markdown", 0},
+    {"mjs", "text/javascript", 0},    {"mp3", "audio/mpeg", 0},
+    {"mp4", "video/mp4", 0},          {"oga", "audio/ogg", 0},
+    {"ogg", "audio/ogg", 0},          {"ogv", "video/ogg", 0},
+    {"otf", "font/otf", 0},           {"pdf", "application/pdf", 0},
+    {"png", "image/png", 0},          {"sh", "text/plain", 0},
+    {"svg", "image/svg+xml", 0},      {"tar", "application/x-tar", 0},
+    {"ttf", "font/ttf", 0},           {"txt", "text/plain", 0},
+    {"wasm", "application/wasm", 0},  {"wav", "audio/wav", 0},
+    {"webm", "video/webm", 0},        {"webp", "image/webp", 0},
+    {"woff", "font/woff", 0},         {"woff2", "font/woff2", 0},
+    {"xml", "application/xml", 0},    {"zip", "application/zip", 0},
+};
+static const MimeSignature Signatures[] = {
+    {"\x89PNG\r\n\x1a\n", 0, 8, "image/png"},
+    {"\xff\xd8\xff", 0, 3, "image/jpeg"},
+    {"GIF87a", 0, 6, "image/gif"},
+    {"GIF89a", 0, 6, "image/gif"},
+    {"WEBP", 8, 4, "image/webp"},
+    {"%PDF-", 0, 5, "application/pdf"},
+    {"\x1f\x8b", 0, 2, "application/gzip"},
+    {"PK\x03\x04", 0, 4, "application/zip"},
+    {"\0asm", 0, 4, "application/wasm"},
+    {"wOFF", 0, 4, "font/woff"},
+    {"wOF2", 0, 4, "font/woff2"},
+    {"OggS", 0, 4, "audio/ogg"},
+    {"ID3", 0, 3, "audio/mpeg"},
+    {"ftyp", 4, 4, "video/mp4"},
+    {"\x1a\x45\xdf\xa3", 0, 4, "video/webm"},
+};
+static MimeEntry Table[sizeof(BuiltIn) / sizeof(BuiltIn[0]) + CONFIG_MAX_MIME];
+static size_t TableCount = 0;
+
+/*============================  Function Implementation =======================*/
+static int CompareExtensions(const void *a, const void *b)
+{
+    return strcmp(((const MimeEntry *)a)->Extension, ((const MimeEntry *)b)->Extension);
+}
+
+static int CompareEntries(const void *a, const void *b)
+{
+    const MimeEntry *left = a;
+    const MimeEntry *right = b;
+    int order = CompareExtensions(a, b);
+
+    // the entry that wins an extension sorts first, the ones after it are dropped
+    if (order != 0)
+    {
+        return order;
+    }
+    return (left->Rank < right->Rank) - (left->Rank > right->Rank);
+}
+
+void MimeTypes_Init(void)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < Config->MimeCount; ++i)
+    {
+        Table[count++] = (MimeEntry){Config->Mime[i].Extension, Config->Mime[i].Type, i + 1};
+    }
+    for (size_t i = 0; i < sizeof(BuiltIn) / sizeof(BuiltIn[0]); ++i)
+    {
+        Table[count++] = BuiltIn[i];
+    }
+    qsort(Table, count, sizeof(Table[0]), CompareEntries);
+
+    // one entry per extension, so bsearch finds the only one
+    TableCount = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (TableCount == 0 || strcmp(Table[TableCount - 1].Extension, Table[i].Extension) != 0)
+        {
+            Table[TableCount++] = Table[i];
+        }
+    }
+}
+
+const char *MimeTypes_Lookup(const char *path)
+{
+    // the extension of the last segment, "dir.d/README" has none
+    const char *name = strrchr(path, '/');
+    name = (name != NULL) ? name + 1 : path;
+    const char *dot = strrchr(name, '.');
+    if (dot == NULL || dot == name || dot[1] == '\0')
+    {
+        return NULL;
+    }
+
+    char extension[CONFIG_MIME_EXTENSION];
+    size_t length = strlen(dot + 1);
+    if (length >= sizeof(extension))
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i <= length; ++i)
+    {
+        extension[i] = tolower((unsigned char)dot[1 + i]);
+    }
+
+    MimeEntry key = {extension, NULL, 0};
+    const MimeEntry *entry = bsearch(&key, Table, TableCount, sizeof(Table[0]), CompareExtensions);
+    return (entry != NULL) ? entry->Type : NULL;
+}
+
+const char *MimeTypes_Sniff(const unsigned char *data, size_t length)
+{
+    for (size_t i = 0; i < sizeof(Signatures) / sizeof(Signatures[0]); ++i)
+    {
+        const MimeSignature *signature = &Signatures[i];
+        if (length >= signature->Offset + signature->Length &&
+            memcmp(data + signature->Offset, signature->Magic, signature->Length) == 0)
+        {
+            return signature->Type;
+        }
+    }
+
+    // markup is recognised by its first tag, after any blank
+    size_t start = 0;
+    while (start < length && isspace(data[start]))
+    {
+        start++;
+    }
+    const char *text = (const char *)data + start;
+    size_t left = length - start;
+    if ((left >= 14 && strncasecmp(text, "<!doctype html", 14) == 0) ||
+        (left >= 5 && strncasecmp(text, "<html", 5) == 0))
+    {
+        return "text/html";
+    }
+    if (left >= 5 && strncmp(text, "<?xml", 5) == 0)
+    {
+        return "application/xml";
+    }
+
+    // text has no control bytes besides the blanks, UTF-8 sequences are all above them
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (data[i] < 0x20 && data[i] != '\t' && data[i] != '\n' && data[i] != '\r' && data[i] != '\f' &&
+            data[i] != 0x1b)
+        {
+            return MIME_DEFAULT_TYPE;
+        }
+    }
+    return "text/plain";
+}
+
+const char *MimeTypes_Resolve(const char *path, int fd)
+{
+    const char *type = MimeTypes_Lookup(path);
+    if (type != NULL)
+    {
+        return type;
+    }
+    if (!Config->MimeSniff || fd < 0)
+    {
+        return MIME_DEFAULT_TYPE;
+    }
+
+    unsigned char head[MIME_SNIFF_SIZE];
+    ssize_t length = pread(fd, head, sizeof(head), 0);
+    return (length > 0) ? MimeTypes_Sniff(head, length) : "text/plain"; // an empty file is empty text
+}
@@ -0,0 +1,32 @@
+/*
+ * File Name        : MimeTypes.h
+ * Description      : Content-Type of the files served, from their extension or their first bytes.
+ * Functions        :
+ *                    - MimeTypes_Init: Builds the sorted extension table, the built-in types plus the "mime" settings.
+ *                    - MimeTypes_Lookup: Type of a path by its extension, NULL when it has none or an unknown one.
+ *                    - MimeTypes_Sniff: Type recognised from the first bytes of a file.
+ *                    - MimeTypes_Resolve: Lookup, then sniffing an opened file if that fails ("mime_sniff").
+ * Notes            : The table is built once per configuration, before the server processes are forked,
+ *                    and searched with bsearch on a lower-cased extension. The returned strings live as long
+ *                    as the table, a file cache entry keeps the pointer (FileCacheEntry.Type) so a cached
+ *                    file is typed without any lookup.
+ */
+#ifndef MIME_TYPES_H
+#define MIME_TYPES_H
+
+/*===================================  Includes ==============================*/
+#include <stddef.h>
+
+#include "ServerConfig.h"
+
+/*================================  Definations ==============================*/
+#define MIME_DEFAULT_TYPE "application/octet-stream" // binary files nothing is known about
+#define MIME_SNIFF_SIZE 512                          // bytes of a file looked at by MimeTypes_Sniff
+
+/*=================================  Prototypes ==============================*/
+void MimeTypes_Init(void);
+const char *MimeTypes_Lookup(const char *path);
+const char *MimeTypes_Sniff(const unsigned char *data, size_t length);
+const char *MimeTypes_Resolve(const char *path, int fd);
+
+#endif
@@ -0,0 +1,284 @@
+/*
+ * File Name        : ServerConfig.c
+ * Description      : Implements the configuration file, "key value" lines read into a ServerConfig.
+ * Functions        :
+ *                    - ServerConfig_Load: Parses the file over the compile-time defaults, Config is only
+ *                      replaced when every line is valid.
+ *                    - ServerConfig_Reload: Parses the file given to ServerConfig_Load again.
+ *                    - ParseNumber: Decimal value with an optional K, M or G suffix, within the limits of its key.
+ *                    - AddMime: One "mime" line, appended to the mappings read so far.
+ * Notes            : '#' starts a comment, blank lines are skipped, a key missing from the file keeps its
+ *                    default. Only the process that loads the file writes Config, the server processes it
+ *                    forks read their own copy, so the serving code reads it without any lock.
+ */
+
+/*===================================  Includes ==============================*/
+#include "ServerConfig.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*==================================  Definations =============================*/
+#define CONFIG_INT 0
+#define CONFIG_SIZE 1
+#define CONFIG_PATH 2
+#define CONFIG_MIME 3
+
+/*==================================  Structures =============================*/
+typedef struct ConfigKey
+{
+    const char *Name;
+    int Type;
+    size_t Offset; // of the field in ServerConfig
+    long long Min;
+    long long Max;
+} ConfigKey;
+
+/*============================  Static Variables ==============================*/
+static const ServerConfig Defaults = {
+    0, BACKLOG, SERVER_BUF, HEADER_TIMEOUT, BODY_TIMEOUT, KEEPALIVE_TIMEOUT, WRITE_TIMEOUT,
+    CACHE_MAX_ENTRIES, CACHE_MAX_BYTES, CACHE_MAX_FILE, CACHE_REVALIDATE, CGI_POOL_SIZE, CGI_TIMEOUT_MS, "", 0,
+    ACCESS_LOG_FILE,
+    1, // mime_sniff
+    .Mime = {{{0}}}, .MimeCount = 0, // no "mime" mappings
+};
+static const ConfigKey Keys[] = {
+    {"workers", CONFIG_INT, offsetof(ServerConfig, Workers), 0, 4096},
+    {"backlog", CONFIG_INT, offsetof(ServerConfig, Backlog), 1, INT_MAX},
+    {"buffer_size", CONFIG_SIZE, offsetof(ServerConfig, BufferSize), CONFIG_MIN_BUFFER, CONFIG_MAX_BUFFER},
+    {"header_timeout", CONFIG_INT, offsetof(ServerConfig, HeaderTimeout), 1, 3600},
+    {"body_timeout", CONFIG_INT, offsetof(ServerConfig, BodyTimeout), 1, 3600},
+    {"keepalive_timeout", CONFIG_INT, offsetof(ServerConfig, KeepAliveTimeout), 1, 3600},
+    {"write_timeout", CONFIG_INT, offsetof(ServerConfig, WriteTimeout), 1, 3600},
+    {"cache_entries", CONFIG_SIZE, offsetof(ServerConfig, CacheEntries), 0, 1LL << 24},
+    {"cache_bytes", CONFIG_SIZE, offsetof(ServerConfig, CacheBytes), 0, 1LL << 40},
+    {"cache_max_file", CONFIG_SIZE, offsetof(ServerConfig, CacheMaxFile), 0, 1LL << 40},
+    {"cache_revalidate", CONFIG_INT, offsetof(ServerConfig, CacheRevalidate), 0, 3600},
+    {"cgi_workers", CONFIG_INT, offsetof(ServerConfig, CgiWorkers), 1, CGI_MAX_POOL_SIZE},
+    {"cgi_timeout_ms", CONFIG_INT, offsetof(ServerConfig, CgiTimeoutMs), 1, 3600 * 1000},
+    {"root", CONFIG_PATH, offsetof(ServerConfig, Root), 0, 0},
+    {"access_log", CONFIG_PATH, offsetof(ServerConfig, AccessLog), 0, 0},
+    {"mime_sniff", CONFIG_INT, offsetof(ServerConfig, MimeSniff), 0, 1},
+    {"mime", CONFIG_MIME, offsetof(ServerConfig, Mime), 0, 0},
+};
+static ServerConfig Settings = Defaults;
+static char LoadedPath[CONFIG_PATH_MAX]; // file of the last successful load
+
+const ServerConfig *Config = &Settings;
+
+/*============================  Function Implementation =======================*/
+static int ParseNumber(const ConfigKey *key, const char *value, long long *number)
+{
+    char *end;
+    errno = 0;
+    long long parsed = strtoll(value, &end, 10);
+    if (end == value || errno != 0)
+    {
+        return -1;
+    }
+
+    if (key->Type == CONFIG_SIZE && *end != '\0' && end[1] == '\0')
+    {
+        switch (*end)
+        {
+        case 'g':
+        case 'G':
+            parsed *= _1K;
+            /* fall through */
+        case 'm':
+        case 'M':
+            parsed *= _1K;
+            /* fall through */
+        case 'k':
+        case 'K':
+            parsed *= _1K;
+            end++;
+            break;
+        }
+    }
+    if (*end != '\0' || parsed < key->Min || parsed > key->Max)
+    {
+        return -1;
+    }
+    *number = parsed;
+    return 0;
+}
+
+static int AddMime(ServerConfig *config, const char *value)
+{
+    // "ext type" or ".ext type", repeated for every mapping
+    value += (*value == '.');
+    size_t extensionLength = strcspn(value, " \t");
+    const char *type = value + extensionLength;
+    type += strspn(type, " \t");
+    if (config->MimeCount == CONFIG_MAX_MIME || extensionLength == 0 ||
+        extensionLength >= CONFIG_MIME_EXTENSION || *type == '\0' || strlen(type) >= CONFIG_MIME_TYPE)
+    {
+        return -1;
+    }
+
+    MimeMapping *mapping = &config->Mime[config->MimeCount++];
+    for (size_t i = 0; i < extensionLength; ++i)
+    {
+        mapping->Extension[i] = tolower((unsigned char)value[i]);
+    }
+    mapping->Extension[extensionLength] = '\0';
+    strcpy(mapping->Type, type);
+    return 0;
+}
+
+static int SetValue(ServerConfig *config, const ConfigKey *key, const char *value)
+{
+    char *field = (char *)config + key->Offset;
+    long long number;
+
+    if (key->Type == CONFIG_MIME)
+    {
+        return AddMime(config, value);
+    }
+
+    if (key->Type == CONFIG_PATH)
+    {
+        if (strlen(value) >= CONFIG_PATH_MAX)
+        {
+            return -1;
+        }
+        strcpy(field, value);
+        return 0;
+    }
+    if (ParseNumber(key, value, &number) == -1)
+    {
+        return -1;
+    }
+    if (key->Type == CONFIG_INT)
+    {
+        *(int *)field = (int)number;
+    }
+    else
+    {
+        *(size_t *)field = (size_t)number;
+    }
+    return 0;
+}
+
+static int ParseLine(ServerConfig *config, char *line)
+{
+    line[strcspn(line, "#\r\n")] = '\0';
+    char *key = line + strspn(line, " \t");
+    if (*key == '\0')
+    {
+        return 0;
+    }
+
+    // the value is the rest of the line, so a path may hold spaces
+    char *value = key + strcspn(key, " \t");
+    if (*value != '\0')
+    {
+        *value++ = '\0';
+    }
+    value += strspn(value, " \t");
+    for (size_t length = strlen(value); length > 0 && (value[length - 1] == ' ' || value[length - 1] == '\t');)
+    {
+        value[--length] = '\0';
+    }
+
+    for (size_t i = 0; i < sizeof(Keys) / sizeof(Keys[0]); ++i)
+    {
+        if (strcmp(key, Keys[i].Name) == 0)
+        {
+            if (*value == '\0' || SetValue(config, &Keys[i], value) == -1)
+            {
+                fprintf(stderr, "invalid value \"%s\" for %s", value, key);
+                return -1;
+            }
+            return 0;
+        }
+    }
+    fprintf(stderr, "unknown key %s", key);
+    return -1;
+}
+
+static int CheckRoot(ServerConfig *config)
+{
+    if (config->Root[0] == '\0')
+    {
+        config->RootLength = 0;
+        return 0;
+    }
+
+    // absolute and without a final slash, request paths start with one
+    char resolved[PATH_MAX];
+    if (realpath(config->Root, resolved) == NULL || strlen(resolved) >= CONFIG_PATH_MAX)
+    {
+        fprintf(stderr, "root %s: %s\n", config->Root, strerror(errno));
+        return -1;
+    }
+    if (strcmp(resolved, "/") == 0)
+    {
+        resolved[0] = '\0';
+    }
+    strcpy(config->Root, resolved);
+    config->RootLength = strlen(resolved);
+    return 0;
+}
+
+int ServerConfig_Load(const char *path)
+{
+    FILE *file = fopen(path, "re");
+    if (file == NULL)
+    {
+        fprintf(stderr, "config %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    ServerConfig config = Defaults;
+    char line[2 * CONFIG_PATH_MAX];
+    int number = 0;
+    int failed = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        number++;
+        if (ParseLine(&config, line) == -1)
+        {
+            fprintf(stderr, " (%s line %d)\n", path, number);
+            failed = 1;
+        }
+    }
+    fclose(file);
+
+    if (failed || CheckRoot(&config) == -1)
+    {
+        return -1;
+    }
+    Settings = config;
+    if (path != LoadedPath)
+    {
+        snprintf(LoadedPath, sizeof(LoadedPath), "%s", path);
+    }
+    return 0;
+}
+
+int ServerConfig_Reload(int inPlace)
+{
+    if (LoadedPath[0] == '\0')
+    {
+        return 0; // running on the defaults
+    }
+
+    // the buffers of a running process were sized with the old value, the receive ring of io_uring too
+    size_t bufferSize = Settings.BufferSize;
+    if (ServerConfig_Load(LoadedPath) == -1)
+    {
+        return -1;
+    }
+    if (inPlace && Settings.BufferSize != bufferSize)
+    {
+        fprintf(stderr, "buffer_size is kept at %zu, it changes with an upgrade (SIGUSR2)\n", bufferSize);
+        Settings.BufferSize = bufferSize;
+    }
+    return 0;
+}
@@ -4,10 +4,129 @@
  * Constants        :
  *                    - SERVER_PORT: Default port number for the server.
  *                    - MAX_CONNECTIONS: Maximum number of simultaneous connections.
- * Notes            : Modify these constants as needed to configure the server's behavior.
+ * Functions        :
+ *                    - ServerConfig_Load: Reads the configuration file given with "-c" into Config.
+ *                    - ServerConfig_Reload: Reads the same file again, for the workers started by a reload or
+ *                      in place for a single process, which keeps the buffer_size it allocated with.
+ * Notes            : Modify these constants as needed to configure the server's behavior. The ones
+ *                    Config carries are only defaults, a configuration file overrides them at startup
+ *                    (see server.conf for its keys); the others are sizes fixed at compile time.
  */
+#ifndef SERVER_CONFIG_H
+#define SERVER_CONFIG_H
+
+/*===================================  Includes ==============================*/
+#include <stddef.h>
 
 /*==================================  Definations =============================*/
 #define _1K 1024
-#define SERVER_BUF 4 * _1K
-#define BACKLOG 2
\ No newline at end of file
+#define SERVER_BUF 4 * _1K  // "buffer_size": request head limit and pooled output buffer
+#define BACKLOG 1024    // pending connections, the event loop accepts them in bursts
+#define CONFIG_PATH_MAX 1024                  // longest path a configuration value may hold
+#define CONFIG_MIN_BUFFER _1K                 // "buffer_size" limits
+#define CONFIG_MAX_BUFFER (_1K * _1K)
+#define CONFIG_MAX_MIME 64                    // "mime" lines accepted
+#define CONFIG_MIME_EXTENSION 16              // longest extension, with its terminator
+#define CONFIG_MIME_TYPE 96                   // longest type, with its terminator
+#define MAX_EVENTS 256  // events handled per epoll_wait call
+
+// connection timeouts, in seconds
+#define HEADER_TIMEOUT 10   // to receive a whole request head, from its first byte (or the connection)
+#define BODY_TIMEOUT 10     // without receiving any byte of a request body
+#define KEEPALIVE_TIMEOUT 5 // an idle connection is kept open between two requests
+#define WRITE_TIMEOUT 10    // without the client accepting any byte of the response
+#define TIMER_TICK_MS 100   // resolution of the timing wheel
+#define TIMER_SLOTS 1024    // slots of the timing wheel, a power of two
+
+// static file cache
+#define CACHE_BUCKETS 1024                    // hash table size, a power of two
+#define CACHE_MAX_ENTRIES 1024                // files kept at most
+#define CACHE_MAX_BYTES (64 * _1K * _1K)      // total size of the cached contents
+#define CACHE_MAX_FILE (8 * _1K * _1K)        // larger files are always sent with sendfile
+#define CACHE_INLINE_SIZE (16 * _1K)          // bodies up to this size are copied next to their headers
+#define CACHE_REVALIDATE 2                    // seconds a cached file is served without checking it, by default
+
+// gzip content encoding
+#define GZIP_MIN_SIZE 256                     // smaller files are always sent as they are
+#define GZIP_LEVEL 6                          // zlib level of the compressed variants kept in the cache
+
+// directory listings, "?sort=name|size|mtime&order=asc|desc&page=N&per_page=N"
+#define LISTING_PAGE_SIZE 1000                // entries per page by default
+#define LISTING_MAX_PAGE_SIZE 10000           // largest per_page accepted
+
+// access log
+#define ACCESS_LOG_FILE "access.log"          // appended to by every server process
+#define ACCESS_LOG_RING 16384                 // records queued per process, a power of two
+#define ACCESS_LOG_FLUSH_MS 100               // the logger thread wakes up this often
+#define ACCESS_LOG_PATH 256                   // longer request targets are truncated in the log
+
+// metrics
+#define METRICS_PATH "/__metrics"             // Prometheus text exposition, answered before the file system
+#define METRICS_SLOTS 512                     // counter slots shared by the processes, one per live worker
+
+// reload and upgrade (core/Lifecycle.c)
+#define DRAIN_TIMEOUT 30                      // seconds a draining process waits for its last connections
+#define DRAIN_POLL_MS 1000                    // longest wait of a draining loop between two checks
+
+// connection memory (utilities/BufferPool.c)
+#define POOL_SLAB_OBJECTS 64                  // connections or buffers carved from one allocation
+
+// io_uring event loop ("uring" mode)
+#define URING_ENTRIES 1024                    // submission queue entries, the completion queue has twice as many
+#define URING_BUFFERS 1024                    // receive buffers of buffer_size provided to the kernel, a power of two
+#define URING_STAGE_SIZE (64 * _1K)           // file bytes read and sent by one linked read/send pair
+
+// Cache-Control sent with files and listings, the first matching path prefix applies
+#define CACHE_POLICIES                                  \
+    {                                                   \
+        {"/usr/share/", "public, max-age=86400"},       \
+        {"/", "no-cache"},                              \
+    }
+
+// persistent CGI workers (".fcgi" scripts)
+#define CGI_POOL_SIZE 2                       // workers per script and server process
+#define CGI_MAX_POOL_SIZE 16                  // largest "cgi_workers" accepted
+#define CGI_MAX_SCRIPTS 16                    // scripts with running workers per server process
+#define CGI_TIMEOUT_MS 5000                   // time a worker gets to answer a request
+#define CGI_MAX_RESPONSE (4 * _1K * _1K)      // larger responses are rejected with 502
+
+// one-shot CGI scripts (".cgi"), timed by cgi_timeout_ms too
+#define CGI_MAX_SPAWNED 64                    // scripts running at once per server process, then 503
+
+/*==================================  Structures =============================*/
+typedef struct MimeMapping
+{
+    char Extension[CONFIG_MIME_EXTENSION]; // lower case, without the dot
+    char Type[CONFIG_MIME_TYPE];
+} MimeMapping;
+
+typedef struct ServerConfig
+{
+    int Workers;              // "workers": processes of the workers mode, 0 for one per CPU
+    int Backlog;              // "backlog"
+    size_t BufferSize;        // "buffer_size"
+    int HeaderTimeout;        // "header_timeout", seconds
+    int BodyTimeout;          // "body_timeout"
+    int KeepAliveTimeout;     // "keepalive_timeout"
+    int WriteTimeout;         // "write_timeout"
+    size_t CacheEntries;      // "cache_entries"
+    size_t CacheBytes;        // "cache_bytes"
+    size_t CacheMaxFile;      // "cache_max_file"
+    int CacheRevalidate;      // "cache_revalidate", seconds, 0 to check every request
+    int CgiWorkers;           // "cgi_workers", up to CGI_MAX_POOL_SIZE
+    int CgiTimeoutMs;         // "cgi_timeout_ms"
+    char Root[CONFIG_PATH_MAX];      // "root": prefixed to the request paths, empty to serve the whole file system
+    size_t RootLength;
+    char AccessLog[CONFIG_PATH_MAX]; // "access_log"
+    int MimeSniff;                   // "mime_sniff": type files without a known extension by their first bytes
+    MimeMapping Mime[CONFIG_MAX_MIME]; // "mime <extension> <type>", replacing or adding to the built-in types
+    size_t MimeCount;
+} ServerConfig;
+
+/*=================================  Prototypes ==============================*/
+extern const ServerConfig *Config;
+
+int ServerConfig_Load(const char *path);
+int ServerConfig_Reload(int inPlace);
+
+#endif
@@ -0,0 +1,112 @@
+/*
+ * File Name        : TimerWheel.c
+ * Description      : Implements the hashed timing wheel.
+ * Functions        :
+ *                    - TimerWheel_Arm/TimerWheel_Disarm: Link or unlink a timer in its slot.
+ *                    - TimerWheel_Advance: Walks the slots of the ticks elapsed since the last call.
+ *                    - TimerWheel_NextTimeout: Time left until the next tick.
+ * Notes            : TIMER_SLOTS is a power of two, a slot is found by masking the tick.
+ */
+
+/*===================================  Includes ==============================*/
+#include "TimerWheel.h"
+
+#include <time.h>
+
+/*============================  Function Implementation =======================*/
+long long TimerWheel_Clock(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000LL + now.tv_nsec / 1000000;
+}
+
+static unsigned long long CurrentTick(void)
+{
+    return (unsigned long long)TimerWheel_Clock() / TIMER_TICK_MS;
+}
+
+void TimerWheel_Init(TimerWheel *wheel)
+{
+    // every slot is an empty circular list around its head
+    for (size_t i = 0; i < TIMER_SLOTS; ++i)
+    {
+        wheel->Slots[i].Prev = wheel->Slots[i].Next = &wheel->Slots[i];
+    }
+    wheel->Now = CurrentTick();
+    wheel->Count = 0;
+}
+
+void TimerWheel_Disarm(TimerWheel *wheel, Timer *timer)
+{
+    if (timer->Next == NULL)
+    {
+        return;
+    }
+    timer->Prev->Next = timer->Next;
+    timer->Next->Prev = timer->Prev;
+    timer->Prev = timer->Next = NULL;
+    wheel->Count--;
+}
+
+void TimerWheel_Arm(TimerWheel *wheel, Timer *timer, long long delayMs)
+{
+    TimerWheel_Disarm(wheel, timer);
+
+    // rounded up, a timer never fires early; and never in a tick already expired
+    unsigned long long expires = CurrentTick() + (delayMs + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    if (expires <= wheel->Now)
+    {
+        expires = wheel->Now + 1;
+    }
+    timer->Expires = expires;
+
+    Timer *head = &wheel->Slots[expires & (TIMER_SLOTS - 1)];
+    timer->Prev = head->Prev;
+    timer->Next = head;
+    head->Prev->Next = timer;
+    head->Prev = timer;
+    wheel->Count++;
+}
+
+void TimerWheel_Advance(TimerWheel *wheel, void (*expire)(Timer *timer))
+{
+    unsigned long long target = CurrentTick();
+
+    // after a long pause every slot is visited once, the due timers of all the turns expire
+    unsigned long long tick = wheel->Now;
+    if (target - tick > TIMER_SLOTS)
+    {
+        tick = target - TIMER_SLOTS;
+    }
+
+    while (tick < target)
+    {
+        tick++;
+        Timer *head = &wheel->Slots[tick & (TIMER_SLOTS - 1)];
+        Timer *timer = head->Next;
+        while (timer != head)
+        {
+            // the callback may free the timer, and a later turn stays in the slot
+            Timer *next = timer->Next;
+            if (timer->Expires <= target)
+            {
+                TimerWheel_Disarm(wheel, timer);
+                expire(timer);
+            }
+            timer = next;
+        }
+    }
+    wheel->Now = target;
+}
+
+int TimerWheel_NextTimeout(const TimerWheel *wheel)
+{
+    if (wheel->Count == 0)
+    {
+        return -1;
+    }
+
+    long long next = (long long)(wheel->Now + 1) * TIMER_TICK_MS - TimerWheel_Clock();
+    return (next > 0) ? (int)next : 0;
+}
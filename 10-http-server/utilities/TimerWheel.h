@@ -0,0 +1,47 @@
+/*
+ * File Name        : TimerWheel.h
+ * Description      : Hashed timing wheel, constant time timers for the connection timeouts.
+ * Functions        :
+ *                    - TimerWheel_Init: Starts an empty wheel at the current time.
+ *                    - TimerWheel_Arm: Schedules a timer, or moves an armed one, to expire after a delay.
+ *                    - TimerWheel_Disarm: Cancels a timer.
+ *                    - TimerWheel_Advance: Expires the timers that are due.
+ *                    - TimerWheel_NextTimeout: Milliseconds until the wheel must be advanced again.
+ *                    - TimerWheel_Clock: Monotonic clock in milliseconds.
+ * Notes            : Time is counted in ticks of TIMER_TICK_MS. A timer is kept in the slot of its
+ *                    expiration tick modulo TIMER_SLOTS, in an intrusive doubly linked list, so arming
+ *                    and disarming are O(1) whatever the number of timers. A delay longer than one turn
+ *                    of the wheel waits in its slot for the turns in between. Timers are embedded in the
+ *                    structure they time out, the expire callback gets it back with offsetof.
+ */
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+/*===================================  Includes ==============================*/
+#include <stddef.h>
+
+#include "ServerConfig.h"
+
+/*==================================  Structures =============================*/
+typedef struct Timer
+{
+    unsigned long long Expires;     // tick the timer expires at
+    struct Timer *Prev, *Next;      // slot list, NULL when the timer isn't armed
+} Timer;
+
+typedef struct TimerWheel
+{
+    Timer Slots[TIMER_SLOTS];       // list heads, a slot holds the timers expiring at its ticks
+    unsigned long long Now;         // last tick expired
+    size_t Count;                   // armed timers
+} TimerWheel;
+
+/*=================================  Prototypes ==============================*/
+void TimerWheel_Init(TimerWheel *wheel);
+void TimerWheel_Arm(TimerWheel *wheel, Timer *timer, long long delayMs);
+void TimerWheel_Disarm(TimerWheel *wheel, Timer *timer);
+void TimerWheel_Advance(TimerWheel *wheel, void (*expire)(Timer *timer));
+int TimerWheel_NextTimeout(const TimerWheel *wheel);
+long long TimerWheel_Clock(void);
+
+#endif
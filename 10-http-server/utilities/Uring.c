@@ -0,0 +1,554 @@
+/*
+ * File Name        : Uring.c
+ * Description      : Implements the io_uring rings, the provided buffers and the connection operations.
+ * Functions        :
+ *                    - MapRings: Maps the submission and completion rings and the submission entries.
+ *                    - GetSqe/Flush: Free submission entries, queued ones are submitted when the ring is full.
+ *                    - ProvideBuffer: Gives a receive buffer (back) to the kernel.
+ *                    - Uring_Complete: Stores the result of an operation in its connection.
+ * Notes            : The ring is created with SINGLE_ISSUER and DEFER_TASKRUN when the kernel knows them:
+ *                    completions are then only run when the loop waits for them, in its own thread.
+ *                    The provided buffers need Linux 5.19, as the multishot accept and the cancellation
+ *                    by file descriptor, so a kernel that registers them supports everything used here.
+ */
+
+/*===================================  Includes ==============================*/
+#include "Uring.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/*==================================  Structures =============================*/
+typedef struct Ring
+{
+    int Fd;
+    unsigned *SqHead;           // advanced by the kernel as it consumes the entries
+    unsigned *SqTail;           // published by Flush
+    unsigned SqMask;
+    unsigned SqEntries;
+    unsigned Tail;              // entries handed out by GetSqe, not all published yet
+    struct io_uring_sqe *Sqes;
+    unsigned *CqHead;
+    unsigned *CqTail;
+    unsigned CqMask;
+    struct io_uring_cqe *Cqes;
+    void *SqMap, *CqMap;
+    size_t SqMapSize, CqMapSize;
+    struct io_uring_buf_ring *Buffers; // ring of the provided receive buffers
+    char *Memory;                      // the buffers, URING_BUFFERS of Config->BufferSize
+    unsigned short BufferTail;
+} Ring;
+
+/*============================  Static Variables ==============================*/
+static Ring Uring = {.Fd = -1};
+
+/*============================  Function Implementation =======================*/
+static int MapRings(const struct io_uring_params *params)
+{
+    Uring.SqMapSize = params->sq_off.array + params->sq_entries * sizeof(unsigned);
+    Uring.CqMapSize = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (params->features & IORING_FEAT_SINGLE_MMAP)
+    {
+        // both rings in one mapping
+        if (Uring.CqMapSize > Uring.SqMapSize)
+        {
+            Uring.SqMapSize = Uring.CqMapSize;
+        }
+        Uring.CqMapSize = 0;
+    }
+
+    Uring.SqMap = mmap(NULL, Uring.SqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Uring.Fd,
+                       IORING_OFF_SQ_RING);
+    if (Uring.SqMap == MAP_FAILED)
+    {
+        Uring.SqMap = NULL;
+        return -1;
+    }
+    Uring.CqMap = Uring.SqMap;
+    if (Uring.CqMapSize > 0)
+    {
+        Uring.CqMap = mmap(NULL, Uring.CqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, Uring.Fd,
+                           IORING_OFF_CQ_RING);
+        if (Uring.CqMap == MAP_FAILED)
+        {
+            Uring.CqMap = NULL;
+            return -1;
+        }
+    }
+    Uring.Sqes = mmap(NULL, params->sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, Uring.Fd, IORING_OFF_SQES);
+    if (Uring.Sqes == MAP_FAILED)
+    {
+        Uring.Sqes = NULL;
+        return -1;
+    }
+
+    char *sq = Uring.SqMap;
+    char *cq = Uring.CqMap;
+    Uring.SqHead = (unsigned *)(sq + params->sq_off.head);
+    Uring.SqTail = (unsigned *)(sq + params->sq_off.tail);
+    Uring.SqMask = *(unsigned *)(sq + params->sq_off.ring_mask);
+    Uring.SqEntries = params->sq_entries;
+    Uring.Tail = *Uring.SqTail;
+    Uring.CqHead = (unsigned *)(cq + params->cq_off.head);
+    Uring.CqTail = (unsigned *)(cq + params->cq_off.tail);
+    Uring.CqMask = *(unsigned *)(cq + params->cq_off.ring_mask);
+    Uring.Cqes = (struct io_uring_cqe *)(cq + params->cq_off.cqes);
+
+    // entry i of the submission queue is always submission entry i
+    unsigned *array = (unsigned *)(sq + params->sq_off.array);
+    for (unsigned i = 0; i < params->sq_entries; ++i)
+    {
+        array[i] = i;
+    }
+    return 0;
+}
+
+static void ProvideBuffer(unsigned short id)
+{
+    // addr, len and bid only: the ring tail overlaps the reserved field of the first entry
+    struct io_uring_buf *buffer = &Uring.Buffers->bufs[Uring.BufferTail & (URING_BUFFERS - 1)];
+    buffer->addr = (unsigned long)(Uring.Memory + (size_t)id * Config->BufferSize);
+    buffer->len = Config->BufferSize;
+    buffer->bid = id;
+    Uring.BufferTail++;
+    __atomic_store_n(&Uring.Buffers->tail, Uring.BufferTail, __ATOMIC_RELEASE);
+}
+
+static int SetupBuffers(void)
+{
+    size_t size = URING_BUFFERS * sizeof(struct io_uring_buf);
+    void *ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED)
+    {
+        return -1;
+    }
+    Uring.Buffers = ring;
+    Uring.Memory = malloc((size_t)URING_BUFFERS * Config->BufferSize);
+    if (Uring.Memory == NULL)
+    {
+        return -1;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)ring;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = 0;
+    if (syscall(__NR_io_uring_register, Uring.Fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+    {
+        return -1;
+    }
+
+    for (unsigned i = 0; i < URING_BUFFERS; ++i)
+    {
+        ProvideBuffer(i);
+    }
+    return 0;
+}
+
+int Uring_Init(void)
+{
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+    params.cq_entries = 2 * URING_ENTRIES;
+    Uring.Fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (Uring.Fd < 0 && errno == EINVAL)
+    {
+        // before Linux 6.1, completions are run from task work whenever the kernel likes
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = 2 * URING_ENTRIES;
+        Uring.Fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    }
+    if (Uring.Fd < 0)
+    {
+        return -1;
+    }
+
+    // the wait timeout is passed to io_uring_enter, Linux 5.11
+    if (!(params.features & IORING_FEAT_EXT_ARG) || MapRings(&params) == -1 || SetupBuffers() == -1)
+    {
+        int saved_errno = (params.features & IORING_FEAT_EXT_ARG) ? errno : EOPNOTSUPP;
+        Uring_Exit();
+        errno = saved_errno;
+        return -1;
+    }
+    return 0;
+}
+
+void Uring_Exit(void)
+{
+    if (Uring.Sqes != NULL)
+    {
+        munmap(Uring.Sqes, Uring.SqEntries * sizeof(struct io_uring_sqe));
+    }
+    if (Uring.CqMap != NULL && Uring.CqMap != Uring.SqMap)
+    {
+        munmap(Uring.CqMap, Uring.CqMapSize);
+    }
+    if (Uring.SqMap != NULL)
+    {
+        munmap(Uring.SqMap, Uring.SqMapSize);
+    }
+    if (Uring.Buffers != NULL)
+    {
+        munmap(Uring.Buffers, URING_BUFFERS * sizeof(struct io_uring_buf));
+    }
+    if (Uring.Fd >= 0)
+    {
+        close(Uring.Fd);
+    }
+    free(Uring.Memory);
+    memset(&Uring, 0, sizeof(Uring));
+    Uring.Fd = -1;
+}
+
+static int Flush(unsigned waitFor, int timeoutMs)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned flags = IORING_ENTER_EXT_ARG;
+
+    __atomic_store_n(Uring.SqTail, Uring.Tail, __ATOMIC_RELEASE);
+    unsigned submit = Uring.Tail - __atomic_load_n(Uring.SqHead, __ATOMIC_ACQUIRE);
+
+    memset(&arg, 0, sizeof(arg));
+    if (waitFor > 0)
+    {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeoutMs >= 0)
+        {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+            arg.ts = (unsigned long)&ts;
+        }
+    }
+
+    if (syscall(__NR_io_uring_enter, Uring.Fd, submit, waitFor, flags, &arg, sizeof(arg)) < 0 &&
+        errno != ETIME && errno != EINTR)
+    {
+        return -1;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe *GetSqe(unsigned count)
+{
+    // the entries of a linked pair must be submitted together, so count are made room for at once
+    if (Uring.Tail + count - __atomic_load_n(Uring.SqHead, __ATOMIC_ACQUIRE) > Uring.SqEntries &&
+        Flush(0, -1) == -1)
+    {
+        return NULL;
+    }
+
+    struct io_uring_sqe *sqe = &Uring.Sqes[Uring.Tail & Uring.SqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    Uring.Tail++;
+    return sqe;
+}
+
+int Uring_Accept(int server_fd)
+{
+    struct io_uring_sqe *sqe = GetSqe(1);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+    // no address: every accepted connection would write it to the same place
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = server_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = URING_ACCEPT;
+    return 0;
+}
+
+void Uring_Receive(UringConn *io, int fd)
+{
+    // one receive at a time, none while bytes received before are still waiting
+    if (io->Receiving || io->DataLen > 0 || io->Eof || io->Error != 0)
+    {
+        return;
+    }
+
+    struct io_uring_sqe *sqe = GetSqe(1);
+    if (sqe == NULL)
+    {
+        io->Error = errno;
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = (uintptr_t)io | URING_RECV;
+    io->Receiving = 1;
+    io->InFlight++;
+}
+
+void Uring_Cancel(int fd)
+{
+    struct io_uring_sqe *sqe = GetSqe(1);
+    if (sqe == NULL)
+    {
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = URING_IGNORE;
+}
+
+int Uring_Poll(void *owner, int fd, unsigned events)
+{
+    struct io_uring_sqe *sqe = GetSqe(1);
+    if (sqe == NULL)
+    {
+        return -1;
+    }
+    // one-shot, the owner queues it again when it has to wait once more
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = (uintptr_t)owner | URING_POLL;
+    return 0;
+}
+
+int Uring_Wait(int timeoutMs)
+{
+    return Flush(1, timeoutMs);
+}
+
+int Uring_Next(struct io_uring_cqe *cqe)
+{
+    unsigned head = *Uring.CqHead;
+    if (head == __atomic_load_n(Uring.CqTail, __ATOMIC_ACQUIRE))
+    {
+        return 0;
+    }
+    *cqe = Uring.Cqes[head & Uring.CqMask];
+    __atomic_store_n(Uring.CqHead, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+UringConn *Uring_Complete(const struct io_uring_cqe *cqe)
+{
+    UringConn *io = URING_CONN(cqe->user_data);
+
+    switch (URING_TAG(cqe->user_data))
+    {
+    case URING_RECV:
+        io->Receiving = 0;
+        io->InFlight--;
+        if (cqe->res > 0)
+        {
+            io->Buffer = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            io->Data = Uring.Memory + (size_t)io->Buffer * Config->BufferSize;
+            io->DataLen = cqe->res;
+            break;
+        }
+        if (cqe->flags & IORING_CQE_F_BUFFER)
+        {
+            ProvideBuffer(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+        if (cqe->res == 0)
+        {
+            io->Eof = 1;
+        }
+        else if (cqe->res != -ENOBUFS && cqe->res != -EINTR)
+        {
+            // out of buffers or interrupted: received again on the next run of the connection
+            io->Error = -cqe->res;
+        }
+        break;
+    case URING_SEND:
+        io->Sending = 0;
+        io->InFlight--;
+        io->HasResult = 1;
+        io->Result = cqe->res;
+        break;
+    case URING_READ:
+        io->InFlight--;
+        io->ReadResult = cqe->res;
+        return NULL; // its send completes next
+    case URING_STAGED:
+        io->Sending = 0;
+        io->InFlight--;
+        io->HasResult = 1;
+        io->Result = cqe->res;
+        if (cqe->res == -ECANCELED && io->ReadResult >= 0)
+        {
+            // a short read broke the link: send what is left of the file, nothing at all if it shrank
+            io->Result = 0;
+            io->HasResult = (io->ReadResult == 0);
+            io->StageLimit = io->ReadResult;
+        }
+        else if (cqe->res == -ECANCELED)
+        {
+            io->Result = io->ReadResult;
+        }
+        break;
+    default:
+        return NULL;
+    }
+    return io;
+}
+
+ssize_t Uring_Read(UringConn *io, char *buf, size_t length)
+{
+    if (io->DataLen > 0)
+    {
+        if (length > io->DataLen)
+        {
+            length = io->DataLen;
+        }
+        memcpy(buf, io->Data, length);
+        io->Data += length;
+        io->DataLen -= length;
+        if (io->DataLen == 0)
+        {
+            ProvideBuffer(io->Buffer);
+        }
+        return length;
+    }
+    if (io->Error != 0)
+    {
+        errno = io->Error;
+        io->Error = 0;
+        return -1;
+    }
+    if (io->Eof)
+    {
+        return 0;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+static ssize_t TakeResult(UringConn *io)
+{
+    io->HasResult = 0;
+    if (io->Result < 0)
+    {
+        errno = -io->Result;
+        return -1;
+    }
+    return io->Result;
+}
+
+ssize_t Uring_SendMsg(UringConn *io, int fd, const struct msghdr *msg)
+{
+    if (io->HasResult)
+    {
+        return TakeResult(io);
+    }
+
+    if (!io->Sending)
+    {
+        struct io_uring_sqe *sqe = GetSqe(1);
+        if (sqe == NULL)
+        {
+            return -1;
+        }
+
+        // the kernel reads the vector after the call returns, keep a copy in the connection
+        memcpy(io->Iov, msg->msg_iov, msg->msg_iovlen * sizeof(struct iovec));
+        memset(&io->Msg, 0, sizeof(io->Msg));
+        io->Msg.msg_iov = io->Iov;
+        io->Msg.msg_iovlen = msg->msg_iovlen;
+        if (msg->msg_iovlen == 1)
+        {
+            sqe->opcode = IORING_OP_SEND; // no message header to copy
+            sqe->addr = (uintptr_t)io->Iov[0].iov_base;
+            sqe->len = io->Iov[0].iov_len;
+        }
+        else
+        {
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->addr = (uintptr_t)&io->Msg;
+            sqe->len = 1;
+        }
+        sqe->fd = fd;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = (uintptr_t)io | URING_SEND;
+        io->Sending = 1;
+        io->InFlight++;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+ssize_t Uring_SendFile(UringConn *io, int sock, int file, off_t *offset, size_t count)
+{
+    if (io->HasResult)
+    {
+        ssize_t bytes = TakeResult(io);
+        if (bytes > 0)
+        {
+            *offset += bytes;
+            io->StageLimit = URING_STAGE_SIZE;
+        }
+        return bytes;
+    }
+
+    if (!io->Sending)
+    {
+        if (io->Stage == NULL)
+        {
+            io->Stage = malloc(URING_STAGE_SIZE);
+            io->StageLimit = URING_STAGE_SIZE;
+            if (io->Stage == NULL)
+            {
+                return -1;
+            }
+        }
+
+        struct io_uring_sqe *read = GetSqe(2);
+        if (read == NULL)
+        {
+            return -1;
+        }
+        struct io_uring_sqe *send = GetSqe(1);
+        size_t length = (count < io->StageLimit) ? count : io->StageLimit;
+
+        // the send only starts once the read filled the staging buffer, a short read cancels it
+        read->opcode = IORING_OP_READ;
+        read->fd = file;
+        read->addr = (uintptr_t)io->Stage;
+        read->len = length;
+        read->off = *offset;
+        read->flags = IOSQE_IO_LINK;
+        read->user_data = (uintptr_t)io | URING_READ;
+        send->opcode = IORING_OP_SEND;
+        send->fd = sock;
+        send->addr = (uintptr_t)io->Stage;
+        send->len = length;
+        send->msg_flags = MSG_NOSIGNAL;
+        send->user_data = (uintptr_t)io | URING_STAGED;
+        io->ReadResult = 0;
+        io->Sending = 1;
+        io->InFlight += 2;
+    }
+    errno = EAGAIN;
+    return -1;
+}
+
+void Uring_Release(UringConn *io)
+{
+    if (io->DataLen > 0)
+    {
+        ProvideBuffer(io->Buffer);
+        io->DataLen = 0;
+    }
+    free(io->Stage);
+    io->Stage = NULL;
+}
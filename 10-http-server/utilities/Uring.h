@@ -0,0 +1,87 @@
+/*
+ * File Name        : Uring.h
+ * Description      : Minimal io_uring layer of the "uring" event loop, on the raw system calls.
+ * Functions        :
+ *                    - Uring_Init/Uring_Exit: Sets up the rings and the provided receive buffers, or fails
+ *                      when the kernel lacks one of the features used.
+ *                    - Uring_Accept: Multishot accept, one submission for every connection of the listener.
+ *                    - Uring_Receive: Receives into a buffer the kernel picks from the provided ring.
+ *                    - Uring_Cancel: Cancels every operation still running on a socket.
+ *                    - Uring_Poll: One-shot readiness poll of a socket that isn't a connection (CGI workers).
+ *                    - Uring_Wait: Submits the queued operations and waits for completions, one system call.
+ *                    - Uring_Next/Uring_Complete: Completions, applied to the connection they belong to.
+ *                    - Uring_Read/Uring_SendMsg/Uring_SendFile: read, sendmsg and sendfile of a connection
+ *                      driven by the ring, for ReadRequest, FlushOutput and SendFile.
+ *                    - Uring_Release: Gives back the receive buffer and staging memory of a connection.
+ * Notes            : The state machine of HttpUtils is unchanged: instead of calling the system, an
+ *                    operation is queued and the call fails with EAGAIN like a non-blocking socket. When
+ *                    its completion arrives the loop runs the state machine again, which repeats the
+ *                    same call and now gets the result. A file body is sent by a read into the staging
+ *                    buffer of the connection linked to a send of it, both queued at once. Everything
+ *                    queued during an iteration is submitted with the wait for the next completions.
+ *                    A process has one ring, liburing isn't needed.
+ */
+#ifndef URING_H
+#define URING_H
+
+/*===================================  Includes ==============================*/
+#include <linux/io_uring.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "ServerConfig.h"
+
+/*==================================  Definations =============================*/
+// kind of operation, in the low bits of the user data next to the UringConn pointer
+#define URING_ACCEPT 1 // multishot accept of the listener
+#define URING_RECV 2   // receive into a provided buffer
+#define URING_SEND 3   // send or sendmsg of the output and cached body
+#define URING_READ 4   // file read into the staging buffer, linked to its send
+#define URING_STAGED 5 // send of the staging buffer
+#define URING_IGNORE 6 // cancellation, nothing to do on completion
+#define URING_POLL 7   // poll of another socket, the user data holds its owner instead of a UringConn
+#define URING_TAG(data) ((int)((data) & 7))
+#define URING_CONN(data) ((UringConn *)(uintptr_t)((data) & ~7ULL))
+#define URING_OWNER(data) ((void *)(uintptr_t)((data) & ~7ULL))
+
+/*==================================  Structures =============================*/
+typedef struct UringConn
+{
+    int Active;              // the connection is driven by the ring
+    int InFlight;            // operations queued and not completed, the connection can't be freed before 0
+    int Receiving;           // a receive is queued
+    int Eof;                 // the peer closed its side
+    int Error;               // errno of the last failed receive, returned once by Uring_Read
+    int Closing;             // closed while operations were queued, freed with their last completion
+    char *Data;              // received bytes not consumed yet, the provided buffer is held meanwhile
+    size_t DataLen;
+    unsigned short Buffer;   // id of that buffer
+    int Sending;             // a send (or a read/send pair) is queued
+    int HasResult;           // its result is waiting for the repeated call
+    ssize_t Result;          // bytes sent or -errno
+    struct iovec Iov[2];     // what the queued sendmsg sends, valid until it completes
+    struct msghdr Msg;
+    char *Stage;             // staging buffer of the file bodies, allocated on the first one
+    size_t StageLimit;       // bytes to read next time, lowered by a short read
+    ssize_t ReadResult;      // result of the read of the pair
+} UringConn;
+
+/*=================================  Prototypes ==============================*/
+int Uring_Init(void);
+void Uring_Exit(void);
+int Uring_Accept(int server_fd);
+void Uring_Receive(UringConn *io, int fd);
+void Uring_Cancel(int fd);
+int Uring_Poll(void *owner, int fd, unsigned events);
+int Uring_Wait(int timeoutMs);
+int Uring_Next(struct io_uring_cqe *cqe);
+UringConn *Uring_Complete(const struct io_uring_cqe *cqe);
+ssize_t Uring_Read(UringConn *io, char *buf, size_t length);
+ssize_t Uring_SendMsg(UringConn *io, int fd, const struct msghdr *msg);
+ssize_t Uring_SendFile(UringConn *io, int sock, int file, off_t *offset, size_t count);
+void Uring_Release(UringConn *io);
+
+#endif